@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <string.h>
+#include <math.h>
+#include "augment.h"
+
+// Identity, one-pixel shifts each way, a small rotation each way and a small zoom
+const AugmentTransform defaultAugmentations[NN_TTA_VARIANTS] = {
+    {  0.0,  0.0,   0.0, 1.0 },
+    {  1.0,  0.0,   0.0, 1.0 },
+    { -1.0,  0.0,   0.0, 1.0 },
+    {  0.0,  1.0,   0.0, 1.0 },
+    {  0.0, -1.0,   0.0, 1.0 },
+    {  0.0,  0.0,  10.0, 1.0 },
+    {  0.0,  0.0, -10.0, 1.0 },
+    {  0.0,  0.0,   0.0, 1.1 },
+};
+
+/**
+ * Pixel of an image, zero outside it
+ */
+static inline double pixelAt(const double *src, int width, int height, int x, int y) {
+    return (x >= 0 && x < width && y >= 0 && y < height) ? src[(size_t)y * width + x] : 0.0;
+}
+
+/**
+ * Write one transformed copy of an image
+ * Every output pixel is mapped back through the inverse transform and
+ * sampled bilinearly from src.
+ *
+ * @param src width x height pixels, row by row
+ * @param width Image width
+ * @param height Image height
+ * @param t Transform to apply
+ * @param dst width x height pixels to fill, must not overlap src
+ */
+void augmentImage(const double *src, int width, int height, const AugmentTransform *t, double *dst) {
+    // Whole-pixel shifts (the identity included) are row copies
+    if (t->degrees == 0.0 && t->scale == 1.0 && t->dx == floor(t->dx) && t->dy == floor(t->dy) &&
+        fabs(t->dx) < width && fabs(t->dy) < height) {
+        const int dx = (int)t->dx, dy = (int)t->dy;
+        const int from = dx > 0 ? dx : 0, to = dx < 0 ? width + dx : width;
+        for (int y = 0; y < height; y++) {
+            double *row = dst + (size_t)y * width;
+            memset(row, 0, sizeof(double) * width);
+            if (y - dy < 0 || y - dy >= height) continue;
+            memcpy(row + from, src + (size_t)(y - dy) * width + from - dx, sizeof(double) * (to - from));
+        }
+        return;
+    }
+
+    // Inverse of x' = R * s * (x - c) + c + d, as x = R^T * (x' - c - d) / s + c
+    const double radians = t->degrees * M_PI / 180.0;
+    const double c = cos(radians) / t->scale, s = sin(radians) / t->scale;
+    const double cx = (width - 1) * 0.5, cy = (height - 1) * 0.5;
+    for (int y = 0; y < height; y++) {
+        double v = y - cy - t->dy;
+        for (int x = 0; x < width; x++) {
+            double u = x - cx - t->dx;
+            double sx = c * u + s * v + cx;
+            double sy = -s * u + c * v + cy;
+            double *out = dst + (size_t)y * width + x;
+            if (!(sx > -1.0 && sy > -1.0 && sx < width && sy < height)) {
+                *out = 0.0;   // All four neighbours are outside
+                continue;
+            }
+            int x0 = (int)(sx + 1.0) - 1, y0 = (int)(sy + 1.0) - 1;   // floor, as sx, sy > -1
+            double fx = sx - x0, fy = sy - y0;
+            double top, bottom;
+            if (x0 >= 0 && y0 >= 0 && x0 + 1 < width && y0 + 1 < height) {
+                const double *p = src + (size_t)y0 * width + x0;
+                top = p[0] + fx * (p[1] - p[0]);
+                bottom = p[width] + fx * (p[width + 1] - p[width]);
+            } else {
+                top = (1.0 - fx) * pixelAt(src, width, height, x0, y0) + fx * pixelAt(src, width, height, x0 + 1, y0);
+                bottom = (1.0 - fx) * pixelAt(src, width, height, x0, y0 + 1) +
+                         fx * pixelAt(src, width, height, x0 + 1, y0 + 1);
+            }
+            *out = top + fy * (bottom - top);
+        }
+    }
+}
+
+/**
+ * Write count transformed copies of an image back to back, ready for a batch
+ *
+ * @param src width x height pixels, row by row
+ * @param transforms count transforms, e.g. defaultAugmentations
+ * @param dst count * width * height pixels to fill
+ */
+void augmentImages(const double *src, int width, int height, const AugmentTransform *transforms, int count,
+                   double *dst) {
+    for (int i = 0; i < count; i++) {
+        augmentImage(src, width, height, &transforms[i], dst + (size_t)i * width * height);
+    }
+}
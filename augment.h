@@ -0,0 +1,37 @@
+#ifndef AUGMENT_H
+#define AUGMENT_H
+
+/*
+ * Test-time augmentation (TTA) of square input images.
+ *
+ * A single pass on the centered drawing is brittle when a digit is drawn
+ * off-center or slanted. augmentImages() makes a set of slightly shifted,
+ * rotated and scaled copies of one image (bilinear sampling, zeros outside
+ * the image), and feedForwardAveraged() (nn.h) runs them as one batch, so
+ * every layer's weights are read once for all of them, and averages their
+ * logits before the softmax. The first transform of the default set is the
+ * identity, so the original image always takes part.
+ */
+
+/* ========== Constants ========== */
+
+#define NN_TTA_VARIANTS 8   // Transforms in the default set
+
+/* ========== Data Structures ========== */
+
+// Applied about the image centre: scale, then rotate, then shift
+typedef struct AugmentTransform {
+    double dx, dy;      // Shift in pixels, positive to the right and down
+    double degrees;     // Rotation, clockwise on screen
+    double scale;       // Magnification, 1 for none
+} AugmentTransform;
+
+/* ========== Function Declarations ========== */
+
+extern const AugmentTransform defaultAugmentations[NN_TTA_VARIANTS];
+
+void augmentImage(const double *src, int width, int height, const AugmentTransform *t, double *dst);
+void augmentImages(const double *src, int width, int height, const AugmentTransform *transforms, int count,
+                   double *dst);
+
+#endif // AUGMENT_H
@@ -0,0 +1,425 @@
+// Headless benchmark of model loading, preprocessing and inference
+//
+// usage: bench [options]
+//   -w n          warmup iterations before every timed benchmark (default 100)
+//   -r n          timed iterations of the preprocessing and single-sample benchmarks
+//                 (default 10000); the batch benchmark runs r / 100 + 1
+//   -l n          timed iterations of the load benchmarks (default 10)
+//   -b n          samples per feedForwardBatch call (default 1024)
+//   -m model.nnb  also time loadNetwork on a binary model, and run the rest on it
+//   -p precision  fp64, fp32, fp16 or int8 (default fp64)
+//   -j n          threads for feedForwardBatch (default: every online core)
+//   -o file.json  write the results as JSON
+//   -c file.json  compare against a baseline written by -o; exit 1 on a regression
+//   -t percent    p50 slowdown allowed by -c before it counts as a regression (default 10)
+//   -P file       profile the inference benchmarks per layer and save it, as JSON if
+//                 file ends in .json and as Prometheus text otherwise; the brackets
+//                 add a little to the times
+//
+// Every benchmark reports min, mean, p50, p99, p999 and max per iteration and
+// the items per second at the mean. feedforward_tta times one prediction with
+// test-time augmentation: the NN_TTA_VARIANTS copies of the input made and
+// run as one batch (augment.h). Text weights are read from the working
+// directory like main.c.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "nn.h"
+#include "kernels.h"
+#include "pool.h"
+#include "profile.h"
+#include "augment.h"
+#include "preprocess.h"
+
+#define GRID 28           // Network input is GRID x GRID
+#define CANVAS 1050       // Drawing area of main.c at its default window size
+#define BRUSH_R 10.0      // Brush radius of main.c
+#define MAX_BENCHMARKS 8
+
+typedef struct Result {
+    const char *name;
+    const char *unit;      // Unit of the latency figures
+    int items;             // Samples handled per iteration
+    int reps;
+    double min, mean, p50, p99, p999, max;
+    double itemsPerSecond;
+} Result;
+
+static Result results[MAX_BENCHMARKS];
+static int resultCount = 0;
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Nearest-rank percentile of sorted samples
+ */
+static double percentile(const double *sorted, int count, double p) {
+    int rank = (int)ceil(p / 100.0 * count);
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+/**
+ * Summarize per-iteration times (seconds) into a result
+ * Latencies are reported in microseconds, or milliseconds when the median is above 10 ms.
+ */
+static void record(const char *name, int items, double *seconds, int reps) {
+    if (resultCount == MAX_BENCHMARKS || reps < 1) return;
+    qsort(seconds, reps, sizeof(double), compareDoubles);
+
+    double sum = 0.0;
+    for (int i = 0; i < reps; i++) sum += seconds[i];
+
+    Result *r = &results[resultCount++];
+    double mean = sum / reps;
+    double scale = (percentile(seconds, reps, 50) > 10e-3) ? 1e3 : 1e6;
+    r->name = name;
+    r->unit = (scale == 1e3) ? "ms" : "us";
+    r->items = items;
+    r->reps = reps;
+    r->min = seconds[0] * scale;
+    r->mean = mean * scale;
+    r->p50 = percentile(seconds, reps, 50) * scale;
+    r->p99 = percentile(seconds, reps, 99) * scale;
+    r->p999 = percentile(seconds, reps, 99.9) * scale;
+    r->max = seconds[reps - 1] * scale;
+    r->itemsPerSecond = items / mean;
+}
+
+/* ========== Preprocessing ========== */
+
+/**
+ * Paint a thick line segment into a canvas, like DrawLineEx + DrawCircleV
+ */
+static void drawStroke(unsigned char *canvas, double x0, double y0, double x1, double y1) {
+    double dx = x1 - x0, dy = y1 - y0, len2 = dx * dx + dy * dy;
+    int minX = (int)(fmin(x0, x1) - BRUSH_R), maxX = (int)(fmax(x0, x1) + BRUSH_R);
+    int minY = (int)(fmin(y0, y1) - BRUSH_R), maxY = (int)(fmax(y0, y1) + BRUSH_R);
+    for (int y = minY < 0 ? 0 : minY; y <= maxY && y < CANVAS; y++) {
+        for (int x = minX < 0 ? 0 : minX; x <= maxX && x < CANVAS; x++) {
+            double t = len2 > 0 ? ((x - x0) * dx + (y - y0) * dy) / len2 : 0.0;
+            t = t < 0 ? 0 : (t > 1 ? 1 : t);
+            double ex = x0 + t * dx - x, ey = y0 + t * dy - y;
+            if (ex * ex + ey * ey <= BRUSH_R * BRUSH_R) canvas[(size_t)y * CANVAS + x] = 255;
+        }
+    }
+}
+
+/* ========== Benchmarks ========== */
+
+static void benchTextLoad(int warmup, int reps, double *seconds) {
+    for (int i = -warmup; i < reps; i++) {
+        double t0 = nowSeconds();
+        initializeNetwork(network_structure, n);
+        int status = importNetwork();
+        double t1 = nowSeconds();
+        if (status != 0) {
+            printf("Error: text weights could not be imported\n");
+            exit(1);
+        }
+        if (i >= 0) seconds[i] = t1 - t0;
+        freeNetwork();
+    }
+    record("load_text", 1, seconds, reps);
+}
+
+static void benchBinaryLoad(const char *path, int warmup, int reps, double *seconds) {
+    for (int i = -warmup; i < reps; i++) {
+        double t0 = nowSeconds();
+        int status = loadNetwork(path);
+        double t1 = nowSeconds();
+        if (status != 0) exit(1);
+        if (i >= 0) seconds[i] = t1 - t0;
+        freeNetwork();
+    }
+    record("load_binary", 1, seconds, reps);
+}
+
+static void benchPreprocess(int warmup, int reps, double *seconds, double *input) {
+    unsigned char *canvas = calloc((size_t)CANVAS * CANVAS, 1);
+    if (canvas == NULL) {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+
+    // A "7" drawn with main.c's brush
+    drawStroke(canvas, 300, 250, 700, 250);
+    drawStroke(canvas, 700, 250, 450, 800);
+    drawStroke(canvas, 420, 520, 620, 520);
+
+    for (int i = -warmup; i < reps; i++) {
+        double t0 = nowSeconds();
+        preprocessDigit(canvas, CANVAS, CANVAS, CANVAS, input);
+        double t1 = nowSeconds();
+        if (i >= 0) seconds[i] = t1 - t0;
+    }
+    record("preprocess", 1, seconds, reps);
+    free(canvas);
+}
+
+static void benchSingle(int warmup, int reps, double *seconds, double *input) {
+    for (int i = -warmup; i < reps; i++) {
+        double t0 = nowSeconds();
+        feedForward(input);
+        double t1 = nowSeconds();
+        if (i >= 0) seconds[i] = t1 - t0;
+    }
+    record("feedforward", 1, seconds, reps);
+}
+
+static void benchAugmented(int warmup, int reps, double *seconds, const double *input) {
+    double *variants = malloc(sizeof(double) * NN_TTA_VARIANTS * GRID * GRID);
+    if (variants == NULL) {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    for (int i = -warmup; i < reps; i++) {
+        double t0 = nowSeconds();
+        augmentImages(input, GRID, GRID, defaultAugmentations, NN_TTA_VARIANTS, variants);
+        feedForwardAveraged(variants, NN_TTA_VARIANTS);
+        double t1 = nowSeconds();
+        if (i >= 0) seconds[i] = t1 - t0;
+    }
+    record("feedforward_tta", 1, seconds, reps);
+    free(variants);
+}
+
+static void benchBatch(int warmup, int reps, int batch, double *seconds) {
+    const int inSize = Network[0].size;
+    double *inputs = malloc(sizeof(double) * batch * inSize);
+    double *outputs = malloc(sizeof(double) * batch * Network[n-1].size);
+    if (inputs == NULL || outputs == NULL) {
+        printf("Error: out of memory\n");
+        exit(1);
+    }
+    srand(1);
+    for (size_t i = 0; i < (size_t)batch * inSize; i++) {
+        inputs[i] = (rand() % 4 == 0) ? rand() / (double)RAND_MAX : 0.0;   // Sparse, like digits
+    }
+
+    for (int i = -warmup; i < reps; i++) {
+        double t0 = nowSeconds();
+        feedForwardBatch(inputs, batch, outputs, 1);
+        double t1 = nowSeconds();
+        if (i >= 0) seconds[i] = t1 - t0;
+    }
+    record("feedforward_batch", batch, seconds, reps);
+    free(inputs);
+    free(outputs);
+}
+
+/* ========== Reporting ========== */
+
+static int writeJson(const char *path, const char *precision, int batch, int warmup) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror("Error creating results file");
+        return 1;
+    }
+    fprintf(f, "{\n  \"kernels\": \"%s\",\n  \"precision\": \"%s\",\n  \"threads\": %d,\n", nnKernels->name, precision, poolThreads());
+    fprintf(f, "  \"batch\": %d,\n  \"warmup\": %d,\n  \"benchmarks\": [\n", batch, warmup);
+    for (int i = 0; i < resultCount; i++) {
+        const Result *r = &results[i];
+        fprintf(f, "    { \"name\": \"%s\", \"unit\": \"%s\", \"items\": %d, \"reps\": %d, "
+                   "\"min\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p99\": %.4f, \"p999\": %.4f, "
+                   "\"max\": %.4f, \"items_per_s\": %.1f }%s\n",
+                r->name, r->unit, r->items, r->reps, r->min, r->mean, r->p50, r->p99, r->p999,
+                r->max, r->itemsPerSecond, (i + 1 < resultCount) ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    int status = (fclose(f) == 0) ? 0 : 1;
+    if (status != 0) printf("Error writing %s\n", path);
+    return status;
+}
+
+/**
+ * Find a named benchmark in a results file written by writeJson
+ *
+ * @return Start of its entry, or NULL
+ */
+static const char *baselineEntry(const char *json, const char *name) {
+    char key[96];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    return strstr(json, key);
+}
+
+/**
+ * Locate a field inside one benchmark entry
+ *
+ * @return Start of the value, or NULL
+ */
+static const char *baselineField(const char *entry, const char *field) {
+    char key[32];
+    snprintf(key, sizeof(key), "\"%s\": ", field);
+    const char *end = strchr(entry, '}');
+    const char *at = strstr(entry, key);
+    if (at == NULL || (end != NULL && at > end)) return NULL;
+    return at + strlen(key);
+}
+
+static char *readFile(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror("Error opening baseline");
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *text = malloc((size_t)size + 1);
+    if (text != NULL) {
+        text[fread(text, 1, (size_t)size, f)] = '\0';
+    }
+    fclose(f);
+    return text;
+}
+
+/**
+ * Compare the p50 of every benchmark against a baseline
+ *
+ * @return 0 if nothing regressed, 1 otherwise
+ */
+static int compareBaseline(const char *path, double tolerance) {
+    char *json = readFile(path);
+    if (json == NULL) return 1;
+
+    int regressions = 0;
+    printf("\n%-18s %12s %12s %9s\n", "vs baseline", "base p50", "p50", "change");
+    for (int i = 0; i < resultCount; i++) {
+        const Result *r = &results[i];
+        const char *entry = baselineEntry(json, r->name);
+        const char *p50 = entry ? baselineField(entry, "p50") : NULL;
+        const char *unit = entry ? baselineField(entry, "unit") : NULL;
+        if (p50 == NULL || unit == NULL) {
+            printf("%-18s %12s\n", r->name, "missing");
+            continue;
+        }
+
+        // Bring the baseline to this run's unit
+        double base = strtod(p50, NULL);
+        if (strncmp(unit + 1, r->unit, 2) != 0) {
+            base *= (strncmp(unit + 1, "ms", 2) == 0) ? 1e3 : 1e-3;
+        }
+
+        double change = 100.0 * (r->p50 - base) / base;
+        int regressed = change > tolerance;
+        regressions += regressed;
+        printf("%-18s %10.3f%s %10.3f%s %+8.1f%%%s\n", r->name, base, r->unit, r->p50, r->unit, change,
+               regressed ? "  REGRESSION" : "");
+    }
+    free(json);
+    return regressions > 0;
+}
+
+int main(int argc, char *argv[]) {
+    int warmup = 100, reps = 10000, loadReps = 10, batch = 1024, threads = 0;
+    double tolerance = 10.0;
+    const char *modelPath = NULL, *jsonPath = NULL, *baselinePath = NULL, *profilePath = NULL;
+    const char *precision = "fp64";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            loadReps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            batch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            modelPath = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            precision = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            profilePath = argv[++i];
+        } else {
+            warmup = -1;
+            break;
+        }
+    }
+    if (warmup < 0 || reps < 1 || loadReps < 1 || batch < 1 || precisionFromName(precision) < 0) {
+        printf("usage: %s [-w warmup] [-r reps] [-l load-reps] [-b batch] [-m model.nnb] [-p fp64|fp32|fp16|int8]\n"
+               "       [-j threads] [-o results.json] [-c baseline.json] [-t percent] [-P profile]\n", argv[0]);
+        return 1;
+    }
+
+    int most = reps > loadReps ? reps : loadReps;
+    double *seconds = malloc(sizeof(double) * most);
+    double *input = malloc(sizeof(double) * GRID * GRID);
+    if (seconds == NULL || input == NULL) {
+        printf("Error: out of memory\n");
+        return 1;
+    }
+
+    // --- Loading (the warmup is one load: it fills the page cache) ---
+    setNetworkPrecision(precisionFromName(precision));
+    benchTextLoad(1, loadReps, seconds);
+    if (modelPath != NULL) {
+        benchBinaryLoad(modelPath, 1, loadReps, seconds);
+    }
+
+    // --- Preprocessing and inference ---
+    benchPreprocess(warmup, reps, seconds, input);
+    if (modelPath != NULL) {
+        if (loadNetwork(modelPath) != 0) return 1;
+    } else {
+        initializeNetwork(network_structure, n);
+        if (importNetwork() != 0) return 1;
+    }
+    if (Network[0].size != GRID * GRID) {
+        printf("Error: the network does not take %dx%d images\n", GRID, GRID);
+        return 1;
+    }
+    setNetworkThreads(threads, 0);
+    if (profilePath != NULL) {
+        if (profilingLevel() == NN_PROFILE_OFF) setProfiling(NN_PROFILE_TIMERS);
+        resetProfile();
+    }
+    benchSingle(warmup, reps, seconds, input);
+    benchAugmented(warmup, reps, seconds, input);
+    benchBatch(warmup / 10 + 1, reps / 100 + 1, batch, seconds);
+
+    // --- Report ---
+    printf("\n%s kernels, %s, %d threads\n", nnKernels->name, precision, poolThreads());
+    printf("%-18s %6s %10s %10s %10s %10s %10s %13s\n", "benchmark", "reps", "min", "p50", "p99", "p999", "max", "items/s");
+    for (int i = 0; i < resultCount; i++) {
+        const Result *r = &results[i];
+        printf("%-18s %6d %8.2f%s %8.2f%s %8.2f%s %8.2f%s %8.2f%s %13.0f\n", r->name, r->reps,
+               r->min, r->unit, r->p50, r->unit, r->p99, r->unit, r->p999, r->unit, r->max, r->unit,
+               r->itemsPerSecond);
+    }
+
+    int status = 0;
+    if (jsonPath != NULL && writeJson(jsonPath, precision, batch, warmup) != 0) status = 1;
+    if (baselinePath != NULL && compareBaseline(baselinePath, tolerance) != 0) status = 1;
+    if (profilePath != NULL) {
+        ProfileSnapshot profile;
+        profileSnapshot(&profile);
+        if (writeProfileFile(profilePath, &profile) != 0) status = 1;
+    }
+
+    free(seconds);
+    free(input);
+    freeNetwork();
+    return status;
+}
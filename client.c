@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "client.h"
+
+/* ========== Helpers ========== */
+
+/**
+ * Read exactly `size` bytes
+ *
+ * @return 0 on success, 1 on error or end of stream
+ */
+static int readFull(int fd, void *buf, size_t size) {
+    unsigned char *p = buf;
+    while (size > 0) {
+        ssize_t got = read(fd, p, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return 1;
+        p += got;
+        size -= (size_t)got;
+    }
+    return 0;
+}
+
+/**
+ * Send a header and its payload with one system call where possible
+ *
+ * @return 0 on success, 1 on error
+ */
+static int writeMessage(int fd, const void *header, size_t headerSize, const void *payload, size_t payloadSize) {
+    struct iovec parts[2] = { { (void*)header, headerSize }, { (void*)payload, payloadSize } };
+    int first = 0;
+    while (first < 2) {
+        ssize_t sent = writev(fd, parts + first, 2 - first);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return 1;
+        while (first < 2 && (size_t)sent >= parts[first].iov_len) {
+            sent -= (ssize_t)parts[first].iov_len;
+            first++;
+        }
+        if (first < 2) {
+            parts[first].iov_base = (unsigned char*)parts[first].iov_base + sent;
+            parts[first].iov_len -= (size_t)sent;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Send one request and read its reply header and payload
+ *
+ * @param payloadOut Buffer for the reply payload (may be NULL if capacity is 0)
+ * @param capacity Bytes available in payloadOut; a longer payload is an error
+ * @return The reply's value field on success, -1 on failure
+ */
+static int roundTrip(int fd, int type, int flags, const void *payload, size_t size, void *payloadOut, size_t capacity) {
+    static uint32_t nextId = 0;
+    RequestHeader request = { NN_REQUEST_MAGIC, (uint8_t)type, (uint8_t)flags, 0, 0, (uint32_t)size };
+    request.id = __atomic_add_fetch(&nextId, 1, __ATOMIC_RELAXED);
+
+    ResponseHeader response;
+    if (writeMessage(fd, &request, sizeof(request), payload, size) != 0 ||
+        readFull(fd, &response, sizeof(response)) != 0) {
+        fprintf(stderr, "Error: lost the connection to the daemon\n");
+        return -1;
+    }
+    if (response.magic != NN_RESPONSE_MAGIC || response.id != request.id || response.length > capacity) {
+        fprintf(stderr, "Error: malformed reply from the daemon\n");
+        return -1;
+    }
+    if (response.length > 0 && readFull(fd, payloadOut, response.length) != 0) {
+        fprintf(stderr, "Error: lost the connection to the daemon\n");
+        return -1;
+    }
+    if (response.status != NN_STATUS_OK) {
+        fprintf(stderr, "Error: daemon refused the request (%s)\n",
+                response.status == NN_STATUS_OVERLOADED ? "overloaded" :
+                response.status == NN_STATUS_FAILED ? "failed" : "bad request");
+        return -1;
+    }
+    return response.value;
+}
+
+/* ========== Connection ========== */
+
+/**
+ * Connect to a daemon
+ *
+ * @param path Socket path the daemon listens on
+ * @return Socket descriptor, or -1 on failure
+ */
+int clientConnect(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: socket path %s is too long\n", path);
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Error creating socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Error connecting to %s: ", path);
+        perror("");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void clientClose(int fd) {
+    if (fd >= 0) close(fd);
+}
+
+/* ========== Requests ========== */
+
+/**
+ * Classify one sample given as network input
+ *
+ * @param fd Connection
+ * @param inputs count values in [0, 1]
+ * @param count Number of values (the network's input size)
+ * @param probabilities Receives the class probabilities, or NULL to skip them
+ * @param classes Entries available in probabilities
+ * @return Predicted class, or -1 on failure
+ */
+int clientPredict(int fd, const double *inputs, int count, float *probabilities, int classes) {
+    return roundTrip(fd, NN_REQ_PREDICT_F64, probabilities ? NN_FLAG_PROBABILITIES : 0, inputs,
+                     sizeof(double) * count, probabilities, probabilities ? sizeof(float) * classes : 0);
+}
+
+/**
+ * Classify one raw image of 0-255 pixels
+ * Same as clientPredict, with a quarter of the bytes on the wire.
+ */
+int clientPredictPixels(int fd, const unsigned char *pixels, int count, float *probabilities, int classes) {
+    return roundTrip(fd, NN_REQ_PREDICT_U8, probabilities ? NN_FLAG_PROBABILITIES : 0, pixels,
+                     (size_t)count, probabilities, probabilities ? sizeof(float) * classes : 0);
+}
+
+/**
+ * Fetch the daemon's queue and batching statistics
+ *
+ * @return 0 on success, 1 on failure
+ */
+int clientStats(int fd, ServeStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    return roundTrip(fd, NN_REQ_STATS, 0, NULL, 0, stats, sizeof(*stats)) < 0 ? 1 : 0;
+}
+
+/**
+ * Make the daemon reload its model file
+ * Returns once the new model serves; predictions keep being answered meanwhile.
+ *
+ * @return 0 on success, 1 on failure (the daemon keeps its current model)
+ */
+int clientReload(int fd) {
+    return roundTrip(fd, NN_REQ_RELOAD, 0, NULL, 0, NULL, 0) < 0 ? 1 : 0;
+}
+
+/**
+ * Fetch the daemon's metrics as text (see NN_REQ_METRICS)
+ *
+ * @param json Non-zero for the profile as JSON, zero for Prometheus text
+ * @param text Receives the text, NUL-terminated
+ * @param capacity Bytes available in text; a longer reply is an error
+ * @return 0 on success, 1 on failure
+ */
+int clientMetrics(int fd, int json, char *text, size_t capacity) {
+    if (capacity == 0) return 1;
+    memset(text, 0, capacity);
+    return roundTrip(fd, NN_REQ_METRICS, json ? NN_FLAG_JSON : 0, NULL, 0, text, capacity - 1) < 0 ? 1 : 0;
+}
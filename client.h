@@ -0,0 +1,24 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+/*
+ * Client library for the inference daemon (serve.c); see protocol.h.
+ *
+ * A connection is a plain socket descriptor and handles one request at a
+ * time, so give every thread its own.
+ */
+
+#include <stddef.h>
+#include "protocol.h"
+
+/* ========== Function Declarations ========== */
+
+int clientConnect(const char *path);
+void clientClose(int fd);
+int clientPredict(int fd, const double *inputs, int count, float *probabilities, int classes);
+int clientPredictPixels(int fd, const unsigned char *pixels, int count, float *probabilities, int classes);
+int clientStats(int fd, ServeStats *stats);
+int clientReload(int fd);
+int clientMetrics(int fd, int json, char *text, size_t capacity);
+
+#endif // CLIENT_H
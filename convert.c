@@ -0,0 +1,96 @@
+// Program to convert the text weights W1.txt(784X128), W2.txt(128X10), b1.txt and b2.txt
+// into a binary model file that loadNetwork() maps in place
+//
+// usage: convert [-t] [-a layers] [-l rows|columns] [-o model.nnb]
+//   -t  read W<i>_transpose.txt (one row per neuron) instead of W<i>.txt (one row per input)
+//   -a  network description, e.g. 784,256:tanh,64,10 (default 784,128,10); a layer
+//       is relu, linear, sigmoid or tanh, hidden layers default to relu and the
+//       output layer to linear. Reads W<i>.txt and b<i>.txt for every layer i.
+//   -l  layout of the weights in the model file: rows, one per neuron, which
+//       is mapped in place (default), or columns, one per input (see model.h)
+//       Layers that are mostly zeros (see prune.c) are stored as CSR either way
+//   -o  output file (default model.nnb)
+
+#include <stdio.h>
+#include <string.h>
+#include "nn.h"
+#include "parse.h"
+#include "model.h"
+#include "sparse.h"
+
+#define MAX_LAYERS 64
+
+/**
+ * Read one layer's weights and biases from the text files into Network[h]
+ * W<h>.txt is stored one row per input, so it is transposed while it is
+ * parsed; W<h>_transpose.txt is already one row per neuron.
+ *
+ * @return 0 on success, 1 on failure
+ */
+static int readLayer(int h, int transposed) {
+    Layer *l = &Network[h];
+    char wname[64], bname[64];
+    snprintf(wname, sizeof(wname), "W%d%s.txt", h, transposed ? "_transpose" : "");
+    snprintf(bname, sizeof(bname), "b%d.txt", h);
+
+    int rows = transposed ? l->size : l->inputs;
+    int cols = transposed ? l->inputs : l->size;
+    if (readTextMatrix(wname, l->weights, rows, cols, (size_t)l->stride, !transposed) != 0 ||
+        readTextMatrix(bname, l->bias, 1, l->size, (size_t)l->size, 0) != 0) {
+        printf("Error reading %s or %s.\n", wname, bname);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *out = "model.nnb";
+    const char *spec = "784,128,10";
+    int transposed = 0, layout = NN_LAYOUT_ROWS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0) {
+            transposed = 1;
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            spec = argv[++i];
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc && strcmp(argv[i+1], "rows") == 0) {
+            layout = NN_LAYOUT_ROWS;
+            i++;
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc && strcmp(argv[i+1], "columns") == 0) {
+            layout = NN_LAYOUT_COLUMNS;
+            i++;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else {
+            printf("usage: %s [-t] [-a layers] [-l rows|columns] [-o model.nnb]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    int structure[MAX_LAYERS], activations[MAX_LAYERS];
+    int layers = parseNetworkSpec(spec, structure, activations, MAX_LAYERS);
+    if (layers < 0) {
+        return 1;
+    }
+    initializeNetwork(structure, layers);
+    setNetworkThreads(0, 0);   // Parse the text files on every core
+    for (int h = 1; h < n; h++) {
+        Network[h].activation = activations[h];
+    }
+
+    for (int h = 1; h < n; h++) {
+        if (readLayer(h, transposed) != 0) {
+            freeNetwork();
+            return 1;
+        }
+    }
+
+    if (writeModelFile(out, Network, n, layout, NN_CSR_DENSITY) != 0) {
+        freeNetwork();
+        return 1;
+    }
+
+    printf("Wrote %s\n", out);
+    freeNetwork();
+    return 0;
+}
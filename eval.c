@@ -0,0 +1,156 @@
+// Program to score the network on a labelled IDX data set (e.g. the MNIST test set)
+//
+// usage: eval [-m model.nnb] [-p fp64|fp32|fp16|int8] [-b batch] [-j threads] [-P file] images.idx labels.idx
+//   -m  binary model to load (default: the text files, like main.c)
+//   -p  precision to run at (default fp64)
+//   -b  samples per batch (default 1024)
+//   -j  threads for inference (default: every online core)
+//   -P  profile the scoring per layer and save it, as JSON if file ends in
+//       .json and as Prometheus text otherwise (NN_PROFILE=perf adds hardware counters)
+//
+// The files are streamed: a decoder thread converts the next batches while
+// the network runs on the current one, so the set can be larger than RAM.
+// Reports accuracy, the confusion matrix and images per second.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "nn.h"
+#include "idx.h"
+#include "pool.h"
+#include "profile.h"
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    const char *modelPath = NULL, *profilePath = NULL;
+    const char *precision = "fp64";
+    const char *paths[2] = { NULL, NULL };
+    int batchSize = 1024, threads = 0, positional = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            modelPath = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            precision = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            batchSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            profilePath = argv[++i];
+        } else if (argv[i][0] != '-' && positional < 2) {
+            paths[positional++] = argv[i];
+        } else {
+            positional = -1;
+            break;
+        }
+    }
+    if (positional != 2 || batchSize < 1 || precisionFromName(precision) < 0) {
+        printf("usage: %s [-m model.nnb] [-p fp64|fp32|fp16|int8] [-b batch] [-j threads] [-P file] images.idx labels.idx\n", argv[0]);
+        return 1;
+    }
+
+    // --- Load the model and open the data set ---
+    setNetworkPrecision(precisionFromName(precision));
+    if (modelPath != NULL) {
+        if (loadNetwork(modelPath) != 0) return 1;
+    } else {
+        initializeNetwork(network_structure, n);
+        if (importNetwork() != 0) return 1;
+    }
+    setNetworkThreads(threads, 0);
+
+    IdxFile images, labels;
+    if (openIdx(paths[0], &images) != 0) return 1;
+    if (openIdx(paths[1], &labels) != 0) return 1;
+    if (images.itemSize != (size_t)Network[0].size) {
+        printf("Error: images have %zu pixels, the network takes %d\n", images.itemSize, Network[0].size);
+        return 1;
+    }
+
+    const int classes = Network[n-1].size;
+    double *outputs = malloc(sizeof(double) * batchSize * classes);
+    size_t *confusion = calloc((size_t)classes * classes, sizeof(size_t));   // [label][prediction]
+    IdxStream *stream = openIdxStream(&images, &labels, batchSize);
+    if (outputs == NULL || confusion == NULL || stream == NULL) {
+        printf("Error: out of memory\n");
+        return 1;
+    }
+
+    // --- Score the set batch by batch ---
+    if (profilePath != NULL) {
+        if (profilingLevel() == NN_PROFILE_OFF) setProfiling(NN_PROFILE_TIMERS);
+        resetProfile();
+    }
+    size_t correct = 0, scored = 0, skipped = 0;
+    double inference = 0.0;
+    double started = nowSeconds();
+    IdxBatch batch;
+    while (nextIdxBatch(stream, &batch)) {
+        double t0 = nowSeconds();
+        if (feedForwardBatch(batch.inputs, batch.count, outputs, 0) != 0) return 1;
+        inference += nowSeconds() - t0;
+
+        for (int b = 0; b < batch.count; b++) {
+            const double *row = outputs + (size_t)b * classes;
+            int pred = 0;
+            for (int o = 1; o < classes; o++) {
+                if (row[o] > row[pred]) pred = o;
+            }
+            int label = batch.labels[b];
+            if (label >= classes) {
+                skipped++;
+                continue;
+            }
+            confusion[(size_t)label * classes + pred]++;
+            correct += (pred == label);
+            scored++;
+        }
+    }
+    double elapsed = nowSeconds() - started;
+    ProfileSnapshot profile;
+    profileSnapshot(&profile);
+
+    // --- Report ---
+    printf("\n--- %s on %zu samples (%s, %d threads) ---\n", precision, images.count, paths[0], poolThreads());
+    printf("Accuracy:    %.2f%% (%zu / %zu)\n", scored ? 100.0 * correct / scored : 0.0, correct, scored);
+    if (skipped > 0) {
+        printf("Skipped:     %zu samples with labels >= %d\n", skipped, classes);
+    }
+    printf("Throughput:  %.0f images/s end to end, %.0f images/s inference only\n",
+           images.count / elapsed, images.count / inference);
+
+    printf("\nConfusion matrix (rows: label, columns: prediction)\n      ");
+    for (int p = 0; p < classes; p++) printf("%7d", p);
+    printf("  recall\n");
+    for (int l = 0; l < classes; l++) {
+        size_t total = 0;
+        printf("%5d ", l);
+        for (int p = 0; p < classes; p++) {
+            size_t c = confusion[(size_t)l * classes + p];
+            total += c;
+            printf("%7zu", c);
+        }
+        printf("  %5.1f%%\n", total ? 100.0 * confusion[(size_t)l * classes + l] / total : 0.0);
+    }
+
+    int status = 0;
+    if (profilePath != NULL) {
+        status = writeProfileFile(profilePath, &profile);
+        if (status == 0) printf("\nProfile saved to %s\n", profilePath);
+    }
+
+    closeIdxStream(stream);
+    free(outputs);
+    free(confusion);
+    closeIdx(&images);
+    closeIdx(&labels);
+    freeNetwork();
+    return status;
+}
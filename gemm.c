@@ -0,0 +1,521 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "gemm.h"
+#include "kernels.h"
+#include "nn.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define GEMM_MAX_BLOCK 256    // Largest gemmRows x gemmCols of any kernel table
+#define GEMM_MAX_COLS 32      // Largest gemmCols
+
+/* ========== Private State ========== */
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_once_t once;
+    GemmTuning tuning;        // Loaded or set sizes, mc == 0 for none
+    long cache[3];            // L1 data, L2 and L3 bytes
+} state = { .lock = PTHREAD_MUTEX_INITIALIZER, .once = PTHREAD_ONCE_INIT };
+
+/* ========== Helpers ========== */
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int roundUp(int value, int multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+static int clampInt(int value, int low, int high) {
+    return value < low ? low : value > high ? high : value;
+}
+
+static size_t alignUp(size_t bytes) {
+    return (bytes + NN_ALIGN - 1) & ~(size_t)(NN_ALIGN - 1);
+}
+
+static int readTuning(const char *path, GemmTuning *t);
+
+/**
+ * Cache sizes, then the tuning file, once per process
+ */
+static void loadState(void) {
+    long fallback[3] = { 32 << 10, 256 << 10, 8 << 20 };
+    memcpy(state.cache, fallback, sizeof(fallback));
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+    long found[3] = { sysconf(_SC_LEVEL1_DCACHE_SIZE), sysconf(_SC_LEVEL2_CACHE_SIZE), sysconf(_SC_LEVEL3_CACHE_SIZE) };
+    for (int i = 0; i < 3; i++) {
+        if (found[i] > 0) state.cache[i] = found[i];
+    }
+#endif
+
+    const char *path = getenv("NN_GEMM_TUNING");
+    FILE *probe = fopen(path != NULL ? path : NN_GEMM_PROFILE, "r");
+    if (probe == NULL) {
+        if (path != NULL) fprintf(stderr, "Warning: cannot open %s, using the default GEMM tiling\n", path);
+        return;
+    }
+    fclose(probe);
+    GemmTuning t;
+    if (readTuning(path != NULL ? path : NN_GEMM_PROFILE, &t) == 0) state.tuning = t;
+}
+
+/**
+ * Round a tuning to whole panels of a kernel table and keep it in range
+ */
+static void fitTuning(const Kernels *kt, GemmTuning *t) {
+    t->mc = roundUp(clampInt(t->mc, kt->gemmRows, 4096), kt->gemmRows);
+    t->kc = clampInt(t->kc, 16, 4096);
+    t->nc = roundUp(clampInt(t->nc, kt->gemmCols, 16384), kt->gemmCols);
+}
+
+/**
+ * Default block sizes for a kernel table from the cache sizes
+ * A kc x gemmCols panel of B takes half of L1, an mc x kc block of A an
+ * eighth of L2 (larger blocks measured slower) and a kc x nc block of B half
+ * of L3, up to 4096 columns since L3 is shared with the other cores.
+ */
+static void defaultsFor(const Kernels *kt, GemmTuning *t) {
+    snprintf(t->kernel, sizeof(t->kernel), "%s", kt->name);
+    t->kc = (int)(state.cache[0] / 2 / ((long)sizeof(double) * kt->gemmCols)) / 8 * 8;
+    t->kc = clampInt(t->kc, 64, 512);
+    t->mc = (int)(state.cache[1] / 8 / ((long)sizeof(double) * t->kc)) / kt->gemmRows * kt->gemmRows;
+    t->nc = (int)(state.cache[2] / 2 / ((long)sizeof(double) * t->kc)) / kt->gemmCols * kt->gemmCols;
+    if (t->nc > 4096) t->nc = 4096;
+    fitTuning(kt, t);
+}
+
+/**
+ * Block sizes to use with a kernel table: the loaded or set ones if they
+ * were tuned for it, the defaults otherwise
+ */
+static void tuningFor(const Kernels *kt, GemmTuning *t) {
+    pthread_once(&state.once, loadState);
+    pthread_mutex_lock(&state.lock);
+    *t = state.tuning;
+    pthread_mutex_unlock(&state.lock);
+    if (t->mc > 0 && strcmp(t->kernel, kt->name) == 0) {
+        fitTuning(kt, t);
+    } else {
+        defaultsFor(kt, t);
+    }
+}
+
+/**
+ * Bytes of the packed block of A, and of both blocks, for an m x n x k product
+ */
+static size_t packABytes(const Kernels *kt, const GemmTuning *t, int m, int k) {
+    int mc = t->mc < roundUp(m, kt->gemmRows) ? t->mc : roundUp(m, kt->gemmRows);
+    int kc = t->kc < k ? t->kc : k;
+    return alignUp(sizeof(double) * mc * kc);
+}
+
+static size_t packBytes(const Kernels *kt, const GemmTuning *t, int m, int n, int k) {
+    int nc = t->nc < roundUp(n, kt->gemmCols) ? t->nc : roundUp(n, kt->gemmCols);
+    int kc = t->kc < k ? t->kc : k;
+    return packABytes(kt, t, m, k) + alignUp(sizeof(double) * (size_t)kc * nc);
+}
+
+/* ========== Packing ========== */
+
+/**
+ * Copy rows x depth of op(A), from row i0 and column p0, into panels of
+ * mr rows: panel r holds a[p * mr + i] for row r * mr + i, zero past the edge
+ */
+static void packA(int transA, const double *a, int lda, int i0, int p0, int rows, int depth, int mr, double *dst) {
+    for (int r = 0; r < rows; r += mr) {
+        double *panel = dst + (size_t)r * depth;
+        int height = rows - r < mr ? rows - r : mr;
+        if (height < mr) memset(panel, 0, sizeof(double) * mr * depth);
+        if (transA) {
+            for (int p = 0; p < depth; p++) {
+                memcpy(panel + (size_t)p * mr, a + (size_t)(p0 + p) * lda + i0 + r, sizeof(double) * height);
+            }
+        } else {
+            for (int i = 0; i < height; i++) {
+                const double *src = a + (size_t)(i0 + r + i) * lda + p0;
+                for (int p = 0; p < depth; p++) panel[(size_t)p * mr + i] = src[p];
+            }
+        }
+    }
+}
+
+/**
+ * Copy depth x cols of op(B), from row p0 and column j0, into panels of
+ * nr columns: panel s holds b[p * nr + j] for column s * nr + j
+ */
+static void packB(int transB, const double *b, int ldb, int p0, int j0, int depth, int cols, int nr, double *dst) {
+    for (int s = 0; s < cols; s += nr) {
+        double *panel = dst + (size_t)s * depth;
+        int width = cols - s < nr ? cols - s : nr;
+        if (width < nr) memset(panel, 0, sizeof(double) * nr * depth);
+        if (transB) {
+            // Columns of op(B) are rows of b: read them side by side, write each panel row once
+            const double *src[GEMM_MAX_COLS];
+            for (int j = 0; j < width; j++) src[j] = b + (size_t)(j0 + s + j) * ldb + p0;
+            for (int p = 0; p < depth; p++) {
+                double *row = panel + (size_t)p * nr;
+                for (int j = 0; j < width; j++) row[j] = src[j][p];
+            }
+        } else {
+            for (int p = 0; p < depth; p++) {
+                memcpy(panel + (size_t)p * nr, b + (size_t)(p0 + p) * ldb + j0 + s, sizeof(double) * width);
+            }
+        }
+    }
+}
+
+/* ========== Multiply ========== */
+
+/**
+ * Multiply blocks of A and B already packed into C, one microkernel block at a time
+ *
+ * @param aStride Doubles per gemmRows rows of packed A: depth, or k for a whole-matrix copy
+ */
+static void multiplyPacked(const Kernels *kt, const double *pa, int aStride, const double *pb, int rows, int cols,
+                           int depth, double *c, int ldc, int accumulate) {
+    const int mr = kt->gemmRows, nr = kt->gemmCols;
+    double edge[GEMM_MAX_BLOCK];
+
+    for (int s = 0; s < cols; s += nr) {
+        const double *bp = pb + (size_t)s * depth;
+        int width = cols - s < nr ? cols - s : nr;
+        for (int r = 0; r < rows; r += mr) {
+            const double *ap = pa + (size_t)r * aStride;
+            int height = rows - r < mr ? rows - r : mr;
+            double *cp = c + (size_t)r * ldc + s;
+            if (height == mr && width == nr) {
+                kt->gemmKernel(depth, ap, bp, cp, ldc, accumulate);
+                continue;
+            }
+            // Partial block: through the buffer
+            kt->gemmKernel(depth, ap, bp, edge, nr, 0);
+            for (int i = 0; i < height; i++) {
+                double *ci = cp + (size_t)i * ldc;
+                for (int j = 0; j < width; j++) {
+                    ci[j] = accumulate ? ci[j] + edge[i * nr + j] : edge[i * nr + j];
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Workspace gemm() needs for an m x n x k product with the current tiling
+ *
+ * @return Bytes, a multiple of NN_ALIGN
+ */
+size_t gemmWorkspaceBytes(int m, int n, int k) {
+    const Kernels *kt = nnKernels;
+    GemmTuning t;
+    tuningFor(kt, &t);
+    return packBytes(kt, &t, m, n, k);
+}
+
+/**
+ * Blocked product behind gemm and gemmPackedA; packedA, if not NULL, replaces a
+ */
+static int multiply(int transA, const double *a, int lda, const double *packedA, int transB, const double *b,
+                    int ldb, int m, int n, int k, double *c, int ldc, int accumulate, void *workspace,
+                    size_t workspaceBytes) {
+    if (m <= 0 || n <= 0) return 0;
+    if (k <= 0) {
+        for (int i = 0; i < m && !accumulate; i++) memset(c + (size_t)i * ldc, 0, sizeof(double) * n);
+        return 0;
+    }
+
+    const Kernels *kt = nnKernels;
+    GemmTuning t;
+    tuningFor(kt, &t);
+    size_t need = packBytes(kt, &t, m, n, k);
+    void *owned = NULL;
+    if (workspace == NULL || workspaceBytes < need) {
+        workspace = owned = alignedAlloc(need);
+        if (workspace == NULL) {
+            fprintf(stderr, "Memory allocation failed for GEMM workspace\n");
+            return 1;
+        }
+    }
+    int mc = t.mc < roundUp(m, kt->gemmRows) ? t.mc : roundUp(m, kt->gemmRows);
+    double *pa = workspace;
+    double *pb = (double*)((unsigned char*)workspace + packABytes(kt, &t, m, k));
+
+    // jc: nc columns of C; pc: kc deep slice; ic: mc rows
+    for (int jc = 0; jc < n; jc += t.nc) {
+        int cols = n - jc < t.nc ? n - jc : t.nc;
+        for (int pc = 0; pc < k; pc += t.kc) {
+            int depth = k - pc < t.kc ? k - pc : t.kc;
+            packB(transB, b, ldb, pc, jc, depth, cols, kt->gemmCols, pb);
+            for (int ic = 0; ic < m; ic += mc) {
+                int rows = m - ic < mc ? m - ic : mc;
+                double *cp = c + (size_t)ic * ldc + jc;
+                if (packedA != NULL) {
+                    multiplyPacked(kt, packedA + (size_t)ic * k + (size_t)pc * kt->gemmRows, k, pb, rows, cols,
+                                   depth, cp, ldc, accumulate || pc > 0);
+                } else {
+                    packA(transA, a, lda, ic, pc, rows, depth, kt->gemmRows, pa);
+                    multiplyPacked(kt, pa, depth, pb, rows, cols, depth, cp, ldc, accumulate || pc > 0);
+                }
+            }
+        }
+    }
+    if (owned != NULL) alignedFree(owned);
+    return 0;
+}
+
+/**
+ * C = op(A) * op(B), or C += op(A) * op(B)
+ * All matrices are row-major. op(A) is m x k: A itself (m rows of lda) or,
+ * with transA, the transpose of a k x m matrix (k rows of lda); likewise
+ * op(B) is k x n, from B or from an n x k matrix with transB.
+ *
+ * @param accumulate Non-zero to add the product to C rather than overwrite it
+ * @param workspace NN_ALIGN-aligned scratch of gemmWorkspaceBytes(m, n, k),
+ *        or NULL to allocate it for this call
+ * @param workspaceBytes Size of workspace; a smaller one is not used
+ * @return 0 on success, 1 on allocation failure
+ */
+int gemm(int transA, int transB, int m, int n, int k, const double *a, int lda, const double *b, int ldb,
+         double *c, int ldc, int accumulate, void *workspace, size_t workspaceBytes) {
+    return multiply(transA, a, lda, NULL, transB, b, ldb, m, n, k, c, ldc, accumulate, workspace, workspaceBytes);
+}
+
+/**
+ * Bytes of packGemmA's copy of an m x k matrix for the active kernel table
+ */
+size_t gemmPackedBytes(int m, int k) {
+    return alignUp(sizeof(double) * (size_t)roundUp(m, nnKernels->gemmRows) * k);
+}
+
+/**
+ * Pack a whole m x k matrix once for gemmPackedA, e.g. weights reused by
+ * every batch: panels of gemmRows rows over the full depth, so any kc slice
+ * of a panel is already in place
+ *
+ * @param dst gemmPackedBytes(m, k) bytes
+ * @return The gemmRows of the active table, which gemmPackedA needs again
+ */
+int packGemmA(const double *a, int lda, int m, int k, double *dst) {
+    packA(0, a, lda, 0, 0, m, k, nnKernels->gemmRows, dst);
+    return nnKernels->gemmRows;
+}
+
+/**
+ * gemm with op(A) = A given as packGemmA's copy, made with the active kernel table
+ */
+int gemmPackedA(const double *packedA, int m, int n, int k, int transB, const double *b, int ldb,
+                double *c, int ldc, int accumulate, void *workspace, size_t workspaceBytes) {
+    return multiply(0, NULL, 0, packedA, transB, b, ldb, m, n, k, c, ldc, accumulate, workspace, workspaceBytes);
+}
+
+/* ========== Tuning ========== */
+
+/**
+ * Default block sizes for the active kernel table on this machine
+ */
+void defaultGemmTuning(GemmTuning *t) {
+    pthread_once(&state.once, loadState);
+    defaultsFor(nnKernels, t);
+}
+
+/**
+ * Block sizes gemm() uses with the active kernel table
+ */
+void gemmTuning(GemmTuning *t) {
+    tuningFor(nnKernels, t);
+}
+
+/**
+ * Use these block sizes from now on for the kernel table they name
+ * mc and nc are rounded up to whole panels.
+ *
+ * @return 0 on success, 1 if a size is not positive
+ */
+int setGemmTuning(const GemmTuning *t) {
+    if (t->mc <= 0 || t->kc <= 0 || t->nc <= 0) return 1;
+    pthread_once(&state.once, loadState);
+    pthread_mutex_lock(&state.lock);
+    state.tuning = *t;
+    state.tuning.kernel[sizeof(state.tuning.kernel) - 1] = '\0';
+    pthread_mutex_unlock(&state.lock);
+    return 0;
+}
+
+/**
+ * Parse a tuning file
+ *
+ * @return 0 on success, 1 if the file cannot be read or is incomplete
+ */
+static int readTuning(const char *path, GemmTuning *t) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Error opening %s\n", path);
+        return 1;
+    }
+    memset(t, 0, sizeof(*t));
+    char line[128];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#' || line[0] == '\0') continue;
+        if (strncmp(line, "kernel ", 7) == 0) {
+            snprintf(t->kernel, sizeof(t->kernel), "%.31s", line + 7);
+        } else if (sscanf(line, "mc %d", &t->mc) != 1 && sscanf(line, "kc %d", &t->kc) != 1 &&
+                   sscanf(line, "nc %d", &t->nc) != 1) {
+            fprintf(stderr, "Warning: ignoring \"%s\" in %s\n", line, path);
+        }
+    }
+    fclose(f);
+    if (t->kernel[0] == '\0' || t->mc <= 0 || t->kc <= 0 || t->nc <= 0) {
+        fprintf(stderr, "Error: %s is not a complete GEMM tuning\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Read block sizes written by saveGemmTuning and use them
+ * The file holds "kernel <name>", "mc <n>", "kc <n>" and "nc <n>" lines;
+ * lines starting with # are comments.
+ *
+ * @return 0 on success, 1 if the file cannot be read or is incomplete
+ */
+int loadGemmTuning(const char *path) {
+    GemmTuning t;
+    if (readTuning(path, &t) != 0) return 1;
+    return setGemmTuning(&t);
+}
+
+/**
+ * Write block sizes for loadGemmTuning
+ *
+ * @return 0 on success, 1 on failure
+ */
+int saveGemmTuning(const char *path, const GemmTuning *t) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Error creating %s\n", path);
+        return 1;
+    }
+    fprintf(f, "# GEMM block sizes for this machine, written by tune\n");
+    fprintf(f, "kernel %s\nmc %d\nkc %d\nnc %d\n", t->kernel, t->mc, t->kc, t->nc);
+    if (fclose(f) != 0) {
+        fprintf(stderr, "Error writing %s\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * GFLOP/s of one tiling on an m x n x k product: the best of as many runs
+ * as fit in the time slice
+ */
+static double timeTiling(const GemmTuning *t, int m, int n, int k, const double *a, const double *b, double *c,
+                         void *workspace, size_t workspaceBytes, double slice) {
+    setGemmTuning(t);
+    double best = 0.0, started = nowSeconds();
+    do {
+        double begin = nowSeconds();
+        if (gemm(0, 0, m, n, k, a, k, b, n, c, n, 0, workspace, workspaceBytes) != 0) return 0.0;
+        double seconds = nowSeconds() - begin;
+        double rate = seconds > 0 ? 2.0 * m * n * k / seconds * 1e-9 : 0.0;
+        if (rate > best) best = rate;
+    } while (nowSeconds() - started < slice);
+    return best;
+}
+
+/**
+ * Time block sizes on an m x n x k product and keep the fastest
+ * kc is searched first with the default mc and nc, then mc, then nc (which
+ * only matters when n is larger than it). The winner is left active.
+ *
+ * @param seconds Time to spend in total
+ * @param best Receives the fastest sizes
+ * @param gflops Receives their speed, may be NULL
+ * @param log Where to print every candidate, may be NULL
+ * @return 0 on success, 1 on allocation failure
+ */
+int tuneGemm(int m, int n, int k, double seconds, GemmTuning *best, double *gflops, FILE *log) {
+    static const int kcList[] = { 64, 128, 192, 256, 320, 384, 512, 768 };
+    static const int mcList[] = { 48, 96, 144, 192, 288, 384, 576, 768, 1152 };
+    static const int ncList[] = { 256, 512, 1024, 2048, 4096, 8192 };
+    const int counts[3] = { 8, 9, 6 };
+    const Kernels *kt = nnKernels;
+
+    double *a = alignedAlloc(sizeof(double) * ((size_t)m * k + (size_t)k * n + (size_t)m * n));
+    if (a == NULL) {
+        fprintf(stderr, "Memory allocation failed for GEMM tuning\n");
+        return 1;
+    }
+    double *b = a + (size_t)m * k, *c = b + (size_t)k * n;
+    uint64_t seed = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < (size_t)m * k + (size_t)k * n; i++) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        a[i] = (double)(seed >> 11) / 9007199254740992.0 - 0.5;
+    }
+
+    // Workspace for the largest candidate
+    GemmTuning largest;
+    defaultGemmTuning(&largest);
+    largest.mc = mcList[counts[1] - 1];
+    largest.kc = kcList[counts[0] - 1];
+    largest.nc = ncList[counts[2] - 1];
+    fitTuning(kt, &largest);
+    size_t workspaceBytes = packBytes(kt, &largest, m, n, k) + NN_ALIGN;
+    void *workspace = alignedAlloc(workspaceBytes);
+    if (workspace == NULL) {
+        fprintf(stderr, "Memory allocation failed for GEMM tuning\n");
+        alignedFree(a);
+        return 1;
+    }
+
+    GemmTuning current;
+    defaultGemmTuning(&current);
+    double slice = seconds / (counts[0] + counts[1] + counts[2] + 1);
+    double bestRate = timeTiling(&current, m, n, k, a, b, c, workspace, workspaceBytes, slice);
+    if (log != NULL) fprintf(log, "default  mc %4d  kc %4d  nc %5d  %8.2f GFLOP/s\n", current.mc, current.kc, current.nc, bestRate);
+    *best = current;
+
+    for (int axis = 0; axis < 3; axis++) {
+        const int *list = axis == 0 ? kcList : axis == 1 ? mcList : ncList;
+        for (int i = 0; i < counts[axis]; i++) {
+            GemmTuning trial = *best;
+            if (axis == 0) trial.kc = list[i];
+            if (axis == 1) trial.mc = list[i];
+            if (axis == 2) trial.nc = list[i];
+            fitTuning(kt, &trial);
+            // Sizes past the matrix all behave like the matrix size: try the first
+            int limit = axis == 0 ? k : axis == 1 ? m : n;
+            if (i > 0 && list[i-1] >= limit) continue;
+            double rate = timeTiling(&trial, m, n, k, a, b, c, workspace, workspaceBytes, slice);
+            if (log != NULL) fprintf(log, "         mc %4d  kc %4d  nc %5d  %8.2f GFLOP/s\n", trial.mc, trial.kc, trial.nc, rate);
+            if (rate > bestRate) {
+                bestRate = rate;
+                *best = trial;
+            }
+        }
+    }
+    setGemmTuning(best);
+    if (gflops != NULL) *gflops = bestRate;
+    alignedFree(workspace);
+    alignedFree(a);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+/*
+ * Cache-blocked double precision matrix multiply for the batched passes.
+ *
+ * gemm() computes C = op(A) * op(B), or adds it to C, the way GotoBLAS and
+ * BLIS do: B is copied kc x nc at a time into panels gemmCols wide that stay
+ * in L3 (or L2), A is copied mc x kc at a time into panels gemmRows tall that
+ * stay in L2, and the active kernel table's microkernel (kernels.h) multiplies
+ * one panel of each into a gemmRows x gemmCols block of C held in registers,
+ * streaming a kc x gemmCols panel of B from L1. Both copies are zero-padded
+ * to whole panels, so the microkernel never sees an edge; the blocks of C
+ * past the edge go through a small buffer. Transposed operands are read
+ * while packing and cost nothing afterwards.
+ *
+ * mc, kc and nc default to sizes derived from the host's cache sizes. The
+ * tune program (tune.c) times the alternatives on this machine and writes
+ * the best to a small profile file, which gemm() reads the first time it
+ * runs: the file named by NN_GEMM_TUNING, or gemm.tune in the working
+ * directory. A profile only applies to the kernel table it was tuned with.
+ *
+ * Each call runs on the calling thread; callers split their work across the
+ * pool and give every worker its own workspace. Results differ from the
+ * dense kernels' only in the order the products are added.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+
+#define NN_GEMM_PROFILE "gemm.tune"   // Default tuning file
+
+/* ========== Data Structures ========== */
+
+typedef struct GemmTuning {
+    char kernel[32];   // Kernel table the sizes apply to (Kernels.name)
+    int mc;            // Rows of A per packed block, sized for L2
+    int kc;            // Depth of the packed blocks, sized for L1
+    int nc;            // Columns of B per packed block, sized for L3
+} GemmTuning;
+
+/* ========== Function Declarations ========== */
+
+int gemm(int transA, int transB, int m, int n, int k, const double *a, int lda, const double *b, int ldb,
+         double *c, int ldc, int accumulate, void *workspace, size_t workspaceBytes);
+size_t gemmWorkspaceBytes(int m, int n, int k);
+size_t gemmPackedBytes(int m, int k);
+int packGemmA(const double *a, int lda, int m, int k, double *dst);
+int gemmPackedA(const double *packedA, int m, int n, int k, int transB, const double *b, int ldb,
+                double *c, int ldc, int accumulate, void *workspace, size_t workspaceBytes);
+void defaultGemmTuning(GemmTuning *t);
+void gemmTuning(GemmTuning *t);
+int setGemmTuning(const GemmTuning *t);
+int loadGemmTuning(const char *path);
+int saveGemmTuning(const char *path, const GemmTuning *t);
+int tuneGemm(int m, int n, int k, double seconds, GemmTuning *best, double *gflops, FILE *log);
+
+#endif // GEMM_H
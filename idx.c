@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "idx.h"
+
+#define STREAM_DEPTH 3       // Batches decoded ahead of the consumer
+#define STREAM_READAHEAD 4   // Batches of pixels the OS is asked to fetch ahead of the decoder
+
+/* ========== Private Structures ========== */
+
+struct IdxStream {
+    const IdxFile *images;
+    const IdxFile *labels;           // NULL for an unlabelled stream
+    int batchSize;
+    double *buffers[STREAM_DEPTH];   // Decoded batches, used round-robin
+    size_t first[STREAM_DEPTH];      // First sample of each buffer
+    int count[STREAM_DEPTH];         // Samples in each buffer
+    int full[STREAM_DEPTH];          // Buffer holds a batch the consumer has not released
+    int readSlot;                    // Next buffer the consumer takes
+    int held;                        // The consumer still holds readSlot
+    int finished;                    // The decoder has produced every batch
+    int stopping;                    // closeIdxStream wants the decoder gone
+
+    pthread_t decoder;
+    pthread_mutex_t lock;            // Guards full, held, finished and stopping
+    pthread_cond_t ready;            // A buffer was filled or the decoder finished
+    pthread_cond_t space;            // A buffer was released or the stream is closing
+};
+
+static unsigned int readBigEndian(const unsigned char *p) {
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+/**
+ * Map an IDX file and parse its header
+ *
+ * @param path IDX file
+ * @param file Filled in on success
+ * @return 0 on success, 1 on failure
+ */
+int openIdx(const char *path, IdxFile *file) {
+    memset(file, 0, sizeof(*file));
+    if (mapFile(path, &file->map) != 0) {
+        return 1;
+    }
+
+    const unsigned char *p = file->map.base;
+    size_t size = file->map.size;
+
+    // Magic: two zero bytes, the data type, the number of dimensions
+    if (size < 4 || p[0] != 0 || p[1] != 0 || p[2] != 0x08 || p[3] < 1 || p[3] > 3 ||
+        size < 4 + 4 * (size_t)p[3]) {
+        fprintf(stderr, "Error: %s is not an unsigned byte IDX file\n", path);
+        closeIdx(file);
+        return 1;
+    }
+
+    file->dims = p[3];
+    file->itemSize = 1;
+    for (int d = 0; d < file->dims; d++) {
+        file->shape[d] = readBigEndian(p + 4 + 4 * d);
+        if (d == 0) continue;
+        if (file->shape[d] != 0 && file->itemSize > SIZE_MAX / file->shape[d]) {
+            fprintf(stderr, "Error: %s has an item too large to address\n", path);
+            closeIdx(file);
+            return 1;
+        }
+        file->itemSize *= file->shape[d];
+    }
+    file->count = file->shape[0];
+    file->data = p + 4 + 4 * file->dims;
+
+    // Divide rather than multiply, so a crafted count cannot wrap the product
+    size_t available = (size_t)(file->map.base + size - file->data);
+    if (file->itemSize != 0 && file->count > available / file->itemSize) {
+        fprintf(stderr, "Error: %s is truncated\n", path);
+        closeIdx(file);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Release a file opened by openIdx
+ * Safe to call on a zeroed IdxFile
+ */
+void closeIdx(IdxFile *file) {
+    unmapFile(&file->map);
+    memset(file, 0, sizeof(*file));
+}
+
+/**
+ * Convert 0-255 pixels to the 0.0-1.0 network input, as main.c does
+ *
+ * @param pixels Pixel bytes
+ * @param count Number of pixels
+ * @param out count doubles
+ */
+void idxToInput(const unsigned char *pixels, size_t count, double *out) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = (double)pixels[i] / 255.0;
+    }
+}
+
+/* ========== Streaming ========== */
+
+/**
+ * Decoder thread: fill free buffers with batches, front to back
+ */
+static void *decodeMain(void *p) {
+    IdxStream *s = p;
+    const IdxFile *images = s->images;
+    const size_t dataOffset = (size_t)(images->data - images->map.base);
+    const size_t batchBytes = (size_t)s->batchSize * images->itemSize;
+    int slot = 0;
+
+    adviseFile(&images->map, 0, 0, NN_ADVISE_SEQUENTIAL);
+    for (size_t next = 0; next < images->count; next += (size_t)s->batchSize) {
+        pthread_mutex_lock(&s->lock);
+        while (s->full[slot] && !s->stopping) {
+            pthread_cond_wait(&s->space, &s->lock);
+        }
+        int stopping = s->stopping;
+        pthread_mutex_unlock(&s->lock);
+        if (stopping) break;
+
+        int count = (images->count - next < (size_t)s->batchSize) ? (int)(images->count - next) : s->batchSize;
+        size_t offset = dataOffset + next * images->itemSize;
+        adviseFile(&images->map, offset + batchBytes, STREAM_READAHEAD * batchBytes, NN_ADVISE_WILLNEED);
+        idxToInput(images->data + next * images->itemSize, (size_t)count * images->itemSize, s->buffers[slot]);
+        adviseFile(&images->map, offset, (size_t)count * images->itemSize, NN_ADVISE_DONTNEED);
+
+        pthread_mutex_lock(&s->lock);
+        s->first[slot] = next;
+        s->count[slot] = count;
+        s->full[slot] = 1;
+        pthread_cond_signal(&s->ready);
+        pthread_mutex_unlock(&s->lock);
+        slot = (slot + 1) % STREAM_DEPTH;
+    }
+
+    pthread_mutex_lock(&s->lock);
+    s->finished = 1;
+    pthread_cond_signal(&s->ready);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/**
+ * Start streaming an image file in batches
+ * The files must stay open until the stream is closed.
+ *
+ * @param images Image file from openIdx
+ * @param labels Matching label file, or NULL
+ * @param batchSize Samples per batch
+ * @return The stream, or NULL on failure
+ */
+IdxStream *openIdxStream(const IdxFile *images, const IdxFile *labels, int batchSize) {
+    if (batchSize < 1 || (labels != NULL && (labels->itemSize != 1 || labels->count < images->count))) {
+        fprintf(stderr, "Error: labels do not match the images\n");
+        return NULL;
+    }
+
+    IdxStream *s = calloc(1, sizeof(IdxStream));
+    if (s == NULL) {
+        fprintf(stderr, "Memory allocation failed for IDX stream\n");
+        return NULL;
+    }
+    s->images = images;
+    s->labels = labels;
+    s->batchSize = batchSize;
+    for (int i = 0; i < STREAM_DEPTH; i++) {
+        s->buffers[i] = alignedAlloc(sizeof(double) * (size_t)batchSize * images->itemSize);
+        if (s->buffers[i] == NULL) {
+            fprintf(stderr, "Memory allocation failed for IDX stream\n");
+            for (int j = 0; j < i; j++) alignedFree(s->buffers[j]);
+            free(s);
+            return NULL;
+        }
+    }
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->ready, NULL);
+    pthread_cond_init(&s->space, NULL);
+    if (pthread_create(&s->decoder, NULL, decodeMain, s) != 0) {
+        fprintf(stderr, "Error: could not start the IDX decoder thread\n");
+        s->stopping = 1;
+        closeIdxStream(s);
+        return NULL;
+    }
+    return s;
+}
+
+/**
+ * Take the next batch, releasing the previous one
+ *
+ * @param stream Stream from openIdxStream
+ * @param batch Filled in with the batch
+ * @return 1 if a batch was returned, 0 at the end of the file
+ */
+int nextIdxBatch(IdxStream *stream, IdxBatch *batch) {
+    IdxStream *s = stream;
+    pthread_mutex_lock(&s->lock);
+    if (s->held) {
+        s->full[s->readSlot] = 0;
+        s->readSlot = (s->readSlot + 1) % STREAM_DEPTH;
+        s->held = 0;
+        pthread_cond_signal(&s->space);
+    }
+    while (!s->full[s->readSlot] && !s->finished) {
+        pthread_cond_wait(&s->ready, &s->lock);
+    }
+    int available = s->full[s->readSlot];
+    s->held = available;
+    pthread_mutex_unlock(&s->lock);
+    if (!available) return 0;
+
+    int slot = s->readSlot;
+    batch->inputs = s->buffers[slot];
+    batch->first = s->first[slot];
+    batch->count = s->count[slot];
+    batch->labels = s->labels ? s->labels->data + s->first[slot] : NULL;
+    return 1;
+}
+
+/**
+ * Stop a stream and free its buffers
+ * Safe to call before the end of the file, and with NULL
+ */
+void closeIdxStream(IdxStream *stream) {
+    IdxStream *s = stream;
+    if (s == NULL) return;
+
+    pthread_mutex_lock(&s->lock);
+    int running = !s->stopping;
+    s->stopping = 1;
+    pthread_cond_signal(&s->space);
+    pthread_mutex_unlock(&s->lock);
+    if (running) {
+        pthread_join(s->decoder, NULL);
+    }
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->ready);
+    pthread_cond_destroy(&s->space);
+    for (int i = 0; i < STREAM_DEPTH; i++) alignedFree(s->buffers[i]);
+    free(s);
+}
@@ -0,0 +1,49 @@
+#ifndef IDX_H
+#define IDX_H
+
+/*
+ * Reader for the IDX files MNIST is distributed in (train-images-idx3-ubyte,
+ * train-labels-idx1-ubyte, ...). Files are memory-mapped and only unsigned
+ * byte data (type 0x08) is accepted.
+ *
+ * An IdxStream walks an image file (and optionally its labels) in batches of
+ * network input. A decoder thread converts the next batches while the
+ * caller runs inference on the current one, reading ahead of itself and
+ * dropping the pages it has finished with, so a data set only needs to fit
+ * on disk, not in RAM.
+ */
+
+#include <stddef.h>
+#include "model.h"
+
+/* ========== Data Structures ========== */
+
+typedef struct IdxFile {
+    MappedFile map;
+    int dims;                   // Number of dimensions (1 for labels, 3 for images)
+    uint32_t shape[3];          // Size of each dimension
+    size_t count;               // Items in the file (shape[0])
+    size_t itemSize;            // Bytes per item (product of the other dimensions)
+    const unsigned char *data;  // count * itemSize bytes
+} IdxFile;
+
+// One decoded batch, valid until the next call to nextIdxBatch
+typedef struct IdxBatch {
+    const double *inputs;            // count * itemSize values in [0, 1]
+    const unsigned char *labels;     // count labels, NULL if the stream has none
+    size_t first;                    // Index of the first sample in the file
+    int count;                       // Samples in the batch
+} IdxBatch;
+
+typedef struct IdxStream IdxStream;
+
+/* ========== Function Declarations ========== */
+
+int openIdx(const char *path, IdxFile *file);
+void closeIdx(IdxFile *file);
+void idxToInput(const unsigned char *pixels, size_t count, double *out);
+IdxStream *openIdxStream(const IdxFile *images, const IdxFile *labels, int batchSize);
+int nextIdxBatch(IdxStream *stream, IdxBatch *batch);
+void closeIdxStream(IdxStream *stream);
+
+#endif // IDX_H
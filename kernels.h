@@ -0,0 +1,125 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+/*
+ * Dense-layer, activation and argmax kernels with runtime CPU dispatch.
+ *
+ * One kernel table exists per instruction set (scalar, SSE2, AVX2+FMA,
+ * AVX-512F, AVX-512 VNNI); selectKernels() picks the widest one the CPU and OS support
+ * using cpuid/xgetbv, so a single binary runs on old and new x86 machines.
+ * The environment variable NN_KERNEL (scalar, sse2, avx2, avx512, avx512vnni)
+ * forces a table, e.g. to compare results.
+ *
+ * Tolerance: the scalar table adds products in input order, exactly like the
+ * original linked-list code. The SIMD tables keep several partial sums and
+ * use FMA, so a dense output may differ from the scalar one by at most
+ * about inputs * 2^-53 * sum(|w * x|); on the 784-128-10 model that is below
+ * 1e-12 per logit. denseSparse and denseSparseTile add the same products column
+ * by column, so they stay within that bound of dense too, as does the GEMM microkernel, which
+ * adds each output's products in input order in blocks of kc. The CSR kernels
+ * skip the zero weights of a pruned layer and stay within the bound of a
+ * dense pass over the same weights. Softmax uses a vectorized exp accurate to 2 ulp, so
+ * probabilities agree with the scalar table to within 1e-14.
+ *
+ * The F32/F16 kernels accumulate in float, so their logits are only within
+ * about 1e-5 of the fp64 ones (fp16 weights: about 1e-2, from the rounding
+ * of the weights themselves); validate.c measures this on a data set.
+ */
+
+#include <stdint.h>
+
+#define NN_BATCH_TILE 32   // Samples per tile in the batched kernels
+#define NN_SPARSE_TILE 8   // Leading samples of a tile denseSparseTile computes
+
+// CPU features usable by this process (instruction set and OS register state)
+#define NN_CPU_SSE2        0x01
+#define NN_CPU_AVX2        0x02   // AVX2, FMA and F16C
+#define NN_CPU_AVX512F     0x04
+#define NN_CPU_AVX512BW    0x08
+#define NN_CPU_AVX512VNNI  0x10
+
+// dense and denseTile compiled for one layer shape, with inputs, outputs and
+// stride fixed at compile time so every loop bound is a constant. Each table
+// lists the same shapes in the same order (see findShape)
+typedef struct ShapeKernels {
+    int inputs, outputs;
+    void (*dense)(const double *weights, int stride, const double *bias,
+                  const double *x, int inputs, int outputs, double *y, int applyRelu);
+    void (*denseTile)(const double *weights, int stride, const double *bias,
+                      const double *x, int inputs, int outputs, double *y, int applyRelu);
+} ShapeKernels;
+
+typedef struct Kernels {
+    const char *name;
+    const ShapeKernels *shapes;   // Specialized kernels for the hot layer shapes
+
+    // y[o] = act(dot(w[o * stride ...], x) + bias[o]) for o < outputs
+    void (*dense)(const double *weights, int stride, const double *bias,
+                  const double *x, int inputs, int outputs, double *y, int applyRelu);
+
+    // Same over a feature-major tile: x is inputs rows of NN_BATCH_TILE
+    // samples, y is outputs rows of NN_BATCH_TILE samples
+    void (*denseTile)(const double *weights, int stride, const double *bias,
+                      const double *x, int inputs, int outputs, double *y, int applyRelu);
+
+    // Sparse input: y[o] = act(bias[o] + sum of columns[k * stride + o] * x[k])
+    // over the count inputs k listed in index. columns is the transposed
+    // weight matrix, one column of outputs zero-padded to stride per input
+    void (*denseSparse)(const double *columns, int stride, const double *bias, const double *x,
+                        const int *index, int count, int outputs, double *y, int applyRelu);
+
+    // Same over a feature-major tile whose samples from NN_SPARSE_TILE on are
+    // zero (e.g. augmented copies of one input): index lists the inputs any
+    // of the first NN_SPARSE_TILE samples uses, and each of their columns is
+    // loaded once for all of them. The zero samples get act(bias), as from denseTile
+    void (*denseSparseTile)(const double *columns, int stride, const double *bias, const double *x,
+                            const int *index, int count, int outputs, double *y, int applyRelu);
+
+    // Sparse weights in CSR form (see sparse.h): y[o] = act(bias[o] + sum of
+    // values[j] * x[index[j]]) over j in [rowStart[o], rowStart[o + 1])
+    void (*denseCsr)(const uint32_t *rowStart, const uint32_t *index, const double *values, const double *bias,
+                     const double *x, int outputs, double *y, int applyRelu);
+
+    // Same over a feature-major tile of NN_BATCH_TILE samples, like denseTile
+    void (*denseCsrTile)(const uint32_t *rowStart, const uint32_t *index, const double *values,
+                         const double *bias, const double *x, int outputs, double *y, int applyRelu);
+
+    void (*relu)(double *values, int length);
+    void (*softmax)(const double *input, double *output, int length);
+    int (*argmax)(const double *values, int length);   // First index of the maximum
+
+    // acc[b * outputs + o] = sum of w[o * stride + k] * x[b * stride + k] over
+    // k < stride for count samples (int32 accumulate). stride is a multiple
+    // of NN_ALIGN bytes and every x value must be <= 127
+    void (*dotInt8)(const int8_t *weights, int stride, const uint8_t *x, int count,
+                    int outputs, int32_t *acc);
+
+    // Single precision dense and denseTile. Weights are float or IEEE half
+    // (converted to float as they are loaded); bias and activations are float.
+    // Weight rows must be zero-padded to stride, a multiple of NN_ALIGN bytes
+    void (*denseF32)(const float *weights, int stride, const float *bias,
+                     const float *x, int inputs, int outputs, float *y, int applyRelu);
+    void (*denseTileF32)(const float *weights, int stride, const float *bias,
+                         const float *x, int inputs, int outputs, float *y, int applyRelu);
+    void (*denseF16)(const uint16_t *weights, int stride, const float *bias,
+                     const float *x, int inputs, int outputs, float *y, int applyRelu);
+    void (*denseTileF16)(const uint16_t *weights, int stride, const float *bias,
+                         const float *x, int inputs, int outputs, float *y, int applyRelu);
+
+    // GEMM microkernel (gemm.c): one gemmRows x gemmCols block of C,
+    // c[i * ldc + j] (+)= sum over p < k of a[p * gemmRows + i] * b[p * gemmCols + j],
+    // from panels packed by gemm.c. Overwrites the block when accumulate is 0
+    int gemmRows, gemmCols;
+    void (*gemmKernel)(int k, const double *a, const double *b, double *c, int ldc, int accumulate);
+} Kernels;
+
+extern const Kernels *nnKernels;   // Active table, scalar until selectKernels() runs
+
+unsigned cpuFeatures(void);
+const Kernels *selectKernels(void);
+int findShape(int inputs, int outputs, int stride);
+
+float halfToFloat(uint16_t h);
+uint16_t floatToHalf(float f);
+
+#endif // KERNELS_H
@@ -0,0 +1,250 @@
+// Load generator for the inference daemon (serve.c)
+//
+// usage: loadgen [-s socket] [-c connections] [-n requests] [-u] [-p] [-R ms] [-P file] [images.idx]
+//   -s  socket path (default /tmp/nn.sock)
+//   -c  concurrent connections, one thread each (default 8)
+//   -n  requests per connection (default 1000)
+//   -u  send raw 0-255 pixels instead of doubles
+//   -p  ask for every class probability as well as the prediction
+//   -R  also make the daemon reload its model every ms milliseconds during the run
+//   -P  save the daemon's metrics after the run, as JSON if file ends in .json
+//       and as Prometheus text otherwise (start serve with NN_PROFILE=1)
+//
+// Samples are taken round robin from images.idx, or are random noise without
+// it. Reports request latency percentiles, throughput and the daemon's
+// queue and batching statistics.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "client.h"
+#include "idx.h"
+
+#define MAX_CLASSES 1024
+#define MAX_METRICS (1 << 20)   // Bytes of metrics text accepted
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static struct {
+    const char *socketPath;
+    int requests;
+    int pixels;                 // Send PREDICT_U8
+    int probabilities;
+    const unsigned char *data;  // samples * inSize pixels
+    size_t samples;
+    int inSize;
+    atomic_int running;         // Connections still sending
+} load = { "/tmp/nn.sock", 1000, 0, 0, NULL, 0, 784, 0 };
+
+typedef struct Worker {
+    pthread_t thread;
+    int index;
+    double *latencies;          // Seconds per request
+    int completed;
+} Worker;
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Worker thread: send requests back to back on its own connection
+ */
+static void *workerMain(void *p) {
+    Worker *w = p;
+    int fd = clientConnect(load.socketPath);
+    if (fd < 0) return NULL;
+
+    double *input = malloc(sizeof(double) * load.inSize);
+    float probabilities[MAX_CLASSES];
+    float *wanted = load.probabilities ? probabilities : NULL;
+    for (int r = 0; r < load.requests && input != NULL; r++) {
+        const unsigned char *pixels = load.data + ((size_t)(w->index + r) % load.samples) * load.inSize;
+        double t0 = nowSeconds();
+        int prediction;
+        if (load.pixels) {
+            prediction = clientPredictPixels(fd, pixels, load.inSize, wanted, MAX_CLASSES);
+        } else {
+            for (int k = 0; k < load.inSize; k++) input[k] = pixels[k] / 255.0;
+            prediction = clientPredict(fd, input, load.inSize, wanted, MAX_CLASSES);
+        }
+        if (prediction < 0) break;
+        w->latencies[w->completed++] = nowSeconds() - t0;
+    }
+    free(input);
+    clientClose(fd);
+    return NULL;
+}
+
+/**
+ * Reloader thread: ask for a reload every interval until the workers are done
+ * Connects for each reload only: the daemon stops filling a batch once every
+ * connected client waits, and an idle connection would never be waiting.
+ *
+ * @return Number of successful reloads, cast to a pointer
+ */
+static void *reloaderMain(void *p) {
+    int interval = (int)(intptr_t)p;
+    intptr_t reloads = 0;
+    while (atomic_load(&load.running) > 0) {
+        struct timespec pause = { interval / 1000, (long)(interval % 1000) * 1000000 };
+        nanosleep(&pause, NULL);
+        int fd = clientConnect(load.socketPath);
+        if (fd < 0) break;
+        if (clientReload(fd) == 0) reloads++;
+        clientClose(fd);
+    }
+    return (void*)reloads;
+}
+
+int main(int argc, char *argv[]) {
+    const char *imagesPath = NULL, *metricsPath = NULL;
+    int connections = 8, reloadInterval = 0, usage = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            load.socketPath = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            connections = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            load.requests = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-u") == 0) {
+            load.pixels = 1;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            load.probabilities = 1;
+        } else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+            reloadInterval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+            metricsPath = argv[++i];
+        } else if (argv[i][0] != '-' && imagesPath == NULL) {
+            imagesPath = argv[i];
+        } else {
+            usage = 1;
+            break;
+        }
+    }
+    if (usage || connections < 1 || load.requests < 1 || reloadInterval < 0) {
+        printf("usage: %s [-s socket] [-c connections] [-n requests] [-u] [-p] [-R ms] [-P file] [images.idx]\n", argv[0]);
+        return 1;
+    }
+
+    // --- Samples to send ---
+    IdxFile images;
+    unsigned char *noise = NULL;
+    if (imagesPath != NULL) {
+        if (openIdx(imagesPath, &images) != 0) return 1;
+        load.data = images.data;
+        load.samples = images.count;
+        load.inSize = (int)images.itemSize;
+    } else {
+        load.samples = 64;
+        noise = malloc(load.samples * load.inSize);
+        if (noise == NULL) return 1;
+        srand(1);
+        for (size_t k = 0; k < load.samples * load.inSize; k++) noise[k] = (unsigned char)(rand() & 0xff);
+        load.data = noise;
+    }
+
+    // --- Run the connections ---
+    Worker *workers = calloc(connections, sizeof(Worker));
+    if (workers == NULL) return 1;
+    atomic_store(&load.running, connections);
+    pthread_t reloader;
+    if (reloadInterval > 0 && pthread_create(&reloader, NULL, reloaderMain, (void*)(intptr_t)reloadInterval) != 0) {
+        fprintf(stderr, "Error: could not start the reloader\n");
+        return 1;
+    }
+    double started = nowSeconds();
+    for (int c = 0; c < connections; c++) {
+        workers[c].index = c;
+        workers[c].latencies = malloc(sizeof(double) * load.requests);
+        if (workers[c].latencies == NULL || pthread_create(&workers[c].thread, NULL, workerMain, &workers[c]) != 0) {
+            fprintf(stderr, "Error: could not start connection %d\n", c);
+            return 1;
+        }
+    }
+    size_t total = 0;
+    for (int c = 0; c < connections; c++) {
+        pthread_join(workers[c].thread, NULL);
+        total += (size_t)workers[c].completed;
+        atomic_fetch_sub(&load.running, 1);
+    }
+    double elapsed = nowSeconds() - started;
+    void *reloads = NULL;
+    if (reloadInterval > 0) pthread_join(reloader, &reloads);
+
+    // --- Report ---
+    double *all = malloc(sizeof(double) * (total > 0 ? total : 1));
+    if (all == NULL) return 1;
+    size_t at = 0;
+    for (int c = 0; c < connections; c++) {
+        memcpy(all + at, workers[c].latencies, sizeof(double) * workers[c].completed);
+        at += (size_t)workers[c].completed;
+        free(workers[c].latencies);
+    }
+    qsort(all, total, sizeof(double), compareDoubles);
+
+    printf("\n--- %zu requests over %d connections (%s%s) ---\n", total, connections,
+           load.pixels ? "uint8" : "fp64", load.probabilities ? ", probabilities" : "");
+    if (total < (size_t)connections * load.requests) {
+        printf("Failed:      %zu requests\n", (size_t)connections * load.requests - total);
+    }
+    if (total > 0) {
+        printf("Latency:     p50 %.1f us, p99 %.1f us, p999 %.1f us, max %.1f us\n",
+               all[total / 2] * 1e6, all[total * 99 / 100] * 1e6, all[total * 999 / 1000] * 1e6, all[total - 1] * 1e6);
+    }
+    printf("Throughput:  %.0f requests/s\n", total / elapsed);
+    if (reloadInterval > 0) {
+        printf("Reloads:     %d during the run\n", (int)(intptr_t)reloads);
+    }
+
+    ServeStats st;
+    int fd = clientConnect(load.socketPath);
+    if (fd >= 0 && clientStats(fd, &st) == 0) {
+        printf("\nDaemon: %llu requests in %llu batches (%.1f per batch, largest %llu), %llu rejected\n",
+               (unsigned long long)st.requests, (unsigned long long)st.batches,
+               st.batches ? (double)st.requests / st.batches : 0.0,
+               (unsigned long long)st.maxBatch, (unsigned long long)st.rejected);
+        printf("Model:  reloaded %llu times\n", (unsigned long long)st.reloads);
+        printf("Queue:  depth %llu now, %llu at most; %.1f us average wait, %.1f us average batch\n",
+               (unsigned long long)st.queueDepth, (unsigned long long)st.maxQueueDepth,
+               st.requests ? (double)st.queueMicros / st.requests : 0.0,
+               st.batches ? (double)st.inferenceMicros / st.batches : 0.0);
+        printf("Batch sizes:");
+        for (int b = 0; b < NN_SERVE_BUCKETS; b++) {
+            if (st.batchSizes[b] > 0) printf("  %d+: %llu", 1 << b, (unsigned long long)st.batchSizes[b]);
+        }
+        printf("\n");
+    }
+
+    // --- Metrics ---
+    char *metrics = metricsPath ? malloc(MAX_METRICS) : NULL;
+    if (metrics != NULL && fd >= 0) {
+        size_t length = strlen(metricsPath);
+        int json = length >= 5 && strcmp(metricsPath + length - 5, ".json") == 0;
+        FILE *f = (clientMetrics(fd, json, metrics, MAX_METRICS) == 0) ? fopen(metricsPath, "w") : NULL;
+        int saved = f != NULL && fputs(metrics, f) >= 0;
+        if (f != NULL && fclose(f) != 0) saved = 0;
+        if (saved) {
+            printf("Metrics:  saved to %s\n", metricsPath);
+        } else {
+            fprintf(stderr, "Error saving the metrics to %s\n", metricsPath);
+        }
+    }
+    free(metrics);
+    clientClose(fd);
+
+    free(all);
+    free(workers);
+    free(noise);
+    if (imagesPath != NULL) closeIdx(&images);
+    return 0;
+}
@@ -1,14 +1,22 @@
 #include "raylib.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <float.h> // For DBL_MAX, DBL_MIN
+#include <pthread.h>
+#include <stdatomic.h>
 #include "nn.h"   // NN functions are declared here
+#include "profile.h"
+#include "augment.h"
+#include "spsc.h"
+#include "preprocess.h"
 
 #define GRID_W 28
 #define GRID_H 28
 #define SCR_W 2000
 #define SCR_H 1200
+#define QUEUE_SIZE 4   // Requests or results in flight between the render thread and the worker
 
 const int PAD = 50;
 const double BRUSH_R = 10.0; 
@@ -16,10 +24,43 @@ const Color BG_COL = BLACK;
 const Color FG_COL = WHITE;
 const int FONT_SZ_INFO = 20;
 
+// --- Asynchronous Prediction ---
+// The render thread only reads the canvas back and queues it; a worker thread
+// owns the network and does the preprocessing, the forward pass and the
+// console output, so a slow prediction never holds up a frame
+typedef struct PredictRequest {
+    Image canvas;        // Drawing read back from the GPU, owned by the request
+    int sequence;        // Increases with every request
+    bool augmented;      // Average over the augmented copies (see augment.h)
+    bool report;         // Full pass with the probabilities printed ([Enter])
+} PredictRequest;
+
+typedef struct PredictResult {
+    int sequence;                   // Of the request it answers
+    int digit;                      // -1 if the pass failed
+    double grid[GRID_H][GRID_W];    // Network input, for the preview
+} PredictResult;
+
+typedef struct Predictor {
+    SpscQueue *requests;        // Render thread -> worker
+    SpscQueue *results;         // Worker -> render thread
+    pthread_t thread;
+    pthread_mutex_t lock;       // Only held to sleep on wake without missing a push
+    pthread_cond_t wake;        // A request was queued or the worker should stop
+    atomic_bool stop;
+} Predictor;
+
 // --- Function Declarations ---
 void flatten2D(double input2D[GRID_H][GRID_W], double output1D[GRID_W * GRID_H]);
-Rectangle CalculateBoundingBox(Image img, Color bgCol);
-void CenterImage(Image srcImg, RenderTexture2D destTexture, Color bgCol);
+void PreprocessImage(Image drawnImage, double inputGrid[GRID_H][GRID_W]);
+int StartPredictor(Predictor *p);
+void StopPredictor(Predictor *p);
+int SubmitRequest(Predictor *p, PredictRequest *req);
+void FreeRequest(PredictRequest *req);
+void UpdatePreview(Texture2D preview, double inputGrid[GRID_H][GRID_W]);
+void RenderStaticLayer(RenderTexture2D layer, Rectangle drawRect, Rectangle prvRect, Rectangle txtRect);
+void RenderInfoLayer(RenderTexture2D layer, int predicted_digit);
+void DrawLayer(RenderTexture2D layer, Vector2 position);
 
 // --- Function Definitions --- 
 
@@ -31,73 +72,215 @@ void flatten2D(double input2D[GRID_H][GRID_W], double output1D[GRID_W * GRID_H])
         }
     }
 }
-Rectangle CalculateBoundingBox(Image img, Color bgCol) {
-    if (img.data == NULL) return (Rectangle){0, 0, 0, 0};
-    int minX = img.width, minY = img.height, maxX = -1, maxY = -1;
-    bool foundPixel = false;
-
-    for (int y = 0; y < img.height; y++) {
-        for (int x = 0; x < img.width; x++) {
-            Color pix = GetImageColor(img, x, y);
-            if (pix.r != bgCol.r || pix.g != bgCol.g || pix.b != bgCol.b || pix.a != bgCol.a) {
-                if (x < minX) minX = x;
-                if (y < minY) minY = y;
-                if (x > maxX) maxX = x;
-                if (y > maxY) maxY = y;
-                foundPixel = true;
-            }
-        }
+// Turn the drawing into the 28x28 network input (preprocess.h)
+void PreprocessImage(Image drawnImage, double inputGrid[GRID_H][GRID_W]) {
+    size_t count = (size_t)drawnImage.width * drawnImage.height;
+    unsigned char *gray = NULL;
+    int status = 1;
+    if (drawnImage.data != NULL && drawnImage.format == PIXELFORMAT_UNCOMPRESSED_R8G8B8A8) {
+        gray = malloc(count);
+    }
+    if (gray != NULL) {
+        grayFromRgba(drawnImage.data, count, gray);
+        // Render textures read back bottom-up, so walk the rows from the last one
+        status = preprocessDigit(gray + (count - drawnImage.width), drawnImage.width, drawnImage.height,
+                                 -(ptrdiff_t)drawnImage.width, &inputGrid[0][0]);
     }
+    if (status != 0) {
+         // Handle error case if image processing failed
+         TraceLog(LOG_ERROR, "Failed to process image to 28x28 grayscale");
+         for (int y = 0; y < GRID_H; ++y) for (int x = 0; x < GRID_W; ++x) inputGrid[y][x] = 0.0;
+    }
+    free(gray);
+}
+
+void FreeRequest(PredictRequest *req) {
+    if (req == NULL) return;
+    UnloadImage(req->canvas);
+    free(req);
+}
 
-    if (foundPixel) {
-        return (Rectangle){(float)minX, (float)minY, (float)(maxX - minX + 1), (float)(maxY - minY + 1)};
+// Preprocess one request and run the network on it (worker thread)
+static PredictResult *RunRequest(PredictRequest *req) {
+    static double variants[NN_TTA_VARIANTS * GRID_W * GRID_H];
+    double input1D[GRID_W * GRID_H];
+    PredictResult *res = malloc(sizeof(PredictResult));
+    if (res == NULL) return NULL;
+    res->sequence = req->sequence;
+
+    PreprocessImage(req->canvas, res->grid);
+    flatten2D(res->grid, input1D);
+
+    int status;
+    if (req->augmented) {
+        augmentImages(input1D, GRID_W, GRID_H, defaultAugmentations, NN_TTA_VARIANTS, variants);
+        status = feedForwardAveraged(variants, NN_TTA_VARIANTS);
+    } else if (req->report) {
+        feedForward(input1D);
+        status = 0;
     } else {
-        return (Rectangle){0, 0, 0, 0};
+        // Successive live requests differ by a few strokes, so feedForwardIncremental
+        // updates the hidden layer for the few input pixels they moved
+        status = (feedForwardIncremental(input1D) >= 0) ? 0 : 1;
+    }
+    res->digit = (status == 0) ? getPrediction() : -1;
+
+    if (req->report && status == 0) {
+        printf("\n--- Network Output Probabilities ---\n");
+        displayFinalOutput(); // Prints probabilities to CONSOLE
+        printf("------------------------------------\n");
     }
+    return res;
 }
 
-void CenterImage(Image srcImg, RenderTexture2D destTexture, Color bgCol) {
-     if (srcImg.data == NULL) return;
-    Rectangle bbox = CalculateBoundingBox(srcImg, bgCol);
+static void *PredictorMain(void *arg) {
+    Predictor *p = arg;
+    while (!atomic_load(&p->stop)) {
+        // Only the newest request is worth running; the ones it supersedes are dropped
+        PredictRequest *req = NULL, *next;
+        while ((next = spscPop(p->requests)) != NULL) {
+            if (req != NULL) {
+                next->report |= req->report;
+                FreeRequest(req);
+            }
+            req = next;
+        }
+        if (req == NULL) {
+            pthread_mutex_lock(&p->lock);
+            while (spscEmpty(p->requests) && !atomic_load(&p->stop)) {
+                pthread_cond_wait(&p->wake, &p->lock);
+            }
+            pthread_mutex_unlock(&p->lock);
+            continue;
+        }
 
-    if (bbox.width <= 0 || bbox.height <= 0) {
-        BeginTextureMode(destTexture);
-        ClearBackground(bgCol);
-        EndTextureMode();
-        return;
+        PredictResult *res = RunRequest(req);
+        FreeRequest(req);
+        // The render thread drains the results every frame, so a full queue clears quickly
+        while (res != NULL && spscPush(p->results, res) != 0) {
+            if (atomic_load(&p->stop)) {
+                free(res);
+                break;
+            }
+            WaitTime(0.001);
+        }
     }
+    return NULL;
+}
+
+int StartPredictor(Predictor *p) {
+    p->requests = createSpscQueue(QUEUE_SIZE);
+    p->results = createSpscQueue(QUEUE_SIZE);
+    atomic_init(&p->stop, false);
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    if (p->requests == NULL || p->results == NULL || pthread_create(&p->thread, NULL, PredictorMain, p) != 0) {
+        freeSpscQueue(p->requests);
+        freeSpscQueue(p->results);
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->wake);
+        return 1;
+    }
+    return 0;
+}
+
+void StopPredictor(Predictor *p) {
+    pthread_mutex_lock(&p->lock);
+    atomic_store(&p->stop, true);
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    pthread_join(p->thread, NULL);
+
+    void *item;
+    while ((item = spscPop(p->requests)) != NULL) FreeRequest(item);
+    while ((item = spscPop(p->results)) != NULL) free(item);
+    freeSpscQueue(p->requests);
+    freeSpscQueue(p->results);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+}
+
+// Queue a request without waiting (render thread)
+// Returns 0 if it was queued, 1 if the queue is full and the caller keeps it
+int SubmitRequest(Predictor *p, PredictRequest *req) {
+    if (spscPush(p->requests, req) != 0) return 1;
+    pthread_mutex_lock(&p->lock); // Held by the worker only while it checks the queue
+    pthread_cond_signal(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
 
-    float scaleX = (float)destTexture.texture.width / bbox.width;
-    float scaleY = (float)destTexture.texture.height / bbox.height;
-    float scale = (scaleX < scaleY) ? scaleX : scaleY;
-    scale *= 0.60f; // Padding factor
+// --- Cached UI Layers ---
+// What only changes on a prediction or a clear is drawn once into a texture,
+// so a frame is a handful of textured quads instead of ~900 draw calls
+
+// Upload the grid as a 28x28 texture (inverted for display)
+void UpdatePreview(Texture2D preview, double inputGrid[GRID_H][GRID_W]) {
+    Color pixels[GRID_H * GRID_W];
+    for (int y = 0; y < GRID_H; y++) {
+        for (int x = 0; x < GRID_W; x++) {
+            unsigned char gray = (unsigned char)(255.0 * (1.0 - inputGrid[y][x]));
+            pixels[y * GRID_W + x] = (Color){ gray, gray, gray, 255 };
+        }
+    }
+    UpdateTexture(preview, pixels);
+}
 
-    float destWidth = bbox.width * scale;
-    float destHeight = bbox.height * scale;
-    float destX = (destTexture.texture.width - destWidth) / 2.0f;
-    float destY = (destTexture.texture.height - destHeight) / 2.0f;
-    Rectangle destRect = { destX, destY, destWidth, destHeight };
-    Rectangle sourceRect = bbox;
+// Background, frames, titles and key help: drawn once at startup
+void RenderStaticLayer(RenderTexture2D layer, Rectangle drawRect, Rectangle prvRect, Rectangle txtRect) {
+    BeginTextureMode(layer);
+    ClearBackground(LIGHTGRAY);
+    DrawText("Drawing Area", drawRect.x, drawRect.y - 25, 20, DARKGRAY);
+    DrawText("28x28 Input Preview", prvRect.x, prvRect.y - 25, 20, DARKGRAY);
+    DrawRectangleLinesEx(prvRect, 1, DARKGRAY);
+    DrawText("Prediction Info", txtRect.x + 5, txtRect.y - 25, 20, DARKGRAY);
+    DrawText("[LMB] Draw | [C] Clear | [Enter] Process | [L] Live prediction | [T] Augment | [P] Profile", PAD, SCR_H - 35, 20, DARKGRAY);
+    EndTextureMode();
+}
 
-    Texture2D tempTex = LoadTextureFromImage(srcImg);
+// Prediction text area, in its own coordinates: drawn again when the prediction changes
+void RenderInfoLayer(RenderTexture2D layer, int predicted_digit) {
+    Rectangle area = { 0, 0, (float)layer.texture.width, (float)layer.texture.height };
+    BeginTextureMode(layer);
+    ClearBackground(LIGHTGRAY);
+    DrawRectangleRec(area, Fade(SKYBLUE, 0.1f)); // Background for prediction text area
+    DrawRectangleLinesEx(area, 1, DARKGRAY);
+
+    if (predicted_digit != -1) {
+        // Draw the main prediction
+        const char *predLabel = TextFormat("Predicted: %d", predicted_digit);
+        int predFontSize = 30;
+        Vector2 predSize = MeasureTextEx(GetFontDefault(), predLabel, predFontSize, 1);
+        DrawText(predLabel, (int)((area.width - predSize.x)/2), 10, predFontSize, MAROON);
+
+         // Add note about console output
+        DrawText("Probabilities printed", 10, 60, FONT_SZ_INFO, DARKGRAY);
+        DrawText("to console window.", 10, 60 + FONT_SZ_INFO + 2, FONT_SZ_INFO, DARKGRAY);
 
-    BeginTextureMode(destTexture);
-    ClearBackground(bgCol);
-    DrawTexturePro(tempTex, sourceRect, destRect, (Vector2){0, 0}, 0.0f, WHITE);
+    } else {
+         DrawText("Draw a digit", 10, 10, FONT_SZ_INFO, DARKGRAY);
+         DrawText("and press [Enter]", 10, 10 + FONT_SZ_INFO + 2, FONT_SZ_INFO, DARKGRAY);
+         DrawText("Check console for probs.", 10, 10 + 2*(FONT_SZ_INFO + 2), FONT_SZ_INFO, DARKGRAY);
+    }
     EndTextureMode();
+}
 
-    UnloadTexture(tempTex);
+// Render textures are stored bottom-up, hence the negative height
+void DrawLayer(RenderTexture2D layer, Vector2 position) {
+    DrawTextureRec(layer.texture, (Rectangle){ 0, 0, (float)layer.texture.width, (float)-layer.texture.height }, position, WHITE);
 }
 
 // --- Main Function ---
 int main(void) {
     int predicted_digit = -1;
     double inputGrid[GRID_H][GRID_W] = {0.0};
-    double input1D[GRID_W * GRID_H];
 
     // --- Initialize NN ---
-    initializeNetwork(network_structure, n);
-    importNetwork();
+    // Map the binary model if it has been converted, else parse the text files
+    if (loadNetwork("model.nnb") != 0) {
+        initializeNetwork(network_structure, n);
+        importNetwork();
+    }
 
     // --- Setup Window & Layout ---
     InitWindow(SCR_W, SCR_H, "Raylib Digit Recognizer (Improved)");
@@ -110,7 +293,6 @@ int main(void) {
 
     Rectangle drawRect = { (float)padL, (float)PAD, (float)drawSz, (float)drawSz };
     Rectangle prvRect = { drawRect.x + drawRect.width + elemPad, drawRect.y, (float)prvW, (float)prvW };
-    double prvCW = prvRect.width / GRID_W, prvCH = prvRect.height / GRID_H;
     Rectangle txtRect = { prvRect.x + prvRect.width + elemPad, prvRect.y, (float)txtW, (float)prvW }; // Area for prediction text
 
 
@@ -118,14 +300,41 @@ int main(void) {
     RenderTexture2D drawingCanvas = LoadRenderTexture(drawRect.width, drawRect.height);
     BeginTextureMode(drawingCanvas); ClearBackground(BG_COL); EndTextureMode();
 
-    RenderTexture2D centeredCanvas = LoadRenderTexture(drawRect.width, drawRect.height);
-    BeginTextureMode(centeredCanvas); ClearBackground(BG_COL); EndTextureMode();
-
-    RenderTexture2D finalInputTexture = LoadRenderTexture(GRID_W, GRID_H);
-    BeginTextureMode(finalInputTexture); ClearBackground(BG_COL); EndTextureMode();
+    RenderTexture2D staticLayer = LoadRenderTexture(SCR_W, SCR_H);
+    RenderStaticLayer(staticLayer, drawRect, prvRect, txtRect);
+
+    RenderTexture2D infoLayer = LoadRenderTexture(txtRect.width, txtRect.height);
+    RenderInfoLayer(infoLayer, predicted_digit);
+    int shownDigit = predicted_digit;   // What infoLayer currently says
+
+    // Point-filtered, so each input pixel scales up to a sharp cell
+    Image blankPreview = GenImageColor(GRID_W, GRID_H, WHITE);
+    Texture2D previewTexture = LoadTextureFromImage(blankPreview);
+    UnloadImage(blankPreview);
+    bool previewDirty = false;          // inputGrid changed since the last upload
+
+    // --- Prediction Worker ---
+    // From here on only the worker touches the network
+    Predictor predictor;
+    if (StartPredictor(&predictor) != 0) {
+        TraceLog(LOG_ERROR, "Failed to start the prediction thread");
+        UnloadTexture(previewTexture);
+        UnloadRenderTexture(infoLayer);
+        UnloadRenderTexture(staticLayer);
+        UnloadRenderTexture(drawingCanvas);
+        CloseWindow();
+        freeNetwork();
+        return 1;
+    }
+    PredictRequest *pending = NULL;   // Newest request the full queue has not taken yet
+    int sequence = 0;                 // Of the last request made
+    int clearedAt = 0;                // Results for requests up to this one predate the last clear
 
 
     bool drawing = false;
+    bool livePrediction = true;   // Predict every frame the drawing changes
+    bool augmented = false;       // Average the logits over shifted, rotated and scaled copies
+    bool canvasDirty = false;     // Drawing changed this frame
     Vector2 prevMp = { -1.0f, -1.0f };
 
     // --- Main Loop ---
@@ -139,6 +348,7 @@ int main(void) {
             drawing = true;
             prevMp = mpCanv;
             BeginTextureMode(drawingCanvas); DrawCircleV(mpCanv, BRUSH_R, FG_COL); EndTextureMode();
+            canvasDirty = true;
         }
         if (drawing && IsMouseButtonDown(MOUSE_LEFT_BUTTON)) {
             if (inDrawRect) {
@@ -147,6 +357,7 @@ int main(void) {
                 DrawLineEx(prevMp, mpCanv, BRUSH_R * 2.0f, FG_COL);
                 EndTextureMode();
                 prevMp = mpCanv;
+                canvasDirty = true;
             } else {
                 drawing = false;
                 prevMp = (Vector2){ -1.0f, -1.0f };
@@ -160,110 +371,105 @@ int main(void) {
         // --- Clear Logic ---
         if (IsKeyPressed(KEY_C)) {
             BeginTextureMode(drawingCanvas); ClearBackground(BG_COL); EndTextureMode();
-            BeginTextureMode(centeredCanvas); ClearBackground(BG_COL); EndTextureMode();
-            BeginTextureMode(finalInputTexture); ClearBackground(BG_COL); EndTextureMode();
             for (int y = 0; y < GRID_H; ++y)
                 for (int x = 0; x < GRID_W; ++x)
                     inputGrid[y][x] = 0.0;
             predicted_digit = -1; // Reset prediction
+            previewDirty = true;
+            FreeRequest(pending);
+            pending = NULL;
+            clearedAt = sequence; // Drop the answers still on their way
             drawing = false;
             prevMp = (Vector2){ -1.0f, -1.0f };
         }
 
-        // --- Process Logic (KEY_ENTER) ---
-        if (IsKeyPressed(KEY_ENTER)) {
-            Image drawnImage = LoadImageFromTexture(drawingCanvas.texture);
-
-            CenterImage(drawnImage, centeredCanvas, BG_COL);
-            Image centeredImg = LoadImageFromTexture(centeredCanvas.texture);
-            Image finalImage = ImageCopy(centeredImg); // Work on a copy
-
-            // Ensure format is grayscale and resize to final 28x28
-            ImageFormat(&finalImage, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE);
-            ImageResize(&finalImage, GRID_W, GRID_H);
-
-            // --- Directly populate inputGrid from the 28x28 finalImage ---
-            if (finalImage.data != NULL && finalImage.width == GRID_W && finalImage.height == GRID_H) {
-                unsigned char* pixels = (unsigned char*)finalImage.data;
-                for (int y = 0; y < GRID_H; y++) {
-                    for (int x = 0; x < GRID_W; x++) {
-                        // Get the grayscale pixel value (0-255)
-                        unsigned char intensity = pixels[y * GRID_W + x];
-                        // Normalize to 0.0 (black) - 1.0 (white) for the NN input
-                        inputGrid[y][x] = (double)intensity / 255.0;
-                    }
+        // --- Live and Process Logic (KEY_ENTER) ---
+        // Reading the canvas back is all the frame does; the worker predicts
+        if (IsKeyPressed(KEY_L)) livePrediction = !livePrediction;
+        bool report = IsKeyPressed(KEY_ENTER);
+        if ((livePrediction && canvasDirty) || report) {
+            PredictRequest *req = malloc(sizeof(PredictRequest));
+            if (req != NULL) {
+                req->canvas = LoadImageFromTexture(drawingCanvas.texture);
+                req->sequence = ++sequence;
+                req->augmented = augmented;
+                req->report = report;
+                // A newer drawing supersedes the one still waiting for room
+                if (pending != NULL) {
+                    req->report |= pending->report;
+                    FreeRequest(pending);
                 }
-            } else {
-                 // Handle error case if image processing failed
-                 TraceLog(LOG_ERROR, "Failed to process image to 28x28 grayscale");
-                 for (int y = 0; y < GRID_H; ++y) for (int x = 0; x < GRID_W; ++x) inputGrid[y][x] = 0.0;
+                pending = req;
             }
+        }
+        canvasDirty = false;
+        if (pending != NULL && SubmitRequest(&predictor, pending) == 0) pending = NULL;
+
+        // --- Results ---
+        PredictResult *res;
+        while ((res = spscPop(predictor.results)) != NULL) {
+            if (res->sequence > clearedAt) {
+                memcpy(inputGrid, res->grid, sizeof(inputGrid));
+                predicted_digit = res->digit;
+                previewDirty = true;
+            }
+            free(res);
+        }
 
-            flatten2D(inputGrid, input1D);
-            feedForward(input1D);
-
-            printf("\n--- Network Output Probabilities ---\n");
-            displayFinalOutput(); // Prints probabilities to CONSOLE
-            printf("------------------------------------\n");
+        // --- Cached Layer Updates ---
+        if (previewDirty) {
+            UpdatePreview(previewTexture, inputGrid);
+            previewDirty = false;
+        }
+        if (predicted_digit != shownDigit) {
+            RenderInfoLayer(infoLayer, predicted_digit);
+            shownDigit = predicted_digit;
+        }
 
-            predicted_digit = getPrediction();
+        // --- Test-time augmentation toggle ---
+        if (IsKeyPressed(KEY_T)) {
+            augmented = !augmented;
+            printf("Test-time augmentation %s\n", augmented ? "on" : "off");
+        }
 
-            UnloadImage(drawnImage);
-            UnloadImage(centeredImg);
-            UnloadImage(finalImage);
+        // --- Profile Logic ---
+        // The first [P] turns the timers on, every later one prints what they counted
+        if (IsKeyPressed(KEY_P)) {
+            if (profilingLevel() == NN_PROFILE_OFF) {
+                setProfiling(NN_PROFILE_TIMERS);
+                resetProfile();
+                printf("Profiling on, press [P] again for the counters\n");
+            } else {
+                ProfileSnapshot snapshot;
+                profileSnapshot(&snapshot);
+                writeProfileJson(stdout, &snapshot);
+            }
         }
         // --- Drawing Section ---
         BeginDrawing();
-        ClearBackground(LIGHTGRAY);
+        DrawLayer(staticLayer, (Vector2){ 0, 0 });
 
         // Draw the raw drawing canvas
-        DrawTextureRec(drawingCanvas.texture, (Rectangle){ 0, 0, (float)drawingCanvas.texture.width, (float)-drawingCanvas.texture.height }, (Vector2){ drawRect.x, drawRect.y }, WHITE);
+        DrawLayer(drawingCanvas, (Vector2){ drawRect.x, drawRect.y });
         DrawRectangleLinesEx(drawRect, 2, DARKGRAY);
-        DrawText("Drawing Area", drawRect.x, drawRect.y - 25, 20, DARKGRAY);
 
         // Draw the 28x28 preview
-        DrawText("28x28 Input Preview", prvRect.x, prvRect.y - 25, 20, DARKGRAY);
-        DrawRectangleLinesEx(prvRect, 1, DARKGRAY);
-        for (int y = 0; y < GRID_H; y++) {
-            for (int x = 0; x < GRID_W; x++) {
-                unsigned char gray = (unsigned char)(255.0 * (1.0 - inputGrid[y][x])); // Invert for display
-                Color cellCol = { gray, gray, gray, 255 };
-                DrawRectangle((int)(prvRect.x + x * prvCW), (int)(prvRect.y + y * prvCH), (int)ceil(prvCW), (int)ceil(prvCH), cellCol);
-            }
-        }
+        DrawTexturePro(previewTexture, (Rectangle){ 0, 0, GRID_W, GRID_H }, prvRect, (Vector2){ 0, 0 }, 0.0f, WHITE);
 
         // --- Draw Prediction Text ---
-        DrawRectangleRec(txtRect, Fade(SKYBLUE, 0.1f)); // Background for prediction text area
-        DrawRectangleLinesEx(txtRect, 1, DARKGRAY);
-        DrawText("Prediction Info", txtRect.x + 5, txtRect.y - 25, 20, DARKGRAY);
-
-        if (predicted_digit != -1) {
-            // Draw the main prediction
-            const char *predLabel = TextFormat("Predicted: %d", predicted_digit);
-            int predFontSize = 30;
-            Vector2 predSize = MeasureTextEx(GetFontDefault(), predLabel, predFontSize, 1);
-            DrawText(predLabel, (int)(txtRect.x + (txtRect.width - predSize.x)/2), (int)txtRect.y + 10, predFontSize, MAROON);
-
-             // Add note about console output
-            DrawText("Probabilities printed", txtRect.x + 10, txtRect.y + 60, FONT_SZ_INFO, DARKGRAY);
-            DrawText("to console window.", txtRect.x + 10, txtRect.y + 60 + FONT_SZ_INFO + 2, FONT_SZ_INFO, DARKGRAY);
-
-        } else {
-             DrawText("Draw a digit", (int)txtRect.x + 10, (int)txtRect.y + 10, FONT_SZ_INFO, DARKGRAY);
-             DrawText("and press [Enter]", (int)txtRect.x + 10, (int)txtRect.y + 10 + FONT_SZ_INFO + 2, FONT_SZ_INFO, DARKGRAY);
-             DrawText("Check console for probs.", (int)txtRect.x + 10, (int)txtRect.y + 10 + 2*(FONT_SZ_INFO + 2), FONT_SZ_INFO, DARKGRAY);
-        }
-
-
-        DrawText("[LMB] Draw | [C] Clear | [Enter] Process", PAD, SCR_H - 35, 20, DARKGRAY);
+        DrawLayer(infoLayer, (Vector2){ txtRect.x, txtRect.y });
 
         EndDrawing();
     }
 
     // --- Cleanup ---
+    StopPredictor(&predictor);
+    FreeRequest(pending);
+    UnloadTexture(previewTexture);
+    UnloadRenderTexture(infoLayer);
+    UnloadRenderTexture(staticLayer);
     UnloadRenderTexture(drawingCanvas);
-    UnloadRenderTexture(centeredCanvas);
-    UnloadRenderTexture(finalInputTexture);
     CloseWindow();
+    freeNetwork();
     return 0;
 }
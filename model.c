@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "model.h"
+#include "sparse.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* ========== Helpers ========== */
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * FNV-1a 64-bit hash
+ *
+ * @param data Bytes to hash
+ * @param size Number of bytes
+ * @return Hash value
+ */
+uint64_t modelChecksum(const void *data, size_t size) {
+    const unsigned char *p = data;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+/* ========== Writing ========== */
+
+/**
+ * Elements per stored weight row of a layer
+ * Rows keep the layer's own stride; columns are padded to whole NN_ALIGN
+ * blocks like the sparse-input kernel's copy (see nn.c).
+ */
+static uint32_t storedStride(const Layer *l, int layout) {
+    if (layout == NN_LAYOUT_COLUMNS) {
+        return (uint32_t)(alignOffset(sizeof(double) * (uint64_t)l->size, NN_ALIGN) / sizeof(double));
+    }
+    return (uint32_t)l->stride;
+}
+
+/**
+ * Write layers to a binary model file
+ * The file is assembled in memory, written to path.tmp and renamed over
+ * path, so a reader never sees a partial file, and a process that still
+ * maps the old file (see reloadModel) keeps its old contents.
+ *
+ * @param path Output file
+ * @param layers Layer array, input layer first
+ * @param layerCount Number of layers
+ * @param layout NN_LAYOUT_* the weights are stored in
+ * @param sparseDensity Nonzero fraction up to which a layer is stored as CSR, 0 for none
+ * @return 0 on success, 1 on failure
+ */
+int writeModelFile(const char *path, const Layer *layers, int layerCount, int layout, double sparseDensity) {
+    const uint64_t align = NN_ALIGN;
+    uint64_t headerSize = alignOffset(sizeof(ModelHeader) +
+                                      (sizeof(ModelLayerEntry) + sizeof(ModelSparseEntry)) * (uint64_t)layerCount, align);
+    if (layout != NN_LAYOUT_ROWS && layout != NN_LAYOUT_COLUMNS) {
+        fprintf(stderr, "Error: unknown model layout %d\n", layout);
+        return 1;
+    }
+
+    // Pick the layers stored as CSR
+    uint64_t *nonzeros = calloc((size_t)layerCount, sizeof(uint64_t));
+    if (nonzeros == NULL) {
+        fprintf(stderr, "Memory allocation failed for model file\n");
+        return 1;
+    }
+    for (int i = 1; i < layerCount; i++) {
+        size_t count = sparseDensity > 0 ? countNonzeros(&layers[i]) : 0;
+        int csr = sparseDensity > 0 && count <= sparseDensity * layers[i].size * layers[i].inputs &&
+                  count <= UINT32_MAX;
+        nonzeros[i] = csr ? count : UINT64_MAX;
+    }
+
+    // Lay out the blobs
+    uint64_t offset = headerSize;
+    for (int i = 1; i < layerCount; i++) {
+        if (nonzeros[i] != UINT64_MAX) {
+            offset += alignOffset(sizeof(double) * nonzeros[i], align);
+            offset += alignOffset(sizeof(uint32_t) * ((uint64_t)layers[i].size + 1), align);
+            offset += alignOffset(sizeof(uint32_t) * nonzeros[i], align);
+        } else {
+            uint64_t rows = (layout == NN_LAYOUT_COLUMNS) ? (uint64_t)layers[i].inputs : (uint64_t)layers[i].size;
+            offset += alignOffset(sizeof(double) * rows * storedStride(&layers[i], layout), align);
+        }
+        offset += alignOffset(sizeof(double) * (uint64_t)layers[i].size, align);
+    }
+    uint64_t fileSize = offset;
+
+    unsigned char *buf = calloc(1, fileSize);
+    if (buf == NULL) {
+        fprintf(stderr, "Memory allocation failed for model file\n");
+        free(nonzeros);
+        return 1;
+    }
+
+    ModelHeader *h = (ModelHeader*) buf;
+    ModelLayerEntry *entries = (ModelLayerEntry*)(buf + sizeof(ModelHeader));
+    ModelSparseEntry *sparse = (ModelSparseEntry*)(entries + layerCount);
+    memcpy(h->magic, NN_MODEL_MAGIC, 4);
+    h->version = NN_MODEL_VERSION;
+    h->headerSize = (uint32_t)headerSize;
+    h->layerCount = (uint32_t)layerCount;
+    h->dtype = NN_DTYPE_F64;
+    h->layout = (uint32_t)layout;
+    h->alignment = (uint32_t)align;
+    h->endian = NN_MODEL_ENDIAN;
+    h->fileSize = fileSize;
+
+    offset = headerSize;
+    for (int i = 0; i < layerCount; i++) {
+        const Layer *l = &layers[i];
+        ModelLayerEntry *e = &entries[i];
+        e->size = (uint32_t)l->size;
+        e->inputs = (uint32_t)l->inputs;
+        e->stride = storedStride(l, layout);
+        if (i == 0) continue;
+        e->activation = (uint32_t)l->activation;
+
+        size_t wBytes;
+        e->weightsOffset = offset;
+        if (nonzeros[i] != UINT64_MAX) {
+            // Values, row starts and indices, neuron by neuron
+            double *values = (double*)(buf + offset);
+            offset += alignOffset(sizeof(double) * nonzeros[i], align);
+            uint32_t *rowStart = (uint32_t*)(buf + offset);
+            sparse[i].rowStartOffset = offset;
+            offset += alignOffset(sizeof(uint32_t) * ((uint64_t)l->size + 1), align);
+            uint32_t *index = (uint32_t*)(buf + offset);
+            sparse[i].indexOffset = offset;
+            sparse[i].format = NN_FORMAT_CSR;
+            sparse[i].nonzeros = (uint32_t)nonzeros[i];
+
+            uint32_t at = 0;
+            for (int o = 0; o < l->size; o++) {
+                const double *row = l->weights + (size_t)o * l->stride;
+                rowStart[o] = at;
+                for (int k = 0; k < l->inputs; k++) {
+                    if (row[k] == 0.0) continue;
+                    index[at] = (uint32_t)k;
+                    values[at++] = row[k];
+                }
+            }
+            rowStart[l->size] = at;
+            wBytes = sizeof(uint32_t) * nonzeros[i];   // The indices end the layer's weight blobs
+        } else if (layout == NN_LAYOUT_COLUMNS) {
+            wBytes = sizeof(double) * (size_t)l->inputs * e->stride;
+            transposeMatrix(l->weights, (size_t)l->stride, (double*)(buf + offset), e->stride, l->size, l->inputs);
+        } else {
+            wBytes = sizeof(double) * (size_t)l->size * l->stride;
+            memcpy(buf + offset, l->weights, wBytes);
+        }
+        offset += alignOffset(wBytes, align);
+
+        e->biasOffset = offset;
+        memcpy(buf + offset, l->bias, sizeof(double) * l->size);
+        offset += alignOffset(sizeof(double) * l->size, align);
+    }
+    free(nonzeros);
+
+    h->checksum = modelChecksum(buf + sizeof(ModelHeader), fileSize - sizeof(ModelHeader));
+
+    char *temporary = malloc(strlen(path) + 5);
+    if (temporary == NULL) {
+        free(buf);
+        return 1;
+    }
+    sprintf(temporary, "%s.tmp", path);
+
+    FILE *f = fopen(temporary, "wb");
+    if (f == NULL) {
+        perror("Error creating model file");
+        free(temporary);
+        free(buf);
+        return 1;
+    }
+    int status = fwrite(buf, 1, fileSize, f) == fileSize ? 0 : 1;
+    if (fclose(f) != 0) status = 1;
+#ifdef _WIN32
+    if (status == 0 && !MoveFileExA(temporary, path, MOVEFILE_REPLACE_EXISTING)) status = 1;
+#else
+    if (status == 0 && rename(temporary, path) != 0) status = 1;
+#endif
+    if (status != 0) {
+        fprintf(stderr, "Error writing model file %s\n", path);
+        remove(temporary);
+    }
+    free(temporary);
+    free(buf);
+    return status;
+}
+
+/* ========== Mapping ========== */
+
+/**
+ * Map a whole file read-only and shared
+ * Every process mapping the same file shares its page-cached contents.
+ *
+ * @param path File to map
+ * @param map Filled in on success
+ * @return 0 on success, 1 on failure
+ */
+int mapFile(const char *path, MappedFile *map) {
+    memset(map, 0, sizeof(*map));
+
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Error opening %s\n", path);
+        return 1;
+    }
+    LARGE_INTEGER len;
+    if (!GetFileSizeEx(fh, &len) || len.QuadPart == 0) {
+        fprintf(stderr, "Error: %s is empty\n", path);
+        CloseHandle(fh);
+        return 1;
+    }
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(fh);
+    if (mh == NULL) {
+        fprintf(stderr, "Error mapping %s\n", path);
+        return 1;
+    }
+    void *base = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    if (base == NULL) {
+        fprintf(stderr, "Error mapping %s\n", path);
+        CloseHandle(mh);
+        return 1;
+    }
+    map->handle = mh;
+    map->size = (size_t)len.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening %s: ", path);
+        perror("");
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Error: %s is empty\n", path);
+        close(fd);
+        return 1;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "Error mapping %s: ", path);
+        perror("");
+        return 1;
+    }
+    map->size = (size_t)st.st_size;
+#endif
+
+    map->base = base;
+    return 0;
+}
+
+/**
+ * Release a mapping made by mapFile
+ * Safe to call on a zeroed MappedFile
+ */
+void unmapFile(MappedFile *map) {
+    if (map->base != NULL) {
+#ifdef _WIN32
+        UnmapViewOfFile(map->base);
+        CloseHandle(map->handle);
+#else
+        munmap((void*) map->base, map->size);
+#endif
+    }
+    memset(map, 0, sizeof(*map));
+}
+
+/**
+ * Tell the OS how a range of a mapping will be used (best effort)
+ * Lets a file far larger than RAM be streamed through its mapping: pages
+ * ahead of the reader are fetched early and pages behind it are dropped.
+ *
+ * @param map Mapping made by mapFile
+ * @param offset First byte of the range
+ * @param length Bytes in the range
+ * @param advice NN_ADVISE_*
+ */
+void adviseFile(const MappedFile *map, size_t offset, size_t length, int advice) {
+    if (map->base == NULL || offset >= map->size) return;
+    if (length > map->size - offset) length = map->size - offset;
+
+#ifdef _WIN32
+    (void) advice;   // PrefetchVirtualMemory needs Windows 8 headers; rely on the cache manager
+#else
+    // madvise works on whole pages: widen WILLNEED ranges, shrink DONTNEED ones
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t begin = offset, end = offset + length;
+    if (advice == NN_ADVISE_SEQUENTIAL) {
+        begin = 0;
+        end = map->size;
+    } else if (advice == NN_ADVISE_DONTNEED) {
+        begin = (begin + page - 1) / page * page;
+        end = end / page * page;
+    } else {
+        begin = begin / page * page;
+    }
+    if (end <= begin) return;
+
+    int flag = (advice == NN_ADVISE_SEQUENTIAL) ? MADV_SEQUENTIAL :
+               (advice == NN_ADVISE_WILLNEED) ? MADV_WILLNEED : MADV_DONTNEED;
+    madvise((void*)(map->base + begin), end - begin, flag);
+#endif
+}
+
+/**
+ * Whether bytes at offset lie inside a file of fileSize bytes
+ * Compares without adding, so a huge offset cannot wrap around.
+ */
+static int blobInFile(uint64_t offset, uint64_t bytes, uint64_t fileSize) {
+    return offset <= fileSize && bytes <= fileSize - offset;
+}
+
+/**
+ * Check the index blobs of a CSR layer
+ * Row starts must rise from 0 to the value count and every neuron's
+ * indices must be ascending inputs of the layer, so the kernels can trust them.
+ *
+ * @return 0 if the layer is usable, 1 otherwise
+ */
+static int validateSparseLayer(const ModelFile *file, const ModelLayerEntry *e, const ModelSparseEntry *s) {
+    const ModelHeader *h = file->header;
+    if (s->rowStartOffset % h->alignment != 0 || s->indexOffset % h->alignment != 0 ||
+        s->rowStartOffset < h->headerSize || s->indexOffset < h->headerSize ||
+        !blobInFile(s->rowStartOffset, sizeof(uint32_t) * ((uint64_t)e->size + 1), h->fileSize) ||
+        !blobInFile(s->indexOffset, sizeof(uint32_t) * (uint64_t)s->nonzeros, h->fileSize)) {
+        return 1;
+    }
+
+    const uint32_t *rowStart = (const uint32_t*)(file->map.base + s->rowStartOffset);
+    const uint32_t *index = (const uint32_t*)(file->map.base + s->indexOffset);
+    if (rowStart[0] != 0 || rowStart[e->size] != s->nonzeros) {
+        return 1;
+    }
+    for (uint32_t o = 0; o < e->size; o++) {
+        if (rowStart[o + 1] < rowStart[o]) return 1;
+        for (uint32_t j = rowStart[o]; j < rowStart[o + 1]; j++) {
+            if (index[j] >= e->inputs || (j > rowStart[o] && index[j] <= index[j - 1])) return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Check the header and layer table of a mapped file
+ *
+ * @return 0 if the file is a usable model, 1 otherwise
+ */
+static int validateModelFile(const ModelFile *file, int verifyChecksum) {
+    const ModelHeader *h = file->header;
+
+    if (file->map.size < sizeof(ModelHeader) || memcmp(h->magic, NN_MODEL_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error: not a model file\n");
+        return 1;
+    }
+    if (h->endian != NN_MODEL_ENDIAN) {
+        fprintf(stderr, "Error: model file has the wrong byte order\n");
+        return 1;
+    }
+    if (h->version < 1 || h->version > NN_MODEL_VERSION) {
+        fprintf(stderr, "Error: unsupported model file version %u\n", h->version);
+        return 1;
+    }
+    size_t entryBytes = sizeof(ModelLayerEntry) + (h->version >= 3 ? sizeof(ModelSparseEntry) : 0);
+    if (h->fileSize != file->map.size || h->layerCount < 2 ||
+        h->headerSize > file->map.size ||
+        sizeof(ModelHeader) + entryBytes * (uint64_t)h->layerCount > h->headerSize ||
+        h->alignment == 0 || h->alignment % NN_ALIGN != 0) {
+        fprintf(stderr, "Error: model file is truncated or malformed\n");
+        return 1;
+    }
+    if (h->dtype != NN_DTYPE_F64 || (h->layout != NN_LAYOUT_ROWS && h->layout != NN_LAYOUT_COLUMNS)) {
+        fprintf(stderr, "Error: unsupported model dtype %u / layout %u\n", h->dtype, h->layout);
+        return 1;
+    }
+
+    // Every blob must be aligned and lie inside the file
+    const ModelSparseEntry *sparse = (h->version >= 3) ? (const ModelSparseEntry*)(file->layers + h->layerCount) : NULL;
+    for (uint32_t i = 1; i < h->layerCount; i++) {
+        const ModelLayerEntry *e = &file->layers[i];
+        int columns = (h->layout == NN_LAYOUT_COLUMNS);
+        // At most (2^32 - 1)^2 elements, which fits; only the byte count can overflow
+        uint64_t wElements = (uint64_t)(columns ? e->inputs : e->size) * e->stride;
+        if (wElements > UINT64_MAX / sizeof(double)) {
+            fprintf(stderr, "Error: model file layer %u is malformed\n", i);
+            return 1;
+        }
+        uint64_t wBytes = sizeof(double) * wElements;
+        if (sparse != NULL && sparse[i].format == NN_FORMAT_CSR) {
+            if (validateSparseLayer(file, e, &sparse[i]) != 0) {
+                fprintf(stderr, "Error: model file layer %u is malformed\n", i);
+                return 1;
+            }
+            wBytes = sizeof(double) * (uint64_t)sparse[i].nonzeros;
+        } else if (sparse != NULL && sparse[i].format != NN_FORMAT_DENSE) {
+            fprintf(stderr, "Error: model file layer %u has unknown format %u\n", i, sparse[i].format);
+            return 1;
+        }
+        if (e->size == 0 || e->inputs != file->layers[i-1].size || e->stride < (columns ? e->size : e->inputs) ||
+            (e->activation != 0 && activationName((int)e->activation) == NULL) ||
+            e->weightsOffset % h->alignment != 0 || e->biasOffset % h->alignment != 0 ||
+            e->weightsOffset < h->headerSize || !blobInFile(e->weightsOffset, wBytes, h->fileSize) ||
+            e->biasOffset < h->headerSize || !blobInFile(e->biasOffset, sizeof(double) * (uint64_t)e->size, h->fileSize)) {
+            fprintf(stderr, "Error: model file layer %u is malformed\n", i);
+            return 1;
+        }
+    }
+
+    if (verifyChecksum &&
+        modelChecksum(file->map.base + sizeof(ModelHeader), file->map.size - sizeof(ModelHeader)) != h->checksum) {
+        fprintf(stderr, "Error: model file checksum mismatch\n");
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Map a model file read-only and validate it
+ *
+ * @param path Model file
+ * @param file Filled in on success
+ * @param verifyChecksum Non-zero to hash the whole file before accepting it
+ * @return 0 on success, 1 on failure
+ */
+int mapModelFile(const char *path, ModelFile *file, int verifyChecksum) {
+    memset(file, 0, sizeof(*file));
+    if (mapFile(path, &file->map) != 0) {
+        return 1;
+    }
+
+    file->header = (const ModelHeader*) file->map.base;
+    file->layers = (const ModelLayerEntry*)(file->map.base + sizeof(ModelHeader));
+
+    if (validateModelFile(file, verifyChecksum) != 0) {
+        unmapModelFile(file);
+        return 1;
+    }
+    if (file->header->version >= 3) {
+        file->sparse = (const ModelSparseEntry*)(file->layers + file->header->layerCount);
+    }
+    return 0;
+}
+
+/**
+ * Release a mapping made by mapModelFile
+ * Safe to call on a zeroed ModelFile
+ */
+void unmapModelFile(ModelFile *file) {
+    unmapFile(&file->map);
+    memset(file, 0, sizeof(*file));
+}
+
+/* ========== Layouts ========== */
+
+/**
+ * Transpose a strided matrix, one cache-sized tile at a time
+ * Walking whole rows of the source would write each destination row once
+ * per source row; tiles of NN_TRANSPOSE_TILE x NN_TRANSPOSE_TILE keep both
+ * the source and destination lines of a tile in L1 until it is done.
+ * Padding elements of dst are left untouched.
+ *
+ * @param src rows x cols source, srcStride elements per row
+ * @param srcStride Elements between source rows
+ * @param dst cols x rows destination, dstStride elements per row
+ * @param dstStride Elements between destination rows
+ * @param rows Rows of src
+ * @param cols Columns of src
+ */
+void transposeMatrix(const double *src, size_t srcStride, double *dst, size_t dstStride, int rows, int cols) {
+    for (int r0 = 0; r0 < rows; r0 += NN_TRANSPOSE_TILE) {
+        int r1 = (r0 + NN_TRANSPOSE_TILE < rows) ? r0 + NN_TRANSPOSE_TILE : rows;
+        for (int c0 = 0; c0 < cols; c0 += NN_TRANSPOSE_TILE) {
+            int c1 = (c0 + NN_TRANSPOSE_TILE < cols) ? c0 + NN_TRANSPOSE_TILE : cols;
+            for (int c = c0; c < c1; c++) {
+                double *out = dst + (size_t)c * dstStride;
+                for (int r = r0; r < r1; r++) {
+                    out[r] = src[(size_t)r * srcStride + c];
+                }
+            }
+        }
+    }
+}
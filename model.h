@@ -0,0 +1,113 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+/*
+ * Binary model file format (.nnb)
+ *
+ *   ModelHeader            64 bytes
+ *   ModelLayerEntry[]      one per layer, input layer first
+ *   ModelSparseEntry[]     one per layer (version 3 on)
+ *   padding                up to headerSize (a multiple of alignment)
+ *   tensor blobs           weights then biases of each dense layer, every
+ *                          blob starting on an `alignment` byte boundary
+ *
+ * All integers and values are little-endian. The checksum is FNV-1a 64 over
+ * bytes [sizeof(ModelHeader), fileSize), i.e. the layer table and all blobs.
+ * In the row layout blobs are laid out exactly like Layer in memory, so a
+ * mapped file is used in place without copying. The column layout stores
+ * each weight matrix the other way round, one padded row of neurons per
+ * input, as frameworks that keep dense kernels inputs x outputs write it;
+ * its weights are packed into rows when the file is opened, and the first
+ * layer's columns feed the sparse-input kernel straight from the mapping.
+ * The layer table is the model description: the network has layerCount
+ * layers of any size, each with its own activation.
+ *
+ * A layer whose sparse entry says NN_FORMAT_CSR (a pruned layer, see
+ * sparse.h) stores only its nonzero weights, whatever the layout: the
+ * values at weightsOffset, then size + 1 uint32 row starts and one uint32
+ * input index per value in blobs of their own.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "nn.h"
+
+/* ========== Constants ========== */
+
+#define NN_MODEL_MAGIC    "NNMB"
+#define NN_MODEL_VERSION  3      // 2 added the per-layer activation, 3 the sparse table; older files still load
+#define NN_MODEL_ENDIAN   0x01020304u
+
+#define NN_DTYPE_F64      1      // IEEE-754 double
+
+#define NN_LAYOUT_ROWS    1      // Row-major, one padded row of inputs per neuron
+#define NN_LAYOUT_COLUMNS 2      // Column-major, one padded row of neurons per input
+
+#define NN_FORMAT_DENSE   0      // Layer weights in the file's layout
+#define NN_FORMAT_CSR     1      // Nonzero weights only, compressed sparse rows
+
+#define NN_TRANSPOSE_TILE 32     // Tile edge of transposeMatrix: two 32x32 double tiles fit in L1
+
+#define NN_ADVISE_SEQUENTIAL 0   // The mapping will be read front to back
+#define NN_ADVISE_WILLNEED   1   // Start reading a range in now
+#define NN_ADVISE_DONTNEED   2   // A range is done with; its pages can go
+
+/* ========== Data Structures ========== */
+
+typedef struct ModelHeader {
+    char magic[4];           // NN_MODEL_MAGIC
+    uint32_t version;        // NN_MODEL_VERSION
+    uint32_t headerSize;     // Bytes before the first blob
+    uint32_t layerCount;     // Layers including the input layer
+    uint32_t dtype;          // NN_DTYPE_*
+    uint32_t layout;         // NN_LAYOUT_*
+    uint32_t alignment;      // Blob alignment in bytes
+    uint32_t endian;         // NN_MODEL_ENDIAN as written by the producer
+    uint64_t fileSize;       // Total file size in bytes
+    uint64_t checksum;       // FNV-1a 64, see above
+    uint8_t reserved[16];
+} ModelHeader;
+
+typedef struct ModelLayerEntry {
+    uint32_t size;           // Neurons in this layer
+    uint32_t inputs;         // Neurons in the previous layer (0 for input layer)
+    uint32_t stride;         // Elements per weight row (per neuron, or per input in the column layout)
+    uint32_t activation;     // NN_ACTIVATION_*, 0 for the input layer or the defaults (version 1)
+    uint64_t weightsOffset;  // File offset of the size x stride (columns: inputs x stride) weights, 0 for input layer
+    uint64_t biasOffset;     // File offset of the size biases (0 for input layer)
+} ModelLayerEntry;
+
+typedef struct ModelSparseEntry {
+    uint32_t format;         // NN_FORMAT_*
+    uint32_t nonzeros;       // Values at weightsOffset of a CSR layer
+    uint64_t rowStartOffset; // File offset of the size + 1 row starts of a CSR layer
+    uint64_t indexOffset;    // File offset of the nonzeros input indices of a CSR layer
+} ModelSparseEntry;
+
+// Any file mapped read-only and shared into memory
+typedef struct MappedFile {
+    const unsigned char *base;      // Start of the mapping
+    size_t size;                    // Length of the mapping
+    void *handle;                   // Platform mapping handle
+} MappedFile;
+
+// A validated model file
+typedef struct ModelFile {
+    MappedFile map;
+    const ModelHeader *header;
+    const ModelLayerEntry *layers;  // header->layerCount entries
+    const ModelSparseEntry *sparse; // header->layerCount entries, NULL before version 3
+} ModelFile;
+
+/* ========== Function Declarations ========== */
+
+int mapFile(const char *path, MappedFile *map);
+void unmapFile(MappedFile *map);
+void adviseFile(const MappedFile *map, size_t offset, size_t length, int advice);
+uint64_t modelChecksum(const void *data, size_t size);
+int writeModelFile(const char *path, const Layer *layers, int layerCount, int layout, double sparseDensity);
+int mapModelFile(const char *path, ModelFile *file, int verifyChecksum);
+void unmapModelFile(ModelFile *file);
+void transposeMatrix(const double *src, size_t srcStride, double *dst, size_t dstStride, int rows, int cols);
+
+#endif // MODEL_H
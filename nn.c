@@ -9,418 +9,1833 @@
 
  #include <stdio.h>
  #include <stdlib.h>
+ #include <string.h>
  #include <time.h>
  #include <math.h>
- 
- /* ========== Data Structures ========== */
- 
- /**
-  * Structure to represent a weight node in the linked list
-  * Each weight connects a neuron to all neurons in the previous layer
-  */
- typedef struct WeightNode {
-     double weight;               // Weight value
-     struct WeightNode *next;     // Pointer to next weight
-     struct WeightNode *prev;     // Pointer to previous weight
- } Weight;
- 
- /**
-  * Structure to represent a neuron in the network
-  * Each neuron has a bias, an output value, and weights to previous layer
-  */
- typedef struct Neuron {
-     Weight* weightNode;          // Linked list of weights to previous layer
-     double bias;                 // Bias value for the neuron
-     double value;                // Output value of the neuron after activation
-     struct Neuron *next;         // Pointer to next neuron in the same layer
-     struct Neuron *prev;         // Pointer to previous neuron in the same layer
- } Neuron;
- 
- /**
-  * Structure to represent a layer in the network
-  * Each layer contains a linked list of neurons
-  */
- typedef struct Layer {
-     Neuron* neuron;              // Linked list of neurons in this layer
-     struct Layer *next;          // Pointer to next layer
-     struct Layer *prev;          // Pointer to previous layer
- } Layer;
- 
- /* ========== Function Declarations ========== */
- void initializeNetwork(int [], int);
- int importNetwork(void);
- double relu(double);
- void softmax(double*, double*, int);
- void feedForward(double []);
- void displayFinalOutput(void);
- 
+ #include <stdatomic.h>
+ #ifdef _WIN32
+ #include <malloc.h>
+ #endif
+ #include "nn.h"
+ #include "kernels.h"
+ #include "model.h"
+ #include "quant.h"
+ #include "reduced.h"
+ #include "pool.h"
+ #include "parse.h"
+ #include "profile.h"
+ #include "gemm.h"
+ #include "sparse.h"
+
+ /* ========== Private Structures ========== */
+
+ // Immutable weights shared by every context created from them
+ struct NetworkModel {
+     int layerCount;
+     Layer *layers;             // Weights and biases (value is only used by the global Network)
+     int widest;                // Largest layer size
+     int precision;             // NN_PRECISION_* the forward passes run at
+     QuantNetwork *quantized;   // INT8 copy for NN_PRECISION_INT8
+     FloatNetwork *floatCopy;   // Float or half copy for NN_PRECISION_FP32/FP16
+     int *shapes;               // Per layer: index into nnKernels->shapes, -1 without a specialized kernel
+     double *columns;           // Column-major copy of layer 1's weights for sparse inputs (fp64 only)
+     int columnStride;          // Column length of columns in doubles, padded to NN_ALIGN bytes
+     const double *fileColumns; // Layer 1's weights inside a column-layout mapping, usable as columns
+     int fileColumnStride;
+     double **packed;           // Per layer: weights packed for gemmPackedA (fp64 only), NULL without
+     int packedRows;            // gemmRows of the kernel table they were packed for
+     SparseNetwork *sparse;     // CSR copies of the pruned layers (fp64 only), NULL without
+     SparseLayer *stored;       // Per layer: CSR arrays inside a version 3 mapping, rowStart NULL without
+     ModelFile file;            // Mapping the weights live in when loaded from a file
+     void *arena;               // Layer array, plus weights and biases unless mapped
+     atomic_int refs;           // Handles and contexts still using the model
+ };
+
+ // Per-thread activations and scratch
+ struct NetworkContext {
+     NetworkModel *model;
+     double **values;           // Output values of each layer, values[0] is the input
+     unsigned char *scratch;    // One block of forward-pass scratch per worker
+     size_t scratchBlock;       // Bytes per worker block
+     size_t scratchTileBytes;   // Bytes of each of its two activation tiles
+     int scratchWorkers;        // Blocks allocated
+     double *averaged;          // Scratch: logits of the variants of an averaged pass
+     int averagedRows;          // Variants averaged fits
+     double *lastInput;         // Input of the last incremental pass, NULL before the first
+     double *firstSums;         // First-layer pre-activations of lastInput
+     double *changedDelta;      // Scratch: change of each changed input
+     int *changedIndex;         // Scratch: index of each changed input
+     int *nonzero;              // Scratch: indices of the nonzero inputs of a forward pass
+     int incrementalPasses;     // Incremental passes since firstSums was last recomputed
+     void *arena;               // values and the value vectors
+ };
+
  /* ========== Global Variables ========== */
  int n = 3;                          // Number of layers in the network
  int network_structure[] = {784, 128, 10};  // Number of neurons per layer
- Layer *Network = NULL;              // Head of the network linked list (global access point)
- 
- /* ========== Main Function ========== */
- 
- 
+ Layer *Network = NULL;              // Array of layers (global access point)
+
+ static NetworkModel *globalModel = NULL;      // Weights behind Network
+ static NetworkContext *globalContext = NULL;  // Values behind Network, scratch for the pool
+
+ static int precision = -1;          // Precision for the global network, -1 until chosen
+ static const char *precisionNames[] = { "fp64", "int8", "fp32", "fp16" };
+
+ static int requestedThreads = 0;    // Threads for feedForwardBatch, 0 = NN_THREADS or every core
+ static int requestedPinning = -1;   // Pin threads to cores, -1 = NN_PIN
+
+ /* ========== Memory Helpers ========== */
+
+ /**
+  * Round a byte count up to the next multiple of NN_ALIGN
+  */
+ static size_t alignUp(size_t bytes) {
+     return (bytes + NN_ALIGN - 1) & ~(size_t)(NN_ALIGN - 1);
+ }
+
+ /**
+  * Allocate a zeroed block aligned to NN_ALIGN bytes
+  *
+  * @param bytes Size of the block
+  * @return Pointer to the block, or NULL on failure
+  */
+ void *alignedAlloc(size_t bytes) {
+     void *p = NULL;
+ #ifdef _WIN32
+     p = _aligned_malloc(bytes, NN_ALIGN);
+ #else
+     if (posix_memalign(&p, NN_ALIGN, bytes) != 0) p = NULL;
+ #endif
+     if (p != NULL) memset(p, 0, bytes);
+     return p;
+ }
+
+ void alignedFree(void *p) {
+ #ifdef _WIN32
+     _aligned_free(p);
+ #else
+     free(p);
+ #endif
+ }
+
+ /* ========== Models ========== */
+
+ /**
+  * Allocate a model of the given structure
+  * The arena holds the Layer array first, then for each dense layer its
+  * weight matrix and bias vector (only if withParams is set).
+  *
+  * Hidden layers start with ReLU and the output layer linear.
+  *
+  * @param structure Array containing number of neurons in each layer
+  * @param layerCount Number of layers in the network
+  * @param withParams Non-zero to reserve weights and biases in the arena
+  * @return The model with one reference, or NULL on allocation failure
+  */
+ static NetworkModel *allocateModel(const int structure[], int layerCount, int withParams) {
+     // Work out the arena size
+     size_t total = alignUp(sizeof(NetworkModel)) + alignUp(sizeof(Layer) * layerCount);
+     total += alignUp(sizeof(int) * layerCount) + alignUp(sizeof(SparseLayer) * layerCount);
+     for(int i = 1; i < layerCount && withParams; i++) {
+         total += alignUp(sizeof(double) * structure[i-1]) * structure[i];  // Weights
+         total += alignUp(sizeof(double) * structure[i]);                   // Biases
+     }
+
+     unsigned char *p = alignedAlloc(total);
+     if (p == NULL) {
+         fprintf(stderr, "Memory allocation failed for network\n");
+         return NULL;
+     }
+
+     NetworkModel *m = (NetworkModel*) p;
+     p += alignUp(sizeof(NetworkModel));
+     m->arena = m;
+     m->layerCount = layerCount;
+     m->precision = NN_PRECISION_FP64;
+     m->layers = (Layer*) p;
+     p += alignUp(sizeof(Layer) * layerCount);
+     m->shapes = (int*) p;
+     p += alignUp(sizeof(int) * layerCount);
+     m->stored = (SparseLayer*) p;
+     p += alignUp(sizeof(SparseLayer) * layerCount);
+     atomic_init(&m->refs, 1);
+
+     // Carve each layer out of the arena
+     for(int i = 0; i < layerCount; i++) {
+         Layer *l = &m->layers[i];
+         l->size = structure[i];
+         l->inputs = (i > 0) ? structure[i-1] : 0;
+         l->stride = (int)(alignUp(sizeof(double) * l->inputs) / sizeof(double));
+         if (i > 0) l->activation = (i < layerCount - 1) ? NN_ACTIVATION_RELU : NN_ACTIVATION_LINEAR;
+         if (l->size > m->widest) m->widest = l->size;
+
+         if (i > 0 && withParams) {
+             l->weights = (double*) p;
+             p += sizeof(double) * (size_t)l->stride * l->size;
+             l->bias = (double*) p;
+             p += alignUp(sizeof(double) * l->size);
+         }
+     }
+     return m;
+ }
+
+ /**
+  * Column-major copy of layer 1's weights, one zero-padded column per input
+  *
+  * @return The copy, or NULL on allocation failure
+  */
+ static double *transposeFirstLayer(const NetworkModel *m, int *columnStride) {
+     const Layer *l = &m->layers[1];
+     int stride = (int)(alignUp(sizeof(double) * l->size) / sizeof(double));
+     double *columns = alignedAlloc(sizeof(double) * (size_t)stride * l->inputs);
+     if(columns == NULL) {
+         return NULL;
+     }
+     transposeMatrix(l->weights, (size_t)l->stride, columns, (size_t)stride, l->size, l->inputs);
+     *columnStride = stride;
+     return columns;
+ }
+
+ /**
+  * Pack every dense layer's weights for the GEMM chunks of forwardBatch
+  * Packing once here saves repacking the weights for every chunk.
+  *
+  * @return The packed copies (one allocation, freed with alignedFree), or NULL on failure
+  */
+ static double **packLayers(const NetworkModel *m, int *rows) {
+     size_t total = alignUp(sizeof(double*) * m->layerCount);
+     for(int h = 1; h < m->layerCount; h++) {
+         total += gemmPackedBytes(m->layers[h].size, m->layers[h].inputs);
+     }
+     double **packed = alignedAlloc(total);
+     if(packed == NULL) {
+         return NULL;
+     }
+     unsigned char *p = (unsigned char*)packed + alignUp(sizeof(double*) * m->layerCount);
+     packed[0] = NULL;
+     for(int h = 1; h < m->layerCount; h++) {
+         const Layer *l = &m->layers[h];
+         packed[h] = (double*) p;
+         *rows = packGemmA(l->weights, l->stride, l->size, l->inputs, packed[h]);
+         p += gemmPackedBytes(l->size, l->inputs);
+     }
+     return packed;
+ }
+
+ /**
+  * Build the copies of the weights a precision runs on
+  * Reduced precisions get their converted weights; fp64 gets the column-major
+  * first layer used for sparse inputs (straight from a column-layout model
+  * file when it has one), CSR copies of the layers pruned to at most
+  * NN_CSR_DENSITY nonzeros (straight from the file when it stores them so)
+  * and, without any, the GEMM-packed layers for batches, and runs without
+  * them if they cannot be allocated. Layers whose shape has compiled kernels (see findShape) are
+  * marked to use them. Falls back to fp64 when a reduced copy cannot be allocated.
+  *
+  * @param m Model, not in use by any forward pass
+  * @param p NN_PRECISION_* value
+  * @return 0 on success, 1 on failure
+  */
+ static int buildPrecisionCopy(NetworkModel *m, int p) {
+     freeQuantNetwork(m->quantized);
+     freeFloatNetwork(m->floatCopy);
+     if(m->columns != NULL && m->columns != m->fileColumns) alignedFree(m->columns);
+     if(m->packed != NULL) alignedFree(m->packed);
+     freeSparseNetwork(m->sparse);
+     m->quantized = NULL;
+     m->floatCopy = NULL;
+     m->columns = NULL;
+     m->packed = NULL;
+     m->sparse = NULL;
+     m->precision = p;
+
+     if(p == NN_PRECISION_INT8) {
+         m->quantized = quantizeLayers(m->layers, m->layerCount);
+     } else if(p == NN_PRECISION_FP32 || p == NN_PRECISION_FP16) {
+         m->floatCopy = convertLayers(m->layers, m->layerCount, p == NN_PRECISION_FP16);
+     }
+
+     int status = 0;
+     if(p != NN_PRECISION_FP64 && m->quantized == NULL && m->floatCopy == NULL) {
+         m->precision = NN_PRECISION_FP64;
+         status = 1;
+     }
+     if(m->precision == NN_PRECISION_FP64 && m->fileColumns != NULL) {
+         m->columns = (double*) m->fileColumns;
+         m->columnStride = m->fileColumnStride;
+     } else if(m->precision == NN_PRECISION_FP64) {
+         m->columns = transposeFirstLayer(m, &m->columnStride);
+     }
+     if(m->precision == NN_PRECISION_FP64) {
+         m->sparse = sparsifyLayers(m->layers, m->stored, m->layerCount, NN_CSR_DENSITY);
+         if(m->sparse != NULL && m->sparse->sparseLayers == 0) {
+             freeSparseNetwork(m->sparse);
+             m->sparse = NULL;
+         }
+     }
+     if(m->precision == NN_PRECISION_FP64 && m->sparse == NULL) {
+         m->packed = packLayers(m, &m->packedRows);
+     }
+     for(int h = 0; h < m->layerCount; h++) {
+         m->shapes[h] = h > 0 ? findShape(m->layers[h].inputs, m->layers[h].size, m->layers[h].stride) : -1;
+     }
+     return status;
+ }
+
+ /**
+  * Create a model from layers in memory
+  * The weights and biases are copied, so the source can be changed or freed
+  * afterwards.
+  *
+  * @param layers Source layers, input layer first (value is ignored, activation 0 means the default)
+  * @param layerCount Number of layers
+  * @param p NN_PRECISION_* the model runs at
+  * @return The model with one reference, or NULL on failure
+  */
+ NetworkModel *createNetworkModel(const Layer *layers, int layerCount, int p) {
+     if(layerCount < 2 || precisionName(p) == NULL) {
+         printf("Error: Invalid network (%d layers, precision %d)\n", layerCount, p);
+         return NULL;
+     }
+     int *structure = malloc(sizeof(int) * layerCount);
+     if(structure == NULL) {
+         fprintf(stderr, "Memory allocation failed for network\n");
+         return NULL;
+     }
+     for(int i = 0; i < layerCount; i++) {
+         structure[i] = layers[i].size;
+     }
+     NetworkModel *m = allocateModel(structure, layerCount, 1);
+     free(structure);
+     if(m == NULL) {
+         return NULL;
+     }
+
+     for(int i = 1; i < layerCount; i++) {
+         Layer *l = &m->layers[i];
+         for(int j = 0; j < l->size; j++) {
+             memcpy(l->weights + (size_t)j * l->stride, layers[i].weights + (size_t)j * layers[i].stride,
+                    sizeof(double) * l->inputs);
+         }
+         memcpy(l->bias, layers[i].bias, sizeof(double) * l->size);
+         if(layers[i].activation != 0) l->activation = layers[i].activation;
+     }
+
+     if(buildPrecisionCopy(m, p) != 0) {
+         releaseNetworkModel(m);
+         return NULL;
+     }
+     return m;
+ }
+
+ /**
+  * Open a binary model file (see model.h) as a model
+  * The file is mapped read-only and its weights and biases are used in
+  * place; every process mapping the same file shares the pages. Weights
+  * stored in the column layout are packed into the rows the dense kernels
+  * read, and the first layer's columns are kept for sparse inputs as they are.
+  * CSR layers run on their arrays in the mapping and are expanded into
+  * rows for everything else (other precisions, training, export).
+  *
+  * @param path Model file
+  * @param p NN_PRECISION_* the model runs at
+  * @return The model with one reference, or NULL on failure
+  */
+ NetworkModel *openNetworkModel(const char *path, int p) {
+     if(precisionName(p) == NULL) {
+         printf("Error: Unknown precision %d\n", p);
+         return NULL;
+     }
+
+     ModelFile file;
+     if (mapModelFile(path, &file, 1) != 0) {
+         return NULL;
+     }
+
+     int count = (int)file.header->layerCount;
+     int *structure = malloc(sizeof(int) * count);
+     if (structure == NULL) {
+         fprintf(stderr, "Memory allocation failed for network\n");
+         unmapModelFile(&file);
+         return NULL;
+     }
+     for(int i = 0; i < count; i++) {
+         structure[i] = (int)file.layers[i].size;
+     }
+     int columns = (file.header->layout == NN_LAYOUT_COLUMNS);
+     int csr = 0;
+     for(int i = 1; i < count && file.sparse != NULL; i++) {
+         csr |= (file.sparse[i].format == NN_FORMAT_CSR);
+     }
+     NetworkModel *m = allocateModel(structure, count, columns || csr);
+     free(structure);
+     if (m == NULL) {
+         unmapModelFile(&file);
+         return NULL;
+     }
+
+     // Point every layer at its blobs inside the mapping, or unpack them into rows
+     for(int i = 1; i < count; i++) {
+         const ModelLayerEntry *e = &file.layers[i];
+         Layer *l = &m->layers[i];
+         const double *weights = (const double*)(file.map.base + e->weightsOffset);
+         if(file.sparse != NULL && file.sparse[i].format == NN_FORMAT_CSR) {
+             SparseLayer *s = &m->stored[i];
+             s->size = l->size;
+             s->inputs = l->inputs;
+             s->nonzeros = file.sparse[i].nonzeros;
+             s->rowStart = (const uint32_t*)(file.map.base + file.sparse[i].rowStartOffset);
+             s->index = (const uint32_t*)(file.map.base + file.sparse[i].indexOffset);
+             s->values = weights;
+             expandSparseLayer(s, l->weights, l->stride);
+         } else if(columns) {
+             transposeMatrix(weights, e->stride, l->weights, (size_t)l->stride, l->inputs, l->size);
+         } else if(csr) {
+             for(int j = 0; j < l->size; j++) {
+                 memcpy(l->weights + (size_t)j * l->stride, weights + (size_t)j * e->stride,
+                        sizeof(double) * l->inputs);
+             }
+         } else {
+             l->stride = (int)e->stride;
+             l->weights = (double*) weights;
+         }
+         l->bias = (double*)(file.map.base + e->biasOffset);
+         if(e->activation != 0) l->activation = (int)e->activation;
+     }
+     const ModelLayerEntry *first = &file.layers[1];
+     if(columns && m->stored[1].rowStart == NULL &&
+        first->stride == alignUp(sizeof(double) * first->size) / sizeof(double)) {
+         m->fileColumns = (const double*)(file.map.base + first->weightsOffset);
+         m->fileColumnStride = (int)first->stride;
+     }
+     m->file = file;
+
+     if(buildPrecisionCopy(m, p) != 0) {
+         releaseNetworkModel(m);
+         return NULL;
+     }
+     return m;
+ }
+
+ /**
+  * Take another reference to a model
+  *
+  * @return m, for convenience
+  */
+ NetworkModel *retainNetworkModel(NetworkModel *m) {
+     atomic_fetch_add_explicit(&m->refs, 1, memory_order_relaxed);
+     return m;
+ }
+
+ /**
+  * Drop a reference to a model, freeing it with the last one
+  * Safe to call with NULL
+  */
+ void releaseNetworkModel(NetworkModel *m) {
+     if(m == NULL || atomic_fetch_sub_explicit(&m->refs, 1, memory_order_acq_rel) != 1) {
+         return;
+     }
+     freeQuantNetwork(m->quantized);
+     freeFloatNetwork(m->floatCopy);
+     if(m->columns != NULL && m->columns != m->fileColumns) alignedFree(m->columns);
+     if(m->packed != NULL) alignedFree(m->packed);
+     freeSparseNetwork(m->sparse);
+     unmapModelFile(&m->file);
+     alignedFree(m->arena);
+ }
+
+ /**
+  * Number of layers of a model, including the input layer
+  */
+ int networkModelLayers(const NetworkModel *m) {
+     return m->layerCount;
+ }
+
+ /**
+  * Number of neurons in one layer of a model
+  */
+ int networkModelLayerSize(const NetworkModel *m, int layer) {
+     return m->layers[layer].size;
+ }
+
+ /**
+  * Bytes of weights and biases a forward pass of the model reads
+  */
+ size_t networkModelWeightBytes(const NetworkModel *m) {
+     if(m->floatCopy != NULL) {
+         return m->floatCopy->weightBytes;   // Float biases live in the copy too
+     }
+
+     size_t bytes = 0;
+     for(int h = 1; h < m->layerCount; h++) {
+         bytes += sizeof(double) * m->layers[h].size;   // Biases are always double
+         if(m->sparse != NULL && m->sparse->layers[h].rowStart != NULL) {
+             bytes += sparseLayerBytes(m->layers[h].size, m->sparse->layers[h].nonzeros);
+         } else if(m->quantized == NULL) {
+             bytes += sizeof(double) * (size_t)m->layers[h].size * m->layers[h].stride;
+         }
+     }
+     if(m->quantized != NULL) {
+         bytes += m->quantized->weightBytes;
+     }
+     return bytes;
+ }
+
+ /* ========== Contexts ========== */
+
+ /**
+  * Create an inference context for a model
+  * A context holds the activations and scratch of one forward pass at a
+  * time; give every thread its own. Contexts keep their model alive.
+  *
+  * @param m Model to run
+  * @return The context, or NULL on allocation failure
+  */
+ NetworkContext *createNetworkContext(NetworkModel *m) {
+     size_t total = alignUp(sizeof(NetworkContext)) + alignUp(sizeof(double*) * m->layerCount);
+     total += alignUp(sizeof(int) * m->layers[0].size);
+     for(int i = 0; i < m->layerCount; i++) {
+         total += alignUp(sizeof(double) * m->layers[i].size);
+     }
+
+     unsigned char *p = alignedAlloc(total);
+     if(p == NULL) {
+         fprintf(stderr, "Memory allocation failed for network context\n");
+         return NULL;
+     }
+
+     NetworkContext *c = (NetworkContext*) p;
+     p += alignUp(sizeof(NetworkContext));
+     c->arena = c;
+     c->model = retainNetworkModel(m);
+     c->values = (double**) p;
+     p += alignUp(sizeof(double*) * m->layerCount);
+     c->nonzero = (int*) p;
+     p += alignUp(sizeof(int) * m->layers[0].size);
+     for(int i = 0; i < m->layerCount; i++) {
+         c->values[i] = (double*) p;
+         p += alignUp(sizeof(double) * m->layers[i].size);
+     }
+     return c;
+ }
+
+ /**
+  * Free a context and drop its model reference
+  * Safe to call with NULL
+  */
+ void freeNetworkContext(NetworkContext *c) {
+     if(c == NULL) return;
+     if(c->scratch != NULL) alignedFree(c->scratch);
+     if(c->averaged != NULL) alignedFree(c->averaged);
+     if(c->lastInput != NULL) alignedFree(c->lastInput);
+     releaseNetworkModel(c->model);
+     alignedFree(c->arena);
+ }
+
+ /**
+  * Make sure a context has a scratch block per worker for its model
+  * A block holds two ping-pong activation tiles (double, or float for the
+  * single precision paths) of samples columns, followed by the INT8 scratch
+  * when quantized or the GEMM workspace for chunks larger than a tile.
+  *
+  * @param c Context
+  * @param workers Number of blocks needed
+  * @param samples Columns per tile: NN_BATCH_TILE, or a GEMM chunk
+  * @return 0 on success, 1 on allocation failure
+  */
+ static int reserveScratch(NetworkContext *c, int workers, int samples) {
+     const NetworkModel *m = c->model;
+     size_t tile = alignUp(sizeof(double) * samples * m->widest);
+     size_t extra = 0;
+     if(m->quantized != NULL) extra = m->quantized->scratchBytes;
+     else if(samples > NN_BATCH_TILE) extra = gemmWorkspaceBytes(m->widest, samples, m->widest);
+     size_t oldExtra = c->scratchBlock - 2 * c->scratchTileBytes;
+     if(tile <= c->scratchTileBytes && extra <= oldExtra && workers <= c->scratchWorkers) return 0;
+
+     if(c->scratch != NULL) alignedFree(c->scratch);
+     if(tile < c->scratchTileBytes) tile = c->scratchTileBytes;
+     if(extra < oldExtra) extra = oldExtra;
+     if(workers < c->scratchWorkers) workers = c->scratchWorkers;
+     c->scratch = alignedAlloc((2 * tile + extra) * workers);
+     if(c->scratch == NULL) {
+         fprintf(stderr, "Memory allocation failed for forward pass scratch\n");
+         c->scratchBlock = 0;
+         c->scratchTileBytes = 0;
+         c->scratchWorkers = 0;
+         return 1;
+     }
+     c->scratchBlock = 2 * tile + extra;
+     c->scratchTileBytes = tile;
+     c->scratchWorkers = workers;
+     return 0;
+ }
+
+ /**
+  * Scratch tile i (0 or 1) of a worker's block
+  */
+ static void *scratchTile(const NetworkContext *c, int worker, int i) {
+     return c->scratch + (size_t)worker * c->scratchBlock + (size_t)i * c->scratchTileBytes;
+ }
+
+ /**
+  * INT8 scratch or GEMM workspace of a worker's block, after its tiles
+  */
+ static void *scratchQuant(const NetworkContext *c, int worker) {
+     return c->scratch + (size_t)worker * c->scratchBlock + 2 * c->scratchTileBytes;
+ }
+
+ /* ========== Forward Pass ========== */
+
+ /**
+  * Whether a layer's activation is the ReLU the dense kernels can fuse
+  */
+ static inline int fusedRelu(const Layer *l) {
+     return l->activation == NN_ACTIVATION_RELU;
+ }
+
+ /**
+  * Apply the activations the kernels do not fuse to count outputs of a layer
+  */
+ static void finishActivation(const Layer *l, double *y, size_t count) {
+     if(l->activation > NN_ACTIVATION_LINEAR) {
+         applyActivation(l->activation, y, count);
+     }
+ }
+
+ static void finishActivationFloat(const Layer *l, float *y, size_t count) {
+     for(size_t i = 0; i < count && l->activation > NN_ACTIVATION_LINEAR; i++) {
+         y[i] = (l->activation == NN_ACTIVATION_SIGMOID) ? 1.0f / (1.0f + expf(-y[i])) : tanhf(y[i]);
+     }
+ }
+
+ /**
+  * CSR copy of layer h, or NULL when it runs dense
+  */
+ static inline const SparseLayer *sparseLayer(const NetworkModel *m, int h) {
+     return (m->sparse != NULL && m->sparse->layers[h].rowStart != NULL) ? &m->sparse->layers[h] : NULL;
+ }
+
+ /**
+  * Multiply-adds of one sample through layer h: its stored weights when CSR
+  */
+ static uint64_t layerMacs(const NetworkModel *m, int h) {
+     const SparseLayer *s = sparseLayer(m, h);
+     return s != NULL ? s->nonzeros : (uint64_t)m->layers[h].size * m->layers[h].inputs;
+ }
+
+ #if NN_PROFILE
+ /**
+  * Multiply-adds of layer h times two, for the profile
+  */
+ static uint64_t layerFlops(const NetworkModel *m, int h, int samples) {
+     return 2 * layerMacs(m, h) * samples;
+ }
+
+ /**
+  * Bytes of weights and activations a pass over layer h moves at the
+  * model's precision, for the profile
+  */
+ static uint64_t layerBytes(const NetworkModel *m, int h, int samples) {
+     static const int weightBytes[] = { 8, 1, 4, 2 };   // By NN_PRECISION_*
+     const Layer *l = &m->layers[h];
+     int valueBytes = (m->floatCopy != NULL) ? 4 : 8;
+     uint64_t weights = sparseLayer(m, h) != NULL ? sparseLayerBytes(l->size, sparseLayer(m, h)->nonzeros) :
+                        (uint64_t)l->size * l->inputs * weightBytes[m->precision];
+     return weights + (uint64_t)(l->inputs + l->size) * valueBytes * samples;
+ }
+
+ /**
+  * layerFlops or layerBytes summed over layers [from, layerCount)
+  */
+ static uint64_t networkWork(const NetworkModel *m, int from, int samples, int bytes) {
+     uint64_t total = 0;
+     for(int h = from; h < m->layerCount; h++) {
+         total += bytes ? layerBytes(m, h, samples) : layerFlops(m, h, samples);
+     }
+     return total;
+ }
+ #endif
+
+ // One layer, or part of it, for runLayerRange
+ typedef struct LayerJob {
+     const NetworkModel *model;
+     int layer;
+     const void *x;    // double or float activations (float when the model has a floatCopy)
+     void *y;
+     int tile;         // Non-zero for a feature-major tile of NN_BATCH_TILE samples
+ } LayerJob;
+
+ /**
+  * Pool task: neuron blocks [begin, end) of a layer
+  * Every neuron is computed exactly as in a whole-layer call, so the result
+  * does not depend on how the layer was split.
+  */
+ static void runLayerRange(void *arg, int begin, int end, int worker) {
+     const LayerJob *job = arg;
+     const NetworkModel *m = job->model;
+     const Layer *l = &m->layers[job->layer];
+     const int rows = job->tile ? NN_BATCH_TILE : 1;
+     int first = begin * NN_NEURON_BLOCK;
+     int last = end * NN_NEURON_BLOCK < l->size ? end * NN_NEURON_BLOCK : l->size;
+     (void) worker;
+
+     if(m->floatCopy != NULL) {
+         float *y = (float*)job->y + (size_t)first * rows;
+         floatDense(m->floatCopy, job->layer, first, last, job->x, y, job->tile, fusedRelu(l));
+         finishActivationFloat(l, y, (size_t)(last - first) * rows);
+         return;
+     }
+
+     // Pruned layers read only their stored weights
+     const SparseLayer *s = sparseLayer(m, job->layer);
+     if(s != NULL) {
+         double *y = (double*)job->y + (size_t)first * rows;
+         (job->tile ? nnKernels->denseCsrTile : nnKernels->denseCsr)(s->rowStart + first, s->index, s->values,
+                                                                     l->bias + first, job->x, last - first, y,
+                                                                     fusedRelu(l));
+         finishActivation(l, y, (size_t)(last - first) * rows);
+         return;
+     }
+
+     // Compiled for this exact shape when there is a kernel for it and the layer runs whole
+     const ShapeKernels *shape = NULL;
+     if(m->shapes[job->layer] >= 0 && first == 0 && last == l->size) {
+         shape = &nnKernels->shapes[m->shapes[job->layer]];
+     }
+
+     const double *w = l->weights + (size_t)first * l->stride;
+     double *y = (double*)job->y + (size_t)first * rows;
+     if(job->tile) {
+         (shape ? shape->denseTile : nnKernels->denseTile)(w, l->stride, l->bias + first, job->x, l->inputs,
+                                                           last - first, y, fusedRelu(l));
+     } else {
+         (shape ? shape->dense : nnKernels->dense)(w, l->stride, l->bias + first, job->x, l->inputs,
+                                                   last - first, y, fusedRelu(l));
+     }
+     finishActivation(l, y, (size_t)(last - first) * rows);
+ }
+
+ /**
+  * Run one fp64 or single precision layer, split by output-neuron blocks
+  * across the thread pool when split is set and the layer is big enough
+  */
+ static void runLayer(const NetworkModel *m, int h, const void *x, void *y, int tile, int split) {
+     LayerJob job = { m, h, x, y, tile };
+     int blocks = (m->layers[h].size + NN_NEURON_BLOCK - 1) / NN_NEURON_BLOCK;
+     double macs = (double)layerMacs(m, h) * (tile ? NN_BATCH_TILE : 1);
+
+     PROFILE_BEGIN(mark);
+     if(split && poolThreads() > 1 && macs >= NN_PARALLEL_MACS) {
+         poolParallelFor(blocks, 1, runLayerRange, &job);
+     } else {
+         runLayerRange(&job, 0, blocks, 0);
+     }
+     PROFILE_END(mark, NN_PROFILE_LAYER(h), layerFlops(m, h, tile ? NN_BATCH_TILE : 1),
+                 layerBytes(m, h, tile ? NN_BATCH_TILE : 1));
+ }
+
+ /**
+  * Run layer 1 on the nonzero inputs only, if there are few enough of them
+  * Drawn digits are mostly background, so the nonzero pixels are counted on
+  * every pass and the weight columns of those pixels alone are added up
+  * when they make up at most NN_SPARSE_DENSITY of the input.
+  *
+  * @return 1 if the layer was computed, 0 if the input is too dense
+  */
+ static int firstLayerSparse(NetworkContext *c) {
+     const NetworkModel *m = c->model;
+     const Layer *l = &m->layers[1];
+     const double *x = c->values[0];
+     int count = 0;
+     for(int k = 0; k < l->inputs; k++) {
+         c->nonzero[count] = k;
+         count += (x[k] != 0.0);
+     }
+     if(count > l->inputs * NN_SPARSE_DENSITY) {
+         return 0;
+     }
+     PROFILE_BEGIN(mark);
+     nnKernels->denseSparse(m->columns, m->columnStride, l->bias, x, c->nonzero, count, l->size, c->values[1],
+                            fusedRelu(l));
+     finishActivation(l, c->values[1], l->size);
+     PROFILE_END(mark, NN_PROFILE_LAYER(1), 2 * (uint64_t)count * l->size,
+                 sizeof(double) * ((uint64_t)count * l->size + l->inputs + l->size));
+     return 1;
+ }
+
+ /**
+  * Run layer 1 of a tile holding at most NN_SPARSE_TILE samples
+  * Like firstLayerSparse for all of them at once, e.g. the augmented copies
+  * of one drawing: an input counts when any sample uses it, and its weight
+  * column is read once for all. Only the samples present are computed, so
+  * this beats the dense tile kernel even when every input counts.
+  */
+ static void firstLayerSparseTile(const NetworkContext *c, const double *x, double *y) {
+     const NetworkModel *m = c->model;
+     const Layer *l = &m->layers[1];
+     int count = 0;
+     for(int k = 0; k < l->inputs; k++) {
+         const double *row = x + (size_t)k * NN_BATCH_TILE;
+         int used = 0;
+         for(int b = 0; b < NN_SPARSE_TILE; b++) used |= (row[b] != 0.0);
+         c->nonzero[count] = k;
+         count += used;
+     }
+     PROFILE_BEGIN(mark);
+     nnKernels->denseSparseTile(m->columns, m->columnStride, l->bias, x, c->nonzero, count, l->size, y,
+                                fusedRelu(l));
+     finishActivation(l, y, (size_t)l->size * NN_BATCH_TILE);
+     PROFILE_END(mark, NN_PROFILE_LAYER(1), 2 * (uint64_t)count * l->size * NN_SPARSE_TILE,
+                 sizeof(double) * ((uint64_t)count * l->size + (uint64_t)(l->inputs + l->size) * NN_BATCH_TILE));
+ }
+
+ /**
+  * Single-sample forward pass into the context's values
+  *
+  * @param split Non-zero to split big layers across the thread pool
+  * @return 0 on success, 1 on allocation failure
+  */
+ static int forward(NetworkContext *c, const double *input, int split) {
+     const NetworkModel *m = c->model;
+     if(reserveScratch(c, 1, NN_BATCH_TILE) != 0) {
+         return 1;
+     }
+     if(c->values[0] != input) {
+         memcpy(c->values[0], input, sizeof(double) * m->layers[0].size);
+     }
+
+     // Process each hidden and output layer with its activation
+     PROFILE_BEGIN(pass);
+     if(m->quantized != NULL) {
+         for(int h = 1; h < m->layerCount; h++) {
+             PROFILE_BEGIN(mark);
+             quantDense(m->quantized, scratchQuant(c, 0), h, c->values[h-1], 0, 1, c->values[h], 0,
+                        fusedRelu(&m->layers[h]));
+             finishActivation(&m->layers[h], c->values[h], m->layers[h].size);
+             PROFILE_END(mark, NN_PROFILE_LAYER(h), layerFlops(m, h, 1), layerBytes(m, h, 1));
+         }
+     } else if(m->floatCopy != NULL) {
+         // Float ping-pong, widened into each layer's values
+         float *x = scratchTile(c, 0, 0);
+         for(int k = 0; k < m->layers[0].size; k++) {
+             x[k] = (float) input[k];
+         }
+         for(int h = 1; h < m->layerCount; h++) {
+             float *y = scratchTile(c, 0, h & 1);
+             runLayer(m, h, x, y, 0, split);
+             for(int o = 0; o < m->layers[h].size; o++) {
+                 c->values[h][o] = y[o];
+             }
+             x = y;
+         }
+     } else {
+         for(int h = 1; h < m->layerCount; h++) {
+             if(h == 1 && m->columns != NULL && firstLayerSparse(c)) continue;
+             runLayer(m, h, c->values[h-1], c->values[h], 0, split);
+         }
+     }
+     PROFILE_END(pass, NN_STAGE_FORWARD, networkWork(m, 1, 1, 0), networkWork(m, 1, 1, 1));
+     return 0;
+ }
+
+ // Arguments shared by every tile of a batch
+ typedef struct BatchJob {
+     NetworkContext *context;
+     const double *inputs;
+     double *outputs;
+     int count;
+     int split;        // Split layers by neurons (only when tiles run one at a time)
+     int chunk;        // Samples per GEMM chunk, 0 to run NN_BATCH_TILE tiles
+     atomic_int failed;
+ } BatchJob;
+
+ /**
+  * Run one tile of up to NN_BATCH_TILE samples through the network
+  */
+ static void runTile(const BatchJob *job, int t, int worker) {
+     const NetworkContext *c = job->context;
+     const NetworkModel *m = c->model;
+     const int T = NN_BATCH_TILE;
+     const int last = m->layerCount - 1;
+     const int inSize = m->layers[0].size;
+     const int outSize = m->layers[last].size;
+     const int start = t * T;
+     const int tile = (job->count - start < T) ? job->count - start : T;
+     const double *in = job->inputs + (size_t)start * inSize;
+     double *out = job->outputs + (size_t)start * outSize;
+
+     // INT8 tiles stay sample-major: each sample's activations are quantized separately
+     if(m->quantized != NULL) {
+         const double *x = in;
+         int xStride = inSize;
+         for(int h = 1; h < m->layerCount; h++) {
+             const Layer *l = &m->layers[h];
+             double *y = (h == last) ? out : scratchTile(c, worker, h & 1);
+             PROFILE_BEGIN(mark);
+             quantDense(m->quantized, scratchQuant(c, worker), h, x, xStride, tile, y, l->size, fusedRelu(l));
+             finishActivation(l, y, (size_t)tile * l->size);
+             PROFILE_END(mark, NN_PROFILE_LAYER(h), layerFlops(m, h, tile), layerBytes(m, h, tile));
+             x = y;
+             xStride = l->size;
+         }
+         return;
+     }
+
+     // Transpose the tile's inputs to feature-major, zero-padding a short tile; a
+     // batch of a few samples runs layer 1 on them alone, which reads no padding
+     const int single = m->floatCopy != NULL;
+     const int few = m->columns != NULL && job->count <= NN_SPARSE_TILE;
+     const int width = few ? NN_SPARSE_TILE : T;
+     void *x = scratchTile(c, worker, 0);
+     for(int k = 0; k < inSize; k++) {
+         for(int b = 0; b < width; b++) {
+             double v = b < tile ? in[(size_t)b * inSize + k] : 0.0;
+             if(single) ((float*)x)[(size_t)k * T + b] = (float) v;
+             else ((double*)x)[(size_t)k * T + b] = v;
+         }
+     }
+
+     // Run every layer over the tile
+     for(int h = 1; h < m->layerCount; h++) {
+         void *y = scratchTile(c, worker, h & 1);
+         if(h == 1 && few) firstLayerSparseTile(c, x, y);
+         else runLayer(m, h, x, y, 1, job->split);
+         x = y;
+     }
+
+     // Transpose the output layer back to one row per sample
+     for(int b = 0; b < tile; b++) {
+         double *row = out + (size_t)b * outSize;
+         for(int o = 0; o < outSize; o++) {
+             row[o] = single ? ((float*)x)[(size_t)o * T + b] : ((double*)x)[(size_t)o * T + b];
+         }
+     }
+ }
+
+ // One layer's GEMM over a chunk, split into ranges of output rows
+ typedef struct ChunkGemm {
+     BatchJob *job;
+     const double *packed;      // Layer's packed weights
+     const Layer *layer;
+     const double *x;           // Layer input: sample-major for layer 1, feature-major after
+     int ldx;
+     int transposed;            // x is sample-major
+     double *y;                 // Feature-major output, samples columns wide
+     int samples;
+     int span;                  // Rows per range, whole panels of the packed weights
+ } ChunkGemm;
+
+ /**
+  * Pool task: ranges [begin, end) of a layer's output rows
+  * Every range starts on a panel boundary, so each output is computed by the
+  * same microkernel block, over the same kc slices, however the rows are split.
+  */
+ static void runChunkRows(void *arg, int begin, int end, int worker) {
+     ChunkGemm *g = arg;
+     const NetworkContext *c = g->job->context;
+     size_t workspaceBytes = c->scratchBlock - 2 * c->scratchTileBytes;
+     for(int r = begin; r < end; r++) {
+         int first = r * g->span;
+         int count = g->layer->size - first < g->span ? g->layer->size - first : g->span;
+         if(count <= 0) continue;
+         if(gemmPackedA(g->packed + (size_t)first * g->layer->inputs, count, g->samples, g->layer->inputs,
+                        g->transposed, g->x, g->ldx, g->y + (size_t)first * g->samples, g->samples, 1,
+                        scratchQuant(c, worker), workspaceBytes) != 0) {
+             atomic_store(&g->job->failed, 1);
+         }
+     }
+ }
+
+ /**
+  * Run chunk t of an fp64 batch through the network with one GEMM per layer
+  * Activations are feature-major, chunk columns wide: layer h computes
+  * bias + W * x into a tile from the packed weights, reading layer 1's
+  * inputs sample-major through a transposed operand, and the output layer
+  * is transposed back. When chunks run one at a time (job->split), each big
+  * layer's GEMM is split across the pool by ranges of whole row panels.
+  */
+ static void runChunk(BatchJob *job, int t, int worker) {
+     const NetworkContext *c = job->context;
+     const NetworkModel *m = c->model;
+     const int last = m->layerCount - 1;
+     const int inSize = m->layers[0].size;
+     const int outSize = m->layers[last].size;
+     const int start = t * job->chunk;
+     const int rows = (job->count - start < job->chunk) ? job->count - start : job->chunk;
+     const int threads = poolThreads();
+
+     const double *x = job->inputs + (size_t)start * inSize;
+     for(int h = 1; h <= last; h++) {
+         const Layer *l = &m->layers[h];
+         double *y = scratchTile(c, worker, h & 1);
+         PROFILE_BEGIN(mark);
+         for(int o = 0; o < l->size; o++) {
+             double *row = y + (size_t)o * rows;
+             for(int b = 0; b < rows; b++) row[b] = l->bias[o];
+         }
+         ChunkGemm gemmJob = { job, m->packed[h], l, x, h == 1 ? inSize : rows, h == 1, y, rows, l->size };
+         if(job->split && threads > 1 && l->size > m->packedRows &&
+            (double)layerMacs(m, h) * rows >= NN_PARALLEL_MACS) {
+             int share = (l->size + threads - 1) / threads;
+             gemmJob.span = (share + m->packedRows - 1) / m->packedRows * m->packedRows;
+             poolParallelFor((l->size + gemmJob.span - 1) / gemmJob.span, 1, runChunkRows, &gemmJob);
+         } else {
+             runChunkRows(&gemmJob, 0, 1, worker);
+         }
+         if(atomic_load(&job->failed)) {
+             return;
+         }
+         if(fusedRelu(l)) nnKernels->relu(y, l->size * rows);
+         finishActivation(l, y, (size_t)l->size * rows);
+         PROFILE_END(mark, NN_PROFILE_LAYER(h), layerFlops(m, h, rows), layerBytes(m, h, rows));
+         x = y;
+     }
+     transposeMatrix(x, rows, job->outputs + (size_t)start * outSize, outSize, outSize, rows);
+ }
+
+ /**
+  * Pool task: tiles or chunks [begin, end) of a batch
+  */
+ static void runTiles(void *arg, int begin, int end, int worker) {
+     BatchJob *job = arg;
+     for(int t = begin; t < end; t++) {
+         if(job->chunk > 0) runChunk(job, t, worker);
+         else runTile(job, t, worker);
+     }
+ }
+
+ /**
+  * Batched forward pass
+  *
+  * @param usePool Non-zero to spread the batch over the thread pool
+  * @return 0 on success, 1 on allocation failure
+  */
+ static int forwardBatch(NetworkContext *c, const double *inputs, int count, double *outputs,
+                         int probabilities, int usePool) {
+     const NetworkModel *m = c->model;
+     int workers = usePool ? poolThreads() : 1;
+     BatchJob job = { c, inputs, outputs, count, 0, 0, 0 };
+
+     // fp64 batches of at least half a chunk run in GEMM chunks of NN_GEMM_BATCH samples,
+     // the last one taking what is left. The path and the chunks depend on count alone,
+     // never on the thread count, so every sample is summed in the same order either way.
+     int tiles = (count + NN_BATCH_TILE - 1) / NN_BATCH_TILE;
+     if(m->packed != NULL && m->packedRows == nnKernels->gemmRows && count >= NN_GEMM_BATCH / 2) {
+         job.chunk = NN_GEMM_BATCH;
+         tiles = (count + NN_GEMM_BATCH - 1) / NN_GEMM_BATCH;
+     }
+     if(reserveScratch(c, workers, job.chunk > 0 ? job.chunk : NN_BATCH_TILE) != 0) {
+         return 1;
+     }
+
+     // With fewer tiles or chunks than threads they run one at a time, each layer split across the pool
+     PROFILE_BEGIN(mark);
+     if(workers > 1 && tiles >= workers) {
+         poolParallelFor(tiles, 1, runTiles, &job);
+     } else {
+         job.split = workers > 1;
+         runTiles(&job, 0, tiles, 0);
+     }
+     if(atomic_load(&job.failed)) {
+         return 1;
+     }
+
+     if(probabilities) {
+         const int outSize = m->layers[m->layerCount - 1].size;
+         for(int b = 0; b < count; b++) {
+             double *row = outputs + (size_t)b * outSize;
+             softmax(row, row, outSize);
+         }
+     }
+     PROFILE_END(mark, NN_STAGE_BATCH, networkWork(m, 1, count, 0), networkWork(m, 1, count, 1));
+     return 0;
+ }
+
+ /**
+  * Forward pass of one sample on a context
+  * Touches only the context and the model's immutable weights, so threads
+  * with their own contexts can run concurrently without locks.
+  *
+  * @param c Context
+  * @param input Input values (size of the model's input layer)
+  * @return The output layer's raw values inside the context, or NULL on failure
+  */
+ const double *contextForward(NetworkContext *c, const double *input) {
+     if(forward(c, input, 0) != 0) {
+         return NULL;
+     }
+     return c->values[c->model->layerCount - 1];
+ }
+
+ /**
+  * Forward pass of many samples on a context, on the calling thread
+  * Same tiling as feedForwardBatch, without the thread pool.
+  *
+  * @param c Context
+  * @param inputs count rows of input values, back to back
+  * @param count Number of samples
+  * @param outputs Caller-owned buffer for count rows of output-layer values
+  * @param probabilities Non-zero to write softmax probabilities, zero for raw logits
+  * @return 0 on success, 1 on failure
+  */
+ int contextForwardBatch(NetworkContext *c, const double *inputs, int count, double *outputs, int probabilities) {
+     return forwardBatch(c, inputs, count, outputs, probabilities, 0);
+ }
+
+ /**
+  * Batched forward pass of several variants of one input, averaging their logits
+  * The mean goes into the context's output-layer values; the other layers'
+  * values are left as they were.
+  *
+  * @param usePool Non-zero to spread the batch over the thread pool
+  * @return 0 on success, 1 on failure
+  */
+ static int forwardAveraged(NetworkContext *c, const double *inputs, int count, int usePool) {
+     const NetworkModel *m = c->model;
+     const int outSize = m->layers[m->layerCount - 1].size;
+     if(count < 1) {
+         return 1;
+     }
+     if(count > c->averagedRows) {
+         if(c->averaged != NULL) alignedFree(c->averaged);
+         c->averaged = alignedAlloc(sizeof(double) * count * outSize);
+         if(c->averaged == NULL) {
+             fprintf(stderr, "Memory allocation failed for averaged outputs\n");
+             c->averagedRows = 0;
+             return 1;
+         }
+         c->averagedRows = count;
+     }
+
+     double *outputs = c->averaged;
+     int status = forwardBatch(c, inputs, count, outputs, 0, usePool);
+     double *mean = c->values[m->layerCount - 1];
+     for(int o = 0; o < outSize && status == 0; o++) {
+         double sum = 0.0;
+         for(int b = 0; b < count; b++) {
+             sum += outputs[(size_t)b * outSize + o];
+         }
+         mean[o] = sum / count;
+     }
+     return status;
+ }
+
+ /**
+  * Forward pass of several variants of one input, e.g. its augmented copies
+  * (see augment.h), as one batch on the calling thread
+  * Their logits are averaged before any softmax, and contextPrediction
+  * reports the class of the average. Up to NN_SPARSE_TILE sparse variants
+  * read each weight of layer 1 they need once for all of them.
+  *
+  * @param c Context
+  * @param inputs count rows of input values, back to back
+  * @param count Number of variants
+  * @return The averaged output-layer values inside the context, or NULL on failure
+  */
+ const double *contextForwardAveraged(NetworkContext *c, const double *inputs, int count) {
+     if(forwardAveraged(c, inputs, count, 0) != 0) {
+         return NULL;
+     }
+     return c->values[c->model->layerCount - 1];
+ }
+
+ /**
+  * Values of one layer after the context's last contextForward
+  */
+ const double *contextValues(const NetworkContext *c, int layer) {
+     return c->values[layer];
+ }
+
+ /**
+  * Predicted class of the context's last contextForward
+  */
+ int contextPrediction(const NetworkContext *c) {
+     const NetworkModel *m = c->model;
+     return nnKernels->argmax(c->values[m->layerCount - 1], m->layers[m->layerCount - 1].size);
+ }
+
+ /* ========== Incremental Forward Pass ========== */
+
+ /**
+  * Forward pass that reuses the previous incremental pass of the context
+  * Keeps the first layer's pre-activations and, for a new input, adds only
+  * W1[:, j] * (x[j] - previous x[j]) for the inputs j that changed, then runs
+  * the remaining (small) layers in full. Meant for inputs that change a few
+  * values at a time, like a digit being drawn. When most inputs changed, or
+  * every NN_INCREMENTAL_REFRESH passes to stop rounding drift, the first
+  * layer is recomputed instead. Always runs on the fp64 weights.
+  *
+  * @param c Context
+  * @param input Input values (size of the model's input layer)
+  * @param changed Receives the number of inputs that changed, may be NULL
+  * @return The output layer's raw values inside the context, or NULL on failure
+  */
+ const double *contextForwardIncremental(NetworkContext *c, const double *input, int *changed) {
+     const NetworkModel *m = c->model;
+     const Layer *first = &m->layers[1];
+     const int inputs = first->inputs;
+
+     if(c->lastInput == NULL) {
+         size_t vector = alignUp(sizeof(double) * inputs);
+         unsigned char *p = alignedAlloc(3 * vector + alignUp(sizeof(double) * first->size));
+         if(p == NULL) {
+             fprintf(stderr, "Memory allocation failed for incremental forward pass\n");
+             return NULL;
+         }
+         c->lastInput = (double*) p;
+         c->changedDelta = (double*)(p + vector);
+         c->changedIndex = (int*)(p + 2 * vector);
+         c->firstSums = (double*)(p + 3 * vector);
+         c->incrementalPasses = -1;   // Nothing cached yet
+     }
+
+     // Collect the inputs that changed; past half of them a full pass is cheaper
+     PROFILE_BEGIN(mark);
+     int count = 0;
+     int full = c->incrementalPasses < 0 || c->incrementalPasses >= NN_INCREMENTAL_REFRESH;
+     for(int k = 0; k < inputs && !full; k++) {
+         if(input[k] != c->lastInput[k]) {
+             c->changedIndex[count] = k;
+             c->changedDelta[count] = input[k] - c->lastInput[k];
+             full = ++count * 2 > inputs;
+         }
+     }
+
+     if(full) {
+         nnKernels->dense(first->weights, first->stride, first->bias, input, inputs, first->size, c->firstSums, 0);
+         c->incrementalPasses = 0;
+         count = 0;
+         for(int k = 0; k < inputs; k++) count += (input[k] != c->lastInput[k]);
+     } else if(count > 0) {
+         // Row by row, so each weight row is touched once whatever the column count
+         for(int o = 0; o < first->size; o++) {
+             const double *row = first->weights + (size_t)o * first->stride;
+             double sum = c->firstSums[o];
+             for(int j = 0; j < count; j++) {
+                 sum += row[c->changedIndex[j]] * c->changedDelta[j];
+             }
+             c->firstSums[o] = sum;
+         }
+         c->incrementalPasses++;
+     }
+     memcpy(c->lastInput, input, sizeof(double) * inputs);
+     memcpy(c->values[0], input, sizeof(double) * inputs);
+     if(changed != NULL) *changed = count;
+
+     // Activation of the cached sums, then the remaining layers in full
+     int last = m->layerCount - 1;
+     memcpy(c->values[1], c->firstSums, sizeof(double) * first->size);
+     applyActivation(first->activation, c->values[1], first->size);
+     for(int h = 2; h < m->layerCount; h++) {
+         const Layer *l = &m->layers[h];
+         nnKernels->dense(l->weights, l->stride, l->bias, c->values[h-1], l->inputs, l->size, c->values[h],
+                          fusedRelu(l));
+         finishActivation(l, c->values[h], l->size);
+     }
+     PROFILE_END(mark, NN_STAGE_INCREMENTAL, 2 * (uint64_t)(full ? inputs : count) * first->size + networkWork(m, 2, 1, 0),
+                 sizeof(double) * (uint64_t)(full ? inputs : count) * first->size + networkWork(m, 2, 1, 1));
+     return c->values[last];
+ }
+
+ /* ========== Global Network ========== */
+
+ /**
+  * Make model the global network: create its context and point Network at both
+  * Any previous global network is freed first.
+  *
+  * @return 0 on success, 1 on failure (m is released)
+  */
+ static int installGlobal(NetworkModel *m) {
+     NetworkContext *c = createNetworkContext(m);
+     releaseNetworkModel(m);   // The context holds the reference now
+     if(c == NULL) {
+         return 1;
+     }
+
+     freeNetwork();
+     globalModel = m;
+     globalContext = c;
+     for(int i = 0; i < m->layerCount; i++) {
+         m->layers[i].value = c->values[i];
+     }
+     Network = m->layers;
+     n = m->layerCount;
+     return 0;
+ }
+
+ /**
+  * Precision for the next global network
+  * The first one takes it from NN_PRECISION (fp64, fp32, fp16 or int8)
+  * unless setNetworkPrecision chose one already.
+  */
+ static int globalPrecision(void) {
+     if(precision < 0) {
+         const char *want = getenv("NN_PRECISION");
+         precision = NN_PRECISION_FP64;
+         if(want != NULL) {
+             int p = precisionFromName(want);
+             if(p < 0) {
+                 printf("Unknown NN_PRECISION %s, using fp64\n", want);
+             } else {
+                 precision = p;
+             }
+         }
+     }
+     return precision;
+ }
+
  /**
   * Initialize the neural network with the specified structure
-  * 
+  * Weights and biases start with random values.
+  *
   * @param structure Array containing number of neurons in each layer
   * @param n1 Number of layers in the network
   */
  void initializeNetwork(int structure[], int n1) {
-     int num = 0;
-     
      printf("\nInitializing Neural Network\n");
-     
-     Layer* head = NULL;    // Head of the layer linked list
-     Layer* tail = NULL;    // Tail pointer to keep track of last layer
-     
-     // Create each layer in the network
-     for(int i = 0; i < n1; i++) {
-         Layer* l = (Layer*) malloc(sizeof(Layer));
-         if (l == NULL) {
-             fprintf(stderr, "Memory allocation failed for layer\n");
-             exit(1);
-         }
-         
-         num = structure[i];    // Number of neurons in current layer
-         
-         Neuron *n = NULL;      // Head of neuron linked list for this layer
-         Neuron *n_tail = NULL; // Tail pointer for neurons
-         
-         // Create neurons for this layer
-         for(int j = 0; j < num; j++) {
-             Neuron* tempNeuron = (Neuron*) malloc(sizeof(Neuron));
-             if (tempNeuron == NULL) {
-                 fprintf(stderr, "Memory allocation failed for neuron\n");
-                 exit(1);
-             }
-             
+     printf("Using %s kernels\n", selectKernels()->name);
+
+     NetworkModel *m = allocateModel(structure, n1, 1);
+     if (m == NULL) {
+         exit(1);
+     }
+
+     for(int i = 1; i < n1; i++) {
+         Layer *l = &m->layers[i];
+         for(int j = 0; j < l->size; j++) {
              // Initialize with random bias between -0.5 and 0.5
-             tempNeuron->bias = (rand() / (double)RAND_MAX) - 0.5;
-             
-             Weight *w = NULL;     // Head of weight linked list
-             Weight *w_tail = NULL; // Tail pointer for weights
-             
-             // Create weights for this neuron (except for input layer)
-             if (i > 0) {
-                 for(int k = 0; k < network_structure[i-1]; k++) {
-                     Weight *tw = (Weight*)malloc(sizeof(Weight));
-                     if (tw == NULL) {
-                         fprintf(stderr, "Memory allocation failed for weight\n");
-                         exit(1);
-                     }
-                     
-                     // Random weight initialization between -1 and 1
-                     tw->weight = (rand() / (double)RAND_MAX) * 2 - 1;
-                     
-                     // Add to weight linked list
-                     if(w == NULL) {
-                         w = tw;
-                         w_tail = tw;
-                         tw->prev = NULL;
-                         tw->next = NULL;
-                     } else {
-                         tw->prev = w_tail;
-                         w_tail->next = tw;
-                         w_tail = tw;
-                         w_tail->next = NULL;
-                     }
-                 }
-             }
-             
-             tempNeuron->weightNode = w;  // Attach weights to the neuron
-             
-             // Add to neuron linked list
-             if(n == NULL) {
-                 n = tempNeuron;
-                 n_tail = tempNeuron;
-                 tempNeuron->prev = NULL;
-                 tempNeuron->next = NULL;
-             } else {
-                 tempNeuron->prev = n_tail;
-                 n_tail->next = tempNeuron;
-                 n_tail = tempNeuron;
-                 n_tail->next = NULL;
+             l->bias[j] = (rand() / (double)RAND_MAX) - 0.5;
+
+             // Random weight initialization between -1 and 1
+             double *row = l->weights + (size_t)j * l->stride;
+             for(int k = 0; k < l->inputs; k++) {
+                 row[k] = (rand() / (double)RAND_MAX) * 2 - 1;
              }
          }
-         
-         l->neuron = n;  // Attach neurons to the layer
-         
-         // Add to layer linked list
-         if(head == NULL) {
-             head = l;
-             tail = l;
-             l->prev = NULL;
-             l->next = NULL;
-         } else {
-             l->prev = tail;
-             tail->next = l;
-             tail = l;
-             tail->next = NULL;
-         }
      }
-     
-     Network = head;  // Set the global network pointer
+
+     buildPrecisionCopy(m, globalPrecision());
+     precision = m->precision;
+     if (installGlobal(m) != 0) {
+         exit(1);
+     }
+     if(precision != NN_PRECISION_FP64) {
+         printf("Using %s weights\n", precisionName(precision));
+     }
      printf("Network initialization complete\n");
  }
- 
+
+ /**
+  * Load a binary model file (see model.h) as the network
+  * Replaces initializeNetwork + importNetwork. The file is mapped read-only
+  * and its weights and biases are used in place; only the value vectors are
+  * allocated.
+  *
+  * @param path Model file
+  * @return 0 on success, 1 on failure
+  */
+ int loadNetwork(const char *path) {
+     printf("Loading network from %s...\n", path);
+     printf("Using %s kernels\n", selectKernels()->name);
+
+     int p = globalPrecision();
+     NetworkModel *m = openNetworkModel(path, p);
+     if (m == NULL || installGlobal(m) != 0) {
+         return 1;
+     }
+     if(p != NN_PRECISION_FP64) {
+         printf("Using %s weights\n", precisionName(p));
+     }
+     printf("Network loaded successfully\n");
+     return 0;
+ }
+
+ /**
+  * Save the network to a binary model file (see model.h)
+  * Layers pruned to at most NN_CSR_DENSITY nonzero weights are stored as CSR.
+  *
+  * @param path Output file
+  * @return 0 on success, 1 on failure
+  */
+ int saveNetwork(const char *path) {
+     if(Network == NULL) {
+         printf("Error: Network is not initialized\n");
+         return 1;
+     }
+     return writeModelFile(path, Network, n, NN_LAYOUT_ROWS, NN_CSR_DENSITY);
+ }
+
+ /**
+  * Choose the weights used by feedForward and feedForwardBatch
+  * Called before a network is loaded it only records the choice, which is
+  * applied when initializeNetwork, loadNetwork or importNetwork set up the
+  * weights. Called afterwards it converts the current weights right away;
+  * call it again after changing them. The fp64 weights are kept either way.
+  *
+  * @param p NN_PRECISION_FP64, NN_PRECISION_FP32, NN_PRECISION_FP16 or NN_PRECISION_INT8
+  * @return 0 on success, 1 on failure
+  */
+ int setNetworkPrecision(int p) {
+     if(precisionName(p) == NULL) {
+         printf("Error: Unknown precision %d\n", p);
+         return 1;
+     }
+
+     precision = p;
+     if(globalModel == NULL) {
+         return 0;
+     }
+     int status = buildPrecisionCopy(globalModel, p);
+     precision = globalModel->precision;
+     return status;
+ }
+
+ /**
+  * Look up a precision by name
+  *
+  * @param name "fp64", "fp32", "fp16" or "int8"
+  * @return The NN_PRECISION_* value, or -1 if the name is unknown
+  */
+ int precisionFromName(const char *name) {
+     for(int p = 0; p < (int)(sizeof(precisionNames) / sizeof(precisionNames[0])); p++) {
+         if(strcmp(name, precisionNames[p]) == 0) return p;
+     }
+     return -1;
+ }
+
+ /**
+  * Name of an NN_PRECISION_* value, or NULL if it is not one
+  */
+ const char *precisionName(int p) {
+     if(p < 0 || p >= (int)(sizeof(precisionNames) / sizeof(precisionNames[0]))) return NULL;
+     return precisionNames[p];
+ }
+
+ /**
+  * Bytes of weights and biases read by a forward pass at the current precision
+  */
+ size_t networkWeightBytes(void) {
+     return globalModel != NULL ? networkModelWeightBytes(globalModel) : 0;
+ }
+
+ /**
+  * Release the memory held by the network
+  * Safe to call when no network is initialized. The chosen precision carries
+  * over to the next network.
+  */
+ void freeNetwork(void) {
+     freeNetworkContext(globalContext);   // Drops the last reference to globalModel
+     poolStop();
+     globalContext = NULL;
+     globalModel = NULL;
+     Network = NULL;
+ }
+
+ /* ========== Activation Functions ========== */
+
  /**
   * ReLU activation function
   * Returns x if x >= 0, otherwise returns 0
-  * 
+  *
   * @param x Input value
   * @return Activated value
   */
  double relu(double x) {
      return x >= 0 ? x : 0;
  }
- 
+
+ /**
+  * Apply an activation in place
+  *
+  * @param activation NN_ACTIVATION_* value
+  * @param values Values to transform
+  * @param count Number of values
+  */
+ void applyActivation(int activation, double *values, size_t count) {
+     switch(activation) {
+     case NN_ACTIVATION_RELU:
+         nnKernels->relu(values, (int)count);
+         break;
+     case NN_ACTIVATION_SIGMOID:
+         for(size_t i = 0; i < count; i++) values[i] = 1.0 / (1.0 + exp(-values[i]));
+         break;
+     case NN_ACTIVATION_TANH:
+         for(size_t i = 0; i < count; i++) values[i] = tanh(values[i]);
+         break;
+     default:
+         break;   // Linear
+     }
+ }
+
+ /**
+  * Look up an activation by name
+  *
+  * @param name "relu", "linear", "sigmoid" or "tanh"
+  * @return The NN_ACTIVATION_* value, or -1 if the name is unknown
+  */
+ int activationFromName(const char *name) {
+     for(int a = NN_ACTIVATION_RELU; a <= NN_ACTIVATION_TANH; a++) {
+         if(strcmp(name, activationName(a)) == 0) return a;
+     }
+     return -1;
+ }
+
+ /**
+  * Name of an NN_ACTIVATION_* value, or NULL if it is not one
+  */
+ const char *activationName(int activation) {
+     static const char *names[] = { "relu", "linear", "sigmoid", "tanh" };
+     if(activation < NN_ACTIVATION_RELU || activation > NN_ACTIVATION_TANH) return NULL;
+     return names[activation - NN_ACTIVATION_RELU];
+ }
+
+ /**
+  * Parse a network description such as "784,128,10" or "784,256:tanh,64,10:linear"
+  * Each layer is a size, optionally followed by ':' and its activation.
+  * Layers without one get the defaults: ReLU on hidden layers, linear on the output.
+  *
+  * @param spec Description, input layer first
+  * @param structure Receives the layer sizes
+  * @param activations Receives the activations (0 for the input layer)
+  * @param maxLayers Room in structure and activations
+  * @return Number of layers, or -1 if the description is invalid
+  */
+ int parseNetworkSpec(const char *spec, int structure[], int activations[], int maxLayers) {
+     int count = 0;
+     const char *p = spec;
+     while(*p != '\0') {
+         char *end;
+         long size = strtol(p, &end, 10);
+         if(end == p || size < 1 || size > (1 << 20) || count == maxLayers) {
+             printf("Error: Invalid network description %s\n", spec);
+             return -1;
+         }
+         structure[count] = (int)size;
+         activations[count] = 0;
+         p = end;
+
+         if(*p == ':') {
+             char name[16];
+             size_t len = strcspn(p + 1, ",");
+             if(len >= sizeof(name) || count == 0) {
+                 printf("Error: Invalid activation in %s\n", spec);
+                 return -1;
+             }
+             memcpy(name, p + 1, len);
+             name[len] = '\0';
+             activations[count] = activationFromName(name);
+             if(activations[count] < 0) {
+                 printf("Error: Unknown activation %s\n", name);
+                 return -1;
+             }
+             p += 1 + len;
+         }
+         count++;
+         if(*p == ',') p++;
+     }
+     if(count < 2) {
+         printf("Error: A network needs at least an input and an output layer\n");
+         return -1;
+     }
+     for(int i = 1; i < count; i++) {
+         if(activations[i] == 0) activations[i] = (i < count - 1) ? NN_ACTIVATION_RELU : NN_ACTIVATION_LINEAR;
+     }
+     return count;
+ }
+
  /**
   * Softmax activation function for output layer
-  * Converts raw outputs to probability distribution
-  * 
+  * Converts raw outputs to probability distribution using the active kernels
+  *
   * @param input Array of input values
   * @param output Array to store softmax results
   * @param size Size of the arrays
   */
  void softmax(double* input, double* output, int size) {
-     // Find the maximum value for numerical stability
-     double max_val = input[0];
-     for (int i = 1; i < size; i++) {
-         if (input[i] > max_val) {
-             max_val = input[i];
-         }
+     PROFILE_BEGIN(mark);
+     nnKernels->softmax(input, output, size);
+     PROFILE_END(mark, NN_STAGE_SOFTMAX, 4 * (uint64_t)size, 2 * sizeof(double) * (uint64_t)size);
+ }
+
+ /* ========== Threading ========== */
+
+ /**
+  * Set the threads feedForwardBatch spreads large batches over
+  * Without a call, NN_THREADS (default: every online core) and NN_PIN=1
+  * decide when the first batch runs.
+  *
+  * @param threads Total threads including the caller, <= 0 for every online core
+  * @param pinCores Non-zero to pin thread i to core i
+  * @return 0 on success, 1 if not every thread could be started
+  */
+ int setNetworkThreads(int threads, int pinCores) {
+     requestedThreads = threads > 0 ? threads : cpuCount();
+     requestedPinning = pinCores ? 1 : 0;
+     return poolStart(requestedThreads, requestedPinning);
+ }
+
+ /**
+  * Start the thread pool with the configured settings if it is not running
+  */
+ static void ensurePool(void) {
+     static int failed = 0;
+     if(poolThreads() > 1 || failed) return;
+
+     if(requestedThreads <= 0) {
+         const char *want = getenv("NN_THREADS");
+         requestedThreads = (want != NULL && atoi(want) > 0) ? atoi(want) : cpuCount();
      }
-     
-     // Compute exp(x - max) for each element and sum them
-     double sum = 0.0;
-     for (int i = 0; i < size; i++) {
-         output[i] = exp(input[i] - max_val);
-         sum += output[i];
+     if(requestedPinning < 0) {
+         const char *pin = getenv("NN_PIN");
+         requestedPinning = (pin != NULL && atoi(pin) != 0);
      }
-     
-     // Normalize by dividing each value by the sum
-     for (int i = 0; i < size; i++) {
-         output[i] /= sum;
+     if(requestedThreads > 1 && poolStart(requestedThreads, requestedPinning) != 0) {
+         failed = 1;   // Keep the threads that did start, don't retry every batch
      }
  }
- 
+
+ /**
+  * Forward pass of many samples on a context, spread over the thread pool
+  * Same as feedForwardBatch on any model. The pool runs one loop at a time,
+  * so only one thread may use it at once (this, feedForwardBatch or training).
+  *
+  * @return 0 on success, 1 on failure
+  */
+ int contextForwardBatchParallel(NetworkContext *c, const double *inputs, int count, double *outputs,
+                                 int probabilities) {
+     ensurePool();
+     return forwardBatch(c, inputs, count, outputs, probabilities, 1);
+ }
+
+ /* ========== Global Forward Pass ========== */
+
  /**
   * Forward propagation through the network
-  * Takes input array and propagates values through the network
-  * 
+  * Takes input array and propagates values through the network. Layers
+  * larger than NN_PARALLEL_MACS are split across the thread pool if it runs.
+  *
   * @param input Array of input values (must match input layer size)
   */
+ void feedForward(double input[]) {
+     forward(globalContext, input, 1);
+ }
 
+ /**
+  * Forward propagation that only recomputes what changed since the last call
+  * See contextForwardIncremental; Network values are set as by feedForward.
+  *
+  * @param input Array of input values (must match input layer size)
+  * @return Number of inputs that changed since the last call, -1 on failure
+  */
+ int feedForwardIncremental(double input[]) {
+     int changed;
+     if(Network == NULL || contextForwardIncremental(globalContext, input, &changed) == NULL) {
+         return -1;
+     }
+     return changed;
+ }
 
- void feedForward(double input[]) {
-     Layer* currentLayer = Network;
-     Neuron* n = currentLayer->neuron;
-     
-     // Set input layer values directly from input array
-     for(int i = 0; i < network_structure[0]; i++) {
-         n->value = (double)input[i];
-         n = n->next;
-     }
-     
-     // Process each hidden and output layer
-     currentLayer = currentLayer->next;
-     int h = 1;  // Layer index counter
-     
-     while(currentLayer != NULL) {
-         Neuron* currentNeuron = currentLayer->neuron;
-         
-         // Process each neuron in current layer
-         for(int i = 0; i < network_structure[h]; i++) {
-             double value = 0.0;
-             Neuron* previousLayerNeuron = currentLayer->prev->neuron;
-             Weight* w = currentNeuron->weightNode;
-             
-             // Calculate weighted sum from previous layer
-             for(int j = 0; j < network_structure[h-1]; j++) {
-                 value += (w->weight) * (previousLayerNeuron->value);
-                 previousLayerNeuron = previousLayerNeuron->next;
-                 w = w->next;
-             }
-             
-             // Apply activation function (ReLU) with bias
-             if(h!= 2) {
-                 currentNeuron->value = relu(value + (currentNeuron->bias));
-             } else { // For output layer, apply softmax later
-                 currentNeuron->value = value + (currentNeuron->bias);
-             }
+ /**
+  * Forward propagation for many samples at once
+  * The batch is processed in tiles of NN_BATCH_TILE samples; each layer runs as
+  * one matrix-matrix product over the tile so its weights are read once per
+  * tile instead of once per sample. Tiles are spread over the thread pool;
+  * a batch with fewer tiles than threads splits its big layers by neurons
+  * instead. Network values are left untouched.
+  *
+  * @param inputs count rows of network_structure[0] values, back to back
+  * @param count Number of samples
+  * @param outputs Caller-owned buffer for count rows of output-layer values
+  * @param probabilities Non-zero to write softmax probabilities, zero for raw logits
+  * @return 0 on success, 1 on failure
+  */
+ int feedForwardBatch(const double *inputs, int count, double *outputs, int probabilities) {
+     if(Network == NULL) {
+         printf("Error: Network is not initialized\n");
+         return 1;
+     }
+     ensurePool();
+     return forwardBatch(globalContext, inputs, count, outputs, probabilities, 1);
+ }
 
-             currentNeuron = currentNeuron->next;
-         }
-         
-         currentLayer = currentLayer->next;
-         h++;
+ /**
+  * Forward propagation of several variants of one input, averaging their logits
+  * See contextForwardAveraged; big layers are split across the thread pool
+  * like feedForward. The output layer's values are set to the average, so
+  * getPrediction and displayFinalOutput report it; hidden layers keep the
+  * values of the last single-sample pass.
+  *
+  * @param inputs count rows of network_structure[0] values, back to back
+  * @param count Number of variants, e.g. NN_TTA_VARIANTS
+  * @return 0 on success, 1 on failure
+  */
+ int feedForwardAveraged(const double *inputs, int count) {
+     if(Network == NULL) {
+         printf("Error: Network is not initialized\n");
+         return 1;
      }
+     ensurePool();
+     return forwardAveraged(globalContext, inputs, count, 1);
  }
- 
+
+ /* ========== Output ========== */
+
  /**
   * Display the output layer values with softmax applied
   * Shows the final prediction probabilities for each class
   */
  void displayFinalOutput() {
-     double output[10] = {0};      // Raw outputs
-     double final_output[10] = {0}; // Softmax probabilities
+     const int classes = Network[n-1].size;
+     double *final_output = malloc(sizeof(double) * classes); // Softmax probabilities
      int i = 0;
-     
-     // Navigate to the last layer
-     Layer* lastLayer = Network;
-     while (lastLayer->next != NULL) {
-         lastLayer = lastLayer->next;
-     }
-     
-     // Collect raw output values
+     if(final_output == NULL) {
+         fprintf(stderr, "Memory allocation failed for output probabilities\n");
+         return;
+     }
+
+     // Apply softmax to the raw values of the last layer
      printf("Final Output (Class Probabilities):\n");
-     Neuron* outputNeuron = lastLayer->neuron;
-     while(outputNeuron != NULL) {
-         output[i] = outputNeuron->value;
-         outputNeuron = outputNeuron->next;
-         i++;
-     }
-     
-     // Apply softmax to get probabilities
-     softmax(output, final_output, 10);
-     
+     softmax(Network[n-1].value, final_output, classes);
+
      // Display the probabilities for each class
-     for(i = 0; i < 10; i++) {
+     for(i = 0; i < classes; i++) {
          printf("Class %d: %lf\n", i, final_output[i]);
      }
-     
+
      // Find and display the predicted class (highest probability)
      int prediction = 0;
      double max_prob = final_output[0];
-     for(i = 1; i < 10; i++) {
+     for(i = 1; i < classes; i++) {
          if(final_output[i] > max_prob) {
              max_prob = final_output[i];
              prediction = i;
          }
      }
      printf("\nPredicted digit: %d (confidence: %.2f%%)\n", prediction, max_prob*100);
+     free(final_output);
  }
- 
+
+ /* ========== Import ========== */
+
  /**
   * Import pre-trained weights and biases from files
-  * 
+  * Reads b<h>.txt and the weights of every layer of the network from either
+  * W<h>_transpose.txt (one row per neuron, as written by exportNetwork) or,
+  * when there is none, W<h>.txt (one row per input). The file name declares
+  * the orientation: both are parsed on the thread pool straight into the
+  * layer's rows (see parse.h), so neither needs transposing first, and must
+  * hold exactly one value per weight.
+  *
   * @return 0 on success, 1 on failure
   */
  int importNetwork() {
      printf("Importing network parameters from files...\n");
-     
-     // Open model parameter files
-     FILE *b1 = fopen("b1.txt", "r");  // Biases for first hidden layer
-     FILE *b2 = fopen("b2.txt", "r");  // Biases for output layer
-     FILE *w1 = fopen("W1_transpose.txt", "r");  // Weights for first hidden layer
-     FILE *w2 = fopen("W2_transpose.txt", "r");  // Weights for output layer
-     
-     // Check if files opened successfully
-     if (b1 == NULL || b2 == NULL || w1 == NULL || w2 == NULL) {
-         perror("Error opening parameter files. Check if files exist in the same directory.");
-         return 1;
-     }
-     
+
      // Verify network is initialized
      if(Network == NULL) {
          printf("Error: Network is not initialized\n");
          return 1;
      }
-     
-     // Navigate through network structure and import parameters
-     int i = 0;
-     Layer* head = Network;
-     
-     // Process each layer
-     while (head != NULL) {
-         Neuron* tn = head->neuron;
-         
-         // Process each neuron in the layer
-         for(int j = 0; j < network_structure[i]; j++) {
-             // Import biases for hidden and output layers
-             if(i == 1) {
-                 if(fscanf(b1, "%lf", &tn->bias) != 1) {
-                     printf("Error reading bias for hidden layer\n");
-                     return 1;
-                 }
-             } else if(i == 2) {
-                 if(fscanf(b2, "%lf", &tn->bias) != 1) {
-                     printf("Error reading bias for output layer\n");
-                     return 1;
-                 }
-             }
-             
-             // Import weights (except for input layer which doesn't have weights)
-             if(i != 0) {
-                 Weight *tw = tn->weightNode;
-                 while(tw != NULL) {
-                     if(i == 1) {
-                         if(fscanf(w1, "%lf", &tw->weight) != 1) {
-                             printf("Error reading weight for hidden layer\n");
-                             return 1;
-                         }
-                     } else if(i == 2) {
-                         if(fscanf(w2, "%lf", &tw->weight) != 1) {
-                             printf("Error reading weight for output layer\n");
-                             return 1;
-                         }
-                     }
-                     tw = tw->next;
-                 }
-             }
-             
-             tn = tn->next;
+     if(globalModel->file.map.base != NULL) {
+         printf("Error: Network was loaded from a read-only model file\n");
+         return 1;
+     }
+
+     // Every layer h has b<h>.txt and W<h>_transpose.txt or W<h>.txt
+     ensurePool();
+     int status = 0;
+     for(int h = 1; h < n && status == 0; h++) {
+         Layer *l = &Network[h];
+         char wname[64], bname[64];
+         snprintf(wname, sizeof(wname), "W%d_transpose.txt", h);
+         snprintf(bname, sizeof(bname), "b%d.txt", h);
+         FILE *rows = fopen(wname, "rb");
+         int byInput = (rows == NULL);
+         if(rows != NULL) fclose(rows);
+         if(byInput) snprintf(wname, sizeof(wname), "W%d.txt", h);
+
+         if(readTextMatrix(bname, l->bias, 1, l->size, (size_t)l->size, 0) != 0) {
+             printf("Error reading bias for layer %d\n", h);
+             status = 1;
+         } else if(readTextMatrix(wname, l->weights, byInput ? l->inputs : l->size, byInput ? l->size : l->inputs,
+                                  (size_t)l->stride, byInput) != 0) {
+             printf("Error reading weight for layer %d\n", h);
+             status = 1;
          }
-         
-         i++;
-         head = head->next;
-     }
-     
-     // Close all files
-     fclose(b1);
-     fclose(b2);
-     fclose(w1);
-     fclose(w2);
-     
-     printf("Network parameters imported successfully\n");
-     return 0;
+     }
+
+     if (status == 0) {
+         printf("Network parameters imported successfully\n");
+         // Rebuild the copies the forward pass runs on from the new weights
+         status = buildPrecisionCopy(globalModel, globalModel->precision);
+     }
+     return status;
  }
+
+ /**
+  * Get the predicted class for the last forward pass
+  *
+  * @return Index of the output neuron with the highest probability
+  */
  int getPrediction(){
-    double output[10] = {0};      // Raw outputs
-     double final_output[10] = {0}; // Softmax probabilities
-     int i = 0;
-     
-     // Navigate to the last layer
-     Layer* lastLayer = Network;
-     while (lastLayer->next != NULL) {
-         lastLayer = lastLayer->next;
-     }
-     
-     Neuron* outputNeuron = lastLayer->neuron;
-     while(outputNeuron != NULL) {
-         output[i] = outputNeuron->value;
-         outputNeuron = outputNeuron->next;
-         i++;
-     }
-     
-     // Apply softmax to get probabilities
-     softmax(output, final_output, 10);
-     
-     
-     
-     
-     // Find and display the predicted class (highest probability)
-     int prediction = 0;
-     double max_prob = final_output[0];
-     for(i = 1; i < 10; i++) {
-         if(final_output[i] > max_prob) {
-             max_prob = final_output[i];
-             prediction = i;
+     // Softmax is monotonic, so the largest logit is the most probable class
+     return nnKernels->argmax(Network[n-1].value, Network[n-1].size);
+ }
+
+ /* ========== Export ========== */
+
+ /**
+  * Write one layer as W<h>_transpose.txt (one row of inputs per neuron) and b<h>.txt
+  * Values are printed with 17 significant digits so they read back exactly.
+  *
+  * @return 0 on success, 1 on failure
+  */
+ static int writeLayerText(int h) {
+     const Layer *l = &Network[h];
+     char wname[64], bname[64];
+     snprintf(wname, sizeof(wname), "W%d_transpose.txt", h);
+     snprintf(bname, sizeof(bname), "b%d.txt", h);
+
+     FILE *wf = fopen(wname, "w");
+     FILE *bf = fopen(bname, "w");
+     int status = 0;
+     if (wf == NULL || bf == NULL) {
+         printf("Error creating %s or %s\n", wname, bname);
+         status = 1;
+     } else {
+         for(int j = 0; j < l->size && status == 0; j++) {
+             const double *row = l->weights + (size_t)j * l->stride;
+             for(int k = 0; k < l->inputs; k++) {
+                 if(fprintf(wf, k + 1 < l->inputs ? "%.17g " : "%.17g\n", row[k]) < 0) status = 1;
+             }
+             if(fprintf(bf, "%.17g\n", l->bias[j]) < 0) status = 1;
          }
      }
-     return prediction;
 
- }
\ No newline at end of file
+     if (wf && fclose(wf) != 0) status = 1;
+     if (bf && fclose(bf) != 0) status = 1;
+     if (status != 0) {
+         printf("Error writing %s or %s\n", wname, bname);
+     }
+     return status;
+ }
+
+ /**
+  * Export the weights and biases to the text files importNetwork reads
+  * Layer h goes to W<h>_transpose.txt and b<h>.txt in the working directory.
+  *
+  * @return 0 on success, 1 on failure
+  */
+ int exportNetwork() {
+     printf("Exporting network parameters to files...\n");
+
+     if(Network == NULL) {
+         printf("Error: Network is not initialized\n");
+         return 1;
+     }
+     for(int h = 1; h < n; h++) {
+         if(writeLayerText(h) != 0) return 1;
+     }
+     printf("Network parameters exported successfully\n");
+     return 0;
+ }
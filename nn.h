@@ -7,45 +7,102 @@
 #include <time.h>
 #include <math.h>
 
+/* ========== Constants ========== */
+
+#define NN_ALIGN 64   // Alignment in bytes of every weight, bias and value vector
+
+#define NN_PRECISION_FP64 0   // Double weights and activations (default)
+#define NN_PRECISION_INT8 1   // INT8 weights with per-neuron scales (see quant.h)
+#define NN_PRECISION_FP32 2   // Float weights and activations (see reduced.h)
+#define NN_PRECISION_FP16 3   // Half weights, float activations (see reduced.h)
+
+#define NN_ACTIVATION_RELU    1   // max(0, x), fused into the dense kernels
+#define NN_ACTIVATION_LINEAR  2   // Identity, the output layer's logits
+#define NN_ACTIVATION_SIGMOID 3
+#define NN_ACTIVATION_TANH    4
+
+#define NN_NEURON_BLOCK 16          // Neurons per work item when a layer is split across threads
+#define NN_PARALLEL_MACS (1 << 19)  // Multiply-adds below which a layer stays on one thread
+#define NN_INCREMENTAL_REFRESH 1024 // Incremental passes between full first-layer recomputes
+#define NN_SPARSE_DENSITY 0.5       // Nonzero input fraction up to which layer 1 runs sparse
+#define NN_GEMM_BATCH 256           // Samples per GEMM chunk of an fp64 batched pass
+
 /* ========== Data Structures ========== */
 
-// Weight linked list node
-typedef struct WeightNode {
-    double weight;
-    struct WeightNode *next;
-    struct WeightNode *prev;
-} Weight;
-
-// Neuron node containing output, bias, and weight links
-typedef struct Neuron {
-    Weight *weightNode;
-    double bias;
-    double value;
-    struct Neuron *next;
-    struct Neuron *prev;
-} Neuron;
-
-// Layer node containing list of neurons
+// Layer stored as contiguous vectors; weights are row-major, one row per neuron.
+// Networks may have any number of layers; by default hidden layers use ReLU
+// and the output layer is linear, with softmax turning its values into
+// probabilities.
 typedef struct Layer {
-    Neuron *neuron;
-    struct Layer *next;
-    struct Layer *prev;
+    int size;         // Number of neurons in this layer
+    int inputs;       // Number of neurons in the previous layer (0 for input layer)
+    int stride;       // Row length of weights in doubles, padded to NN_ALIGN bytes
+    int activation;   // NN_ACTIVATION_* applied to this layer's outputs (0 for input layer)
+    double *weights;  // size x stride matrix (NULL for input layer, read-only if mapped)
+    double *bias;     // One bias per neuron (NULL for input layer, read-only if mapped)
+    double *value;    // Output value of each neuron after activation (global Network only)
 } Layer;
 
+// Reentrant API: a model holds immutable weights that any number of threads
+// can share; each thread runs its forward passes on its own context, which
+// owns the activations and scratch. Neither call takes a lock or allocates
+// once a context has run its first forward pass. The global Network above is a
+// model plus one context behind the original functions.
+typedef struct NetworkModel NetworkModel;
+typedef struct NetworkContext NetworkContext;
+
 /* ========== Global Variables ========== */
 
 extern int n;
 extern int network_structure[];
-extern Layer *Network;
+extern Layer *Network;   // Array of n layers, Network[0] is the input layer
 
 /* ========== Function Declarations ========== */
 
 void initializeNetwork(int structure[], int layerCount);
+void freeNetwork(void);
 int importNetwork(void);
+int exportNetwork(void);
+int loadNetwork(const char *path);
+int saveNetwork(const char *path);
+int setNetworkPrecision(int precision);
+int precisionFromName(const char *name);
+const char *precisionName(int precision);
+size_t networkWeightBytes(void);
+int setNetworkThreads(int threads, int pinCores);
 double relu(double x);
+void applyActivation(int activation, double *values, size_t count);
+int activationFromName(const char *name);
+const char *activationName(int activation);
+int parseNetworkSpec(const char *spec, int structure[], int activations[], int maxLayers);
 void softmax(double *input, double *output, int length);
 void feedForward(double input[]);
+int feedForwardIncremental(double input[]);
+int feedForwardBatch(const double *inputs, int count, double *outputs, int probabilities);
+int feedForwardAveraged(const double *inputs, int count);
 void displayFinalOutput(void);
 int getPrediction(void);
 
+NetworkModel *openNetworkModel(const char *path, int precision);
+NetworkModel *createNetworkModel(const Layer *layers, int layerCount, int precision);
+NetworkModel *retainNetworkModel(NetworkModel *model);
+void releaseNetworkModel(NetworkModel *model);
+int networkModelLayers(const NetworkModel *model);
+int networkModelLayerSize(const NetworkModel *model, int layer);
+size_t networkModelWeightBytes(const NetworkModel *model);
+
+NetworkContext *createNetworkContext(NetworkModel *model);
+void freeNetworkContext(NetworkContext *context);
+const double *contextForward(NetworkContext *context, const double *input);
+const double *contextForwardIncremental(NetworkContext *context, const double *input, int *changed);
+int contextForwardBatch(NetworkContext *context, const double *inputs, int count, double *outputs, int probabilities);
+const double *contextForwardAveraged(NetworkContext *context, const double *inputs, int count);
+int contextForwardBatchParallel(NetworkContext *context, const double *inputs, int count, double *outputs,
+                                int probabilities);
+const double *contextValues(const NetworkContext *context, int layer);
+int contextPrediction(const NetworkContext *context);
+
+void *alignedAlloc(size_t bytes);
+void alignedFree(void *p);
+
 #endif // NN_H
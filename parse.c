@@ -0,0 +1,522 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#define _GNU_SOURCE   // strtod_l, newlocale
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <locale.h>
+#include <pthread.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "parse.h"
+#include "model.h"
+#include "pool.h"
+
+#define POW5_MIN    -342               // Smallest decimal exponent with a table entry
+#define POW5_MAX    308                // Largest decimal exponent with a table entry
+#define BIG_LIMBS   64                 // 32-bit limbs of the table generator's integers
+#define BIG_SHIFT   2000               // Fixed-point scale of the reciprocals, in bits
+#define PARSE_CHUNK (64 * 1024)        // Bytes of text per pool task
+#define MAX_TOKEN   512                // Longest number handed to strtod
+
+/* ========== Wide Arithmetic ========== */
+
+/**
+ * Full 128-bit product of two 64-bit integers
+ *
+ * @param a, b Factors
+ * @param lo Receives the low 64 bits
+ * @return The high 64 bits
+ */
+static uint64_t multiply128(uint64_t a, uint64_t b, uint64_t *lo) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = (unsigned __int128)a * b;
+    *lo = (uint64_t)product;
+    return (uint64_t)(product >> 64);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    *lo = a * b;
+    return __umulh(a, b);
+#else
+    // Schoolbook on 32-bit halves
+    uint64_t aLo = a & 0xFFFFFFFF, aHi = a >> 32, bLo = b & 0xFFFFFFFF, bHi = b >> 32;
+    uint64_t low = aLo * bLo, cross1 = aHi * bLo, cross2 = aLo * bHi;
+    uint64_t middle = (low >> 32) + (cross1 & 0xFFFFFFFF) + (cross2 & 0xFFFFFFFF);
+    *lo = (middle << 32) | (low & 0xFFFFFFFF);
+    return aHi * bHi + (cross1 >> 32) + (cross2 >> 32) + (middle >> 32);
+#endif
+}
+
+/**
+ * Leading zero bits of a nonzero 32-bit integer
+ */
+static int leadingZeros32(uint32_t x) {
+#ifdef _MSC_VER
+    unsigned long bit;
+    _BitScanReverse(&bit, x);
+    return 31 - (int)bit;
+#else
+    return __builtin_clz(x);
+#endif
+}
+
+/**
+ * Leading zero bits of a nonzero 64-bit integer
+ */
+static int leadingZeros64(uint64_t x) {
+#ifdef _MSC_VER
+    if ((x >> 32) != 0) return leadingZeros32((uint32_t)(x >> 32));
+    return 32 + leadingZeros32((uint32_t)x);
+#else
+    return __builtin_clzll(x);
+#endif
+}
+
+/* ========== Powers of Five ========== */
+
+// 128-bit approximations of 5^q for q in [POW5_MIN, POW5_MAX], high word
+// first, normalized so the top bit is set: truncated for q >= 0, and the
+// reciprocal rounded up for q < 0 (the Eisel-Lemire table)
+static uint64_t pow5[(POW5_MAX - POW5_MIN + 1) * 2];
+static pthread_once_t setupOnce = PTHREAD_ONCE_INIT;
+
+#ifdef _WIN32
+static _locale_t cLocale;
+#else
+static locale_t cLocale;
+#endif
+
+static const double exactPowers[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Number of significant bits of a little-endian big integer
+ */
+static int bigBits(const uint32_t *x) {
+    int top = BIG_LIMBS - 1;
+    while (top > 0 && x[top] == 0) top--;
+    return x[top] == 0 ? 0 : top * 32 + 32 - leadingZeros32(x[top]);
+}
+
+/**
+ * The 128 most significant bits of a big integer, truncated (or shifted up
+ * when it has fewer)
+ */
+static void bigTop128(const uint32_t *x, uint64_t *out) {
+    int bits = bigBits(x);
+    out[0] = out[1] = 0;
+    for (int i = 0; i < 128; i++) {
+        int src = bits - 1 - i;
+        uint64_t bit = src >= 0 ? (x[src / 32] >> (src % 32)) & 1 : 0;
+        out[i / 64] = (out[i / 64] << 1) | bit;
+    }
+}
+
+static void bigMul5(uint32_t *x) {
+    uint64_t carry = 0;
+    for (int i = 0; i < BIG_LIMBS; i++) {
+        uint64_t v = (uint64_t)x[i] * 5 + carry;
+        x[i] = (uint32_t)v;
+        carry = v >> 32;
+    }
+}
+
+static void bigDiv5(uint32_t *x) {
+    uint64_t rest = 0;
+    for (int i = BIG_LIMBS - 1; i >= 0; i--) {
+        uint64_t v = (rest << 32) | x[i];
+        x[i] = (uint32_t)(v / 5);
+        rest = v % 5;
+    }
+}
+
+/**
+ * Build the power table with exact integer arithmetic, and the C locale
+ * for the strtod fallback
+ * floor(2^b / 5^k) is taken from floor(2^BIG_SHIFT / 5^k), divided down
+ * by 5 one power at a time, as floor(.. >> (BIG_SHIFT - b)): nested floors
+ * of integer divisions are exact.
+ */
+static void setupParser(void) {
+    uint32_t power[BIG_LIMBS] = { 1 };
+    for (int q = 0; q <= POW5_MAX; q++) {
+        bigTop128(power, &pow5[2 * (q - POW5_MIN)]);
+        bigMul5(power);
+    }
+
+    uint32_t reciprocal[BIG_LIMBS] = { 0 }, scaled[BIG_LIMBS];
+    reciprocal[BIG_SHIFT / 32] = 1u << (BIG_SHIFT % 32);
+    memset(power, 0, sizeof(power));
+    power[0] = 1;
+    for (int k = 1; k <= -POW5_MIN; k++) {
+        bigDiv5(reciprocal);
+        bigMul5(power);
+        int z = bigBits(power);                          // 2^(z-1) < 5^k < 2^z
+        int b = (k <= 27) ? z + 127 : 2 * z + 128;
+        int shift = BIG_SHIFT - b;
+
+        // scaled = (reciprocal >> shift) + 1
+        for (int i = 0; i < BIG_LIMBS; i++) {
+            int src = i + shift / 32;
+            uint64_t v = src < BIG_LIMBS ? reciprocal[src] : 0;
+            if (src + 1 < BIG_LIMBS) v |= (uint64_t)reciprocal[src + 1] << 32;
+            scaled[i] = (uint32_t)(v >> (shift % 32));
+        }
+        for (int i = 0; i < BIG_LIMBS && ++scaled[i] == 0; i++) {}
+        bigTop128(scaled, &pow5[2 * (-k - POW5_MIN)]);
+    }
+
+#ifdef _WIN32
+    cLocale = _create_locale(LC_NUMERIC, "C");
+#else
+    cLocale = newlocale(LC_NUMERIC_MASK, "C", (locale_t)0);
+#endif
+}
+
+/* ========== Number Parsing ========== */
+
+static inline int isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+/**
+ * Whether 8 bytes (little-endian) are all ASCII digits
+ */
+static inline int eightDigits(uint64_t v) {
+    return !(((v + 0x4646464646464646ull) | (v - 0x3030303030303030ull)) & 0x8080808080808080ull);
+}
+
+/**
+ * Value of 8 ASCII digits in one go: pairs, then quads, then the whole
+ */
+static inline uint32_t eightDigitValue(uint64_t v) {
+    v -= 0x3030303030303030ull;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000FF000000FFull) * 0x000F424000000064ull) +
+         (((v >> 16) & 0x000000FF000000FFull) * 0x0000271000000001ull)) >> 32;
+    return (uint32_t)v;
+}
+
+/**
+ * Correctly rounded w * 10^q with the Eisel-Lemire algorithm
+ * The 64-bit mantissa times the 128-bit power of five gives the leading
+ * bits of the exact product; they decide the rounding unless the truncated
+ * bits could still carry into them, which the checks below detect.
+ *
+ * @param w Decimal mantissa, not zero
+ * @param q Decimal exponent
+ * @param value Receives the double
+ * @return 1 on success, 0 when the caller must fall back to strtod
+ */
+static int eiselLemire(uint64_t w, int q, double *value) {
+    if (q < POW5_MIN || q > POW5_MAX) return 0;
+
+    int lz = leadingZeros64(w);
+    w <<= lz;
+    const uint64_t *t = &pow5[2 * (q - POW5_MIN)];
+    uint64_t lo;
+    uint64_t hi = multiply128(w, t[0], &lo);
+    if ((hi & 0x1FF) == 0x1FF) {
+        // The low bits we drop are all ones: bring in the rest of the power
+        uint64_t discarded;
+        uint64_t second = multiply128(w, t[1], &discarded);
+        lo += second;
+        if (second > lo) hi++;
+    }
+    if (lo == UINT64_MAX && (q < -27 || q > 55)) return 0;
+
+    int upper = (int)(hi >> 63);
+    int shift = upper + 9;                               // Keep 54 bits: 53 plus a rounding bit
+    uint64_t mantissa = hi >> shift;
+    int power2 = (((152170 + 65536) * q) >> 16) + 63 + upper - lz + 1023;
+    if (power2 <= 0) return 0;                           // Subnormal
+
+    // Exactly halfway between two doubles: round to even instead of up
+    if (lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 && (mantissa << shift) == hi) {
+        mantissa &= ~(uint64_t)1;
+    }
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= ((uint64_t)2 << 52)) {
+        mantissa = (uint64_t)1 << 52;
+        power2++;
+    }
+    if (power2 >= 0x7FF) return 0;                       // Overflow
+
+    uint64_t bits = (mantissa & (((uint64_t)1 << 52) - 1)) | ((uint64_t)power2 << 52);
+    memcpy(value, &bits, sizeof(bits));
+    return 1;
+}
+
+/**
+ * strtod in the C locale on a copy of the token [p, end)
+ *
+ * @return End of the number, or NULL if the token is not one
+ */
+static const char *parseFallback(const char *p, const char *end, double *value) {
+    char token[MAX_TOKEN];
+    size_t length = (size_t)(end - p);
+    if (length >= sizeof(token)) return NULL;
+    memcpy(token, p, length);
+    token[length] = '\0';
+
+    char *stop;
+#ifdef _WIN32
+    *value = _strtod_l(token, &stop, cLocale);
+#else
+    *value = strtod_l(token, &stop, cLocale);
+#endif
+    return (stop == token + length) ? end : NULL;
+}
+
+/**
+ * Parse one number at p, which must not be whitespace
+ * Accepts what strtod does in the C locale for the files' decimal notation:
+ * an optional sign, digits with an optional point, an optional exponent.
+ * The number must end at whitespace or at end.
+ *
+ * @param p First character
+ * @param end End of the text
+ * @param value Receives the number
+ * @return Just past the number, or NULL if p does not start a valid number
+ */
+const char *parseDouble(const char *p, const char *end, double *value) {
+    pthread_once(&setupOnce, setupParser);
+
+    const char *s = p;
+    int negative = 0;
+    if (s < end && (*s == '-' || *s == '+')) {
+        negative = (*s == '-');
+        s++;
+    }
+
+    // Up to 19 significant digits go into w; the point and any further
+    // zeros only move the exponent
+    uint64_t w = 0;
+    int digits = 0, exponent = 0, anyDigit = 0, truncated = 0;
+    for (; s < end && *s >= '0' && *s <= '9'; s++) {
+        anyDigit = 1;
+        if (digits < 19) {
+            w = w * 10 + (uint64_t)(*s - '0');
+            digits += (w != 0);
+        } else {
+            exponent++;
+            truncated |= (*s != '0');
+        }
+    }
+    if (s < end && *s == '.') {
+        for (s++; w == 0 && s < end && *s == '0'; s++) {
+            anyDigit = 1;
+            exponent--;
+        }
+        // The %.17g and %.18e digits, 8 at a time
+        uint64_t chunk;
+        while (digits <= 11 && end - s >= 8) {
+            memcpy(&chunk, s, 8);
+            if (!eightDigits(chunk)) break;
+            w = w * 100000000 + eightDigitValue(chunk);
+            digits += (w != 0) ? 8 : 0;
+            anyDigit = 1;
+            exponent -= 8;
+            s += 8;
+        }
+        for (; s < end && *s >= '0' && *s <= '9'; s++) {
+            anyDigit = 1;
+            if (digits < 19) {
+                w = w * 10 + (uint64_t)(*s - '0');
+                digits += (w != 0);
+                exponent--;
+            } else {
+                truncated |= (*s != '0');
+            }
+        }
+    }
+    if (s < end && anyDigit && (*s == 'e' || *s == 'E')) {
+        const char *e = s + 1;
+        int negativeExponent = 0, value10 = 0, exponentDigits = 0;
+        if (e < end && (*e == '-' || *e == '+')) {
+            negativeExponent = (*e == '-');
+            e++;
+        }
+        for (; e < end && *e >= '0' && *e <= '9'; e++, exponentDigits++) {
+            if (value10 < 100000) value10 = value10 * 10 + (*e - '0');
+        }
+        if (exponentDigits > 0) {
+            exponent += negativeExponent ? -value10 : value10;
+            s = e;
+        }
+    }
+
+    // The token must end here, or it is something else (inf, nan, hex, garbage)
+    const char *tokenEnd = s;
+    while (tokenEnd < end && !isSpace(*tokenEnd)) tokenEnd++;
+    if (!anyDigit || tokenEnd != s || truncated) {
+        return parseFallback(p, tokenEnd, value);
+    }
+
+    double v;
+    if (w == 0) {
+        v = 0.0;
+    } else if (w <= ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22) {
+        // Clinger: both operands are exact, so one rounding
+        v = exponent < 0 ? (double)w / exactPowers[-exponent] : (double)w * exactPowers[exponent];
+    } else if (!eiselLemire(w, exponent, &v)) {
+        return parseFallback(p, tokenEnd, value);
+    }
+    *value = negative ? -v : v;
+    return s;
+}
+
+/* ========== Text Matrices ========== */
+
+typedef struct TextJob {
+    const char *text;
+    size_t size;
+    size_t *first;             // Per chunk: numbers starting in it, then the index of its first one
+    size_t *errors;            // Per chunk: offset of an invalid number, or SIZE_MAX
+    double *values;
+    int rows, cols;
+    size_t stride;
+    int transposed;
+} TextJob;
+
+/**
+ * Pool task: count the numbers starting in chunks [begin, end)
+ */
+static void countChunks(void *arg, int begin, int end, int worker) {
+    (void) worker;
+    TextJob *job = arg;
+    for (int c = begin; c < end; c++) {
+        size_t a = (size_t)c * PARSE_CHUNK;
+        size_t b = a + PARSE_CHUNK < job->size ? a + PARSE_CHUNK : job->size;
+        size_t count = 0;
+        int inside = (a > 0) && !isSpace(job->text[a - 1]);
+        for (size_t i = a; i < b; i++) {
+            int space = isSpace(job->text[i]);
+            count += (!space && !inside);
+            inside = !space;
+        }
+        job->first[c] = count;
+    }
+}
+
+/**
+ * Pool task: parse the numbers starting in chunks [begin, end) into place
+ */
+static void parseChunks(void *arg, int begin, int end, int worker) {
+    (void) worker;
+    TextJob *job = arg;
+    const size_t total = (size_t)job->rows * job->cols;
+    const char *text = job->text, *stop = text + job->size;
+
+    for (int c = begin; c < end; c++) {
+        size_t a = (size_t)c * PARSE_CHUNK;
+        const char *p = text + a;
+        const char *limit = text + (a + PARSE_CHUNK < job->size ? a + PARSE_CHUNK : job->size);
+        size_t index = job->first[c];
+        int row = (int)(index / job->cols), col = (int)(index % job->cols);
+        job->errors[c] = SIZE_MAX;
+
+        // A number running in from the previous chunk is that chunk's
+        if (a > 0 && !isSpace(text[a - 1])) {
+            while (p < limit && !isSpace(*p)) p++;
+        }
+        for (;;) {
+            while (p < limit && isSpace(*p)) p++;
+            if (p >= limit || index >= total) break;
+
+            double v;
+            const char *next = parseDouble(p, stop, &v);
+            if (next == NULL) {
+                job->errors[c] = (size_t)(p - text);
+                break;
+            }
+            if (job->transposed) {
+                job->values[(size_t)col * job->stride + row] = v;
+            } else {
+                job->values[(size_t)row * job->stride + col] = v;
+            }
+            if (++col == job->cols) {
+                col = 0;
+                row++;
+            }
+            index++;
+            p = next;
+        }
+    }
+}
+
+/**
+ * Read a whitespace-separated text matrix in parallel
+ * The file must hold exactly rows x cols numbers, row by row (any
+ * whitespace between them). Value (r, c) goes to values[r * stride + c], or
+ * to values[c * stride + r] when transposed.
+ *
+ * @param path Text file
+ * @param values Destination
+ * @param rows Rows in the file
+ * @param cols Numbers per row in the file
+ * @param stride Elements between destination rows
+ * @param transposed Non-zero to store the file's rows as destination columns
+ * @return 0 on success, 1 on failure
+ */
+int readTextMatrix(const char *path, double *values, int rows, int cols, size_t stride, int transposed) {
+    MappedFile map;
+    if (mapFile(path, &map) != 0) {
+        return 1;
+    }
+    adviseFile(&map, 0, map.size, NN_ADVISE_WILLNEED);
+    pthread_once(&setupOnce, setupParser);
+
+    int chunks = (int)((map.size + PARSE_CHUNK - 1) / PARSE_CHUNK);
+    size_t *first = malloc(sizeof(size_t) * chunks * 2);
+    if (first == NULL) {
+        fprintf(stderr, "Memory allocation failed for %s\n", path);
+        unmapFile(&map);
+        return 1;
+    }
+    TextJob job = { (const char*)map.base, map.size, first, first + chunks, values, rows, cols, stride, transposed };
+
+    // Pass 1: where every chunk's numbers go
+    poolParallelFor(chunks, 1, countChunks, &job);
+    size_t count = 0;
+    for (int c = 0; c < chunks; c++) {
+        size_t n = first[c];
+        first[c] = count;
+        count += n;
+    }
+
+    // Pass 2: parse them there
+    int status = 0;
+    const size_t expected = (size_t)rows * cols;
+    if (count != expected) {
+        fprintf(stderr, "Error: %s has %zu numbers, expected %zu (%d x %d)\n", path, count, expected, rows, cols);
+        status = 1;
+    } else {
+        poolParallelFor(chunks, 1, parseChunks, &job);
+        for (int c = 0; c < chunks && status == 0; c++) {
+            if (job.errors[c] == SIZE_MAX) continue;
+            int line = 1;
+            for (size_t i = 0; i < job.errors[c]; i++) line += (job.text[i] == '\n');
+            fprintf(stderr, "Error: %s line %d: invalid number\n", path, line);
+            status = 1;
+        }
+    }
+
+    free(first);
+    unmapFile(&map);
+    return status;
+}
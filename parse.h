@@ -0,0 +1,28 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+/*
+ * Fast loading of the whitespace-separated text weight files (W<h>.txt,
+ * W<h>_transpose.txt, b<h>.txt).
+ *
+ * readTextMatrix() maps the file, cuts it into chunks and parses them on the
+ * thread pool in two passes: the first counts the numbers that start in each
+ * chunk, so every chunk knows the index of its first value, and the second
+ * parses them straight into the destination. A number belongs to the chunk
+ * its first character is in, so chunk boundaries need no adjusting.
+ *
+ * parseDouble() ignores the locale and is correctly rounded, like strtod in
+ * the C locale: Clinger's fast path covers short mantissas with small
+ * exponents, the Eisel-Lemire algorithm (128-bit powers of five) the %.17g
+ * and %.18e values the files hold, and the few inputs neither can decide
+ * (more than 19 digits, subnormals, inf/nan) go to strtod in the C locale.
+ */
+
+#include <stddef.h>
+
+/* ========== Function Declarations ========== */
+
+const char *parseDouble(const char *p, const char *end, double *value);
+int readTextMatrix(const char *path, double *values, int rows, int cols, size_t stride, int transposed);
+
+#endif // PARSE_H
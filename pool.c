@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#define _GNU_SOURCE   // pthread_setaffinity_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "pool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+/* ========== Pool State ========== */
+
+typedef struct Worker {
+    pthread_t thread;
+    pthread_mutex_t lock;    // Guards next and end
+    int next;                // First unclaimed item of this worker's range
+    int end;                 // One past the last unclaimed item
+    int index;
+} Worker;
+
+static struct {
+    Worker *workers;
+    int count;               // Workers including the calling thread, 0 when stopped
+    int pinCores;
+
+    pthread_mutex_t lock;    // Guards everything below
+    pthread_cond_t wake;     // A new loop was published or the pool is stopping
+    pthread_cond_t done;     // The last worker left the current loop
+    unsigned generation;     // Bumped for every published loop
+    int active;              // Workers that have not finished the current loop
+    int stopping;
+
+    PoolTask task;
+    void *arg;
+    int grain;
+} pool = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER,
+           .done = PTHREAD_COND_INITIALIZER };
+
+/* ========== Helpers ========== */
+
+/**
+ * Number of processors currently online
+ */
+int cpuCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+/**
+ * Pin the calling thread to one processor (best effort)
+ */
+static void pinToCore(int core) {
+#if defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (core % (int)(8 * sizeof(DWORD_PTR))));
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        fprintf(stderr, "Warning: could not pin thread to core %d\n", core);
+    }
+#else
+    (void) core;   // No portable affinity API
+#endif
+}
+
+/**
+ * Claim up to `grain` items from the front of a worker's range
+ *
+ * @return Number of items claimed (0 if the range is empty), first in *begin
+ */
+static int takeFront(Worker *w, int grain, int *begin) {
+    pthread_mutex_lock(&w->lock);
+    int taken = w->end - w->next;
+    if (taken > grain) taken = grain;
+    *begin = w->next;
+    w->next += taken;
+    pthread_mutex_unlock(&w->lock);
+    return taken;
+}
+
+/**
+ * Move the back half of another worker's range to `self`
+ * Victims are tried round-robin starting after self.
+ *
+ * @return 1 if something was stolen, 0 if every range is empty
+ */
+static int steal(Worker *self) {
+    for (int i = 1; i < pool.count; i++) {
+        Worker *victim = &pool.workers[(self->index + i) % pool.count];
+
+        pthread_mutex_lock(&victim->lock);
+        int left = victim->end - victim->next;
+        if (left <= 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        // A victim down to its last grain gives that grain up whole
+        int split = (left > pool.grain) ? victim->next + left / 2 : victim->next;
+        int end = victim->end;
+        victim->end = split;
+        pthread_mutex_unlock(&victim->lock);
+
+        pthread_mutex_lock(&self->lock);
+        self->next = split;
+        self->end = end;
+        pthread_mutex_unlock(&self->lock);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Work through the current loop: own range first, then stolen ones
+ */
+static void runLoop(Worker *self) {
+    int begin;
+    for (;;) {
+        int taken = takeFront(self, pool.grain, &begin);
+        if (taken > 0) {
+            pool.task(pool.arg, begin, begin + taken, self->index);
+        } else if (!steal(self)) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    if (--pool.active == 0) {
+        pthread_cond_signal(&pool.done);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static void *workerMain(void *p) {
+    Worker *self = p;
+    unsigned seen = 0;
+
+    if (pool.pinCores) {
+        pinToCore(self->index % cpuCount());
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+        while (pool.generation == seen && !pool.stopping) {
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        }
+        if (pool.stopping) break;
+        seen = pool.generation;
+        pthread_mutex_unlock(&pool.lock);
+
+        runLoop(self);
+
+        pthread_mutex_lock(&pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+/* ========== Pool Control ========== */
+
+/**
+ * Start the pool, replacing a running one
+ *
+ * @param threads Total threads including the caller; <= 0 uses every online core
+ * @param pinCores Non-zero to pin worker i (and the caller, as worker 0) to core i
+ * @return 0 on success, 1 on failure (the pool then runs loops on the caller alone)
+ */
+int poolStart(int threads, int pinCores) {
+    poolStop();
+    if (threads <= 0) threads = cpuCount();
+
+    pool.workers = calloc((size_t)threads, sizeof(Worker));
+    if (pool.workers == NULL) {
+        fprintf(stderr, "Memory allocation failed for thread pool\n");
+        return 1;
+    }
+    pool.pinCores = pinCores;
+    pool.stopping = 0;
+    pool.generation = 0;
+    pool.count = 1;
+
+    for (int i = 0; i < threads; i++) {
+        pool.workers[i].index = i;
+        pthread_mutex_init(&pool.workers[i].lock, NULL);
+    }
+    if (pinCores) {
+        pinToCore(0);
+    }
+
+    // Count only the workers that actually started
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&pool.workers[i].thread, NULL, workerMain, &pool.workers[i]) != 0) {
+            fprintf(stderr, "Error: could only start %d of %d threads\n", i, threads);
+            return 1;
+        }
+        pool.count = i + 1;
+    }
+    return 0;
+}
+
+/**
+ * Stop and join every worker thread
+ * Safe to call when the pool is not running
+ */
+void poolStop(void) {
+    if (pool.workers == NULL) return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = 1;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int i = 1; i < pool.count; i++) {
+        pthread_join(pool.workers[i].thread, NULL);
+    }
+    for (int i = 0; i < pool.count; i++) {
+        pthread_mutex_destroy(&pool.workers[i].lock);
+    }
+    free(pool.workers);
+    pool.workers = NULL;
+    pool.count = 0;
+}
+
+/**
+ * Threads a loop is spread over (1 when the pool is not running)
+ */
+int poolThreads(void) {
+    return pool.count > 0 ? pool.count : 1;
+}
+
+/**
+ * Run task over [0, count) on every worker and wait for it to finish
+ * Runs inline on the caller when the pool is not running or the loop is a
+ * single grain.
+ *
+ * @param count Number of items
+ * @param grain Items claimed per step; also the smallest range ever stolen
+ * @param task Called with disjoint item ranges covering [0, count)
+ * @param arg Passed to task unchanged
+ */
+void poolParallelFor(int count, int grain, PoolTask task, void *arg) {
+    if (count <= 0) return;
+    if (grain < 1) grain = 1;
+    if (pool.count <= 1 || count <= grain) {
+        task(arg, 0, count, 0);
+        return;
+    }
+
+    // Hand every worker an equal share before waking them
+    pthread_mutex_lock(&pool.lock);
+    pool.task = task;
+    pool.arg = arg;
+    pool.grain = grain;
+    for (int i = 0; i < pool.count; i++) {
+        Worker *w = &pool.workers[i];
+        pthread_mutex_lock(&w->lock);
+        w->next = (int)((long long)count * i / pool.count);
+        w->end = (int)((long long)count * (i + 1) / pool.count);
+        pthread_mutex_unlock(&w->lock);
+    }
+    pool.active = pool.count;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    runLoop(&pool.workers[0]);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.active > 0) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+}
@@ -0,0 +1,30 @@
+#ifndef POOL_H
+#define POOL_H
+
+/*
+ * Work-stealing thread pool for data-parallel loops.
+ *
+ * poolParallelFor() splits [0, count) evenly across the workers. Each worker
+ * takes `grain` items at a time from the front of its own range; a worker
+ * that runs dry steals the back half of the fullest-looking other range, so
+ * uneven tiles still finish together. The calling thread is worker 0, so a
+ * pool of N threads starts N - 1 extra threads.
+ *
+ * One loop runs at a time: poolParallelFor must not be called from inside a
+ * task, nor from two threads at once.
+ */
+
+/* ========== Data Structures ========== */
+
+// Process items [begin, end) on worker `worker` (0 .. poolThreads() - 1)
+typedef void (*PoolTask)(void *arg, int begin, int end, int worker);
+
+/* ========== Function Declarations ========== */
+
+int poolStart(int threads, int pinCores);
+void poolStop(void);
+int poolThreads(void);
+int cpuCount(void);
+void poolParallelFor(int count, int grain, PoolTask task, void *arg);
+
+#endif // POOL_H
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include "preprocess.h"
+#include "profile.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* ========== Bounding Box ========== */
+
+#ifdef __SSE2__
+// Bit i set if byte i of v is nonzero
+static inline int nonzeroMask(__m128i v) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) ^ 0xFFFF;
+}
+#endif
+
+/**
+ * First nonzero pixel of row[0, end)
+ *
+ * @return Its x, or end if there is none
+ */
+static int firstInRow(const unsigned char *row, int end) {
+    int x = 0;
+#ifdef __SSE2__
+    // 64 pixels per test while the row is blank
+    for (; x + 64 <= end; x += 64) {
+        const __m128i *p = (const __m128i*)(row + x);
+        __m128i v = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+                                 _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+        if (nonzeroMask(v) != 0) break;
+    }
+    for (; x + 16 <= end; x += 16) {
+        int mask = nonzeroMask(_mm_loadu_si128((const __m128i*)(row + x)));
+        if (mask != 0) return x + __builtin_ctz(mask);
+    }
+#endif
+    for (; x < end; x++) {
+        if (row[x] != 0) return x;
+    }
+    return end;
+}
+
+/**
+ * Last nonzero pixel of row[begin, width)
+ *
+ * @return Its x, or begin - 1 if there is none
+ */
+static int lastInRow(const unsigned char *row, int begin, int width) {
+    int x = width;
+#ifdef __SSE2__
+    for (; x - 64 >= begin; x -= 64) {
+        const __m128i *p = (const __m128i*)(row + x - 64);
+        __m128i v = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(p + 1)),
+                                 _mm_or_si128(_mm_loadu_si128(p + 2), _mm_loadu_si128(p + 3)));
+        if (nonzeroMask(v) != 0) break;
+    }
+    for (; x - 16 >= begin; x -= 16) {
+        int mask = nonzeroMask(_mm_loadu_si128((const __m128i*)(row + x - 16)));
+        if (mask != 0) return x - 16 + 31 - __builtin_clz(mask);
+    }
+#endif
+    while (--x >= begin) {
+        if (row[x] != 0) return x;
+    }
+    return begin - 1;
+}
+
+/**
+ * Find the smallest box holding every nonzero pixel
+ * Blank rows are found from the top and the bottom; between them each row
+ * only needs the pixels left of the box so far and right of it, so the
+ * drawing itself is mostly never read.
+ *
+ * @param pixels First row of a width x height 8-bit image
+ * @param stride Bytes from one row to the next; negative for a bottom-up image
+ * @param box Filled with the bounds
+ * @return 0 on success, 1 if the image is blank
+ */
+int digitBoundingBox(const unsigned char *pixels, int width, int height, ptrdiff_t stride, DigitBox *box) {
+    int top = 0, bottom = height - 1;
+    while (top < height && firstInRow(pixels + top * stride, width) == width) top++;
+    if (top == height) return 1;
+    while (firstInRow(pixels + bottom * stride, width) == width) bottom--;
+
+    int minX = width, maxX = -1;
+    for (int y = top; y <= bottom; y++) {
+        const unsigned char *row = pixels + y * stride;
+        minX = firstInRow(row, minX);
+        maxX = lastInRow(row, maxX + 1, width);
+    }
+    box->minX = minX;
+    box->minY = top;
+    box->maxX = maxX;
+    box->maxY = bottom;
+    return 0;
+}
+
+/* ========== Area Averaging ========== */
+
+#define SUM_ROWS 257   // Whole rows a 16-bit sum of 8-bit pixels holds
+
+/**
+ * sums[x] += row[x] for a source row a cell row covers whole
+ */
+static void addRow(uint16_t *sums, const unsigned char *row, int count) {
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= count; x += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + x));
+        __m128i *lo = (__m128i*)(sums + x), *hi = (__m128i*)(sums + x + 8);
+        _mm_storeu_si128(lo, _mm_add_epi16(_mm_loadu_si128(lo), _mm_unpacklo_epi8(v, zero)));
+        _mm_storeu_si128(hi, _mm_add_epi16(_mm_loadu_si128(hi), _mm_unpackhi_epi8(v, zero)));
+    }
+#endif
+    for (; x < count; x++) {
+        sums[x] += row[x];
+    }
+}
+
+/**
+ * acc[x] += weight * row[x] for a source row a cell row covers in part
+ * (at most two per cell row)
+ */
+static void accumulateRow(float *acc, const unsigned char *row, int count, float weight) {
+    int x = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 w = _mm_set1_ps(weight);
+    for (; x + 16 <= count; x += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + x));
+        __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+        __m128i parts[4] = {
+            _mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+            _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)
+        };
+        for (int k = 0; k < 4; k++) {
+            float *a = acc + x + 4 * k;
+            _mm_storeu_ps(a, _mm_add_ps(_mm_loadu_ps(a), _mm_mul_ps(w, _mm_cvtepi32_ps(parts[k]))));
+        }
+    }
+#endif
+    for (; x < count; x++) {
+        acc[x] += weight * row[x];
+    }
+}
+
+/**
+ * Move the 16-bit sums into the float ones and clear them
+ */
+static void flushSums(float *acc, uint16_t *sums, int count) {
+    for (int x = 0; x < count; x++) {
+        acc[x] += sums[x];
+        sums[x] = 0;
+    }
+}
+
+/**
+ * Overlap of the source pixel [i, i + 1) with [from, to)
+ */
+static inline float coverage(int i, double from, double to) {
+    double lo = i > from ? i : from, hi = i + 1 < to ? i + 1 : to;
+    return hi > lo ? (float)(hi - lo) : 0.0f;
+}
+
+/**
+ * Downsample a w x h region to cols x rows cells of scale x scale source
+ * pixels each; cells reaching past the region only average what they cover
+ *
+ * @param sums w 16-bit sums of scratch
+ * @param acc w floats of scratch
+ * @param cells rows x cols values in [0, 1]
+ */
+static void areaAverage(const unsigned char *region, int w, int h, ptrdiff_t stride, double scale,
+                        int cols, int rows, uint16_t *sums, float *acc, double *cells) {
+    memset(sums, 0, sizeof(uint16_t) * w);
+    const double norm = 1.0 / (scale * scale * 255.0);
+    for (int cy = 0; cy < rows; cy++) {
+        // Vertical: every source row the cell row covers, weighted by how much
+        double top = cy * scale, bottom = fmin((cy + 1) * scale, h);
+        memset(acc, 0, sizeof(float) * w);
+        int whole = 0;
+        for (int y = (int)top; y < bottom; y++) {
+            float weight = coverage(y, top, bottom);
+            if (weight != 1.0f) {
+                accumulateRow(acc, region + y * stride, w, weight);
+                continue;
+            }
+            addRow(sums, region + y * stride, w);
+            if (++whole == SUM_ROWS) {
+                // Only a cell taller than SUM_ROWS rows gets here
+                flushSums(acc, sums, w);
+                whole = 0;
+            }
+        }
+        flushSums(acc, sums, w);
+
+        // Horizontal: only w sums per cell row are left, and inside a cell they all weigh 1
+        for (int cx = 0; cx < cols; cx++) {
+            double left = cx * scale, right = fmin((cx + 1) * scale, w);
+            int first = (int)left, last = (int)ceil(right) - 1;
+            double sum;
+            if (first == last) {
+                sum = (right - left) * acc[first];
+            } else {
+                sum = (first + 1 - left) * acc[first] + (right - last) * acc[last];
+                for (int x = first + 1; x < last; x++) sum += acc[x];
+            }
+            cells[cy * cols + cx] = sum * norm;
+        }
+    }
+}
+
+/* ========== Preprocessing ========== */
+
+/**
+ * Turn a drawing into network input, MNIST style
+ * The digit's bounding box is fitted to NN_DIGIT_FIT pixels on its longer
+ * side by area averaging, then placed so its center of mass is at the
+ * middle of the NN_DIGIT_SIZE x NN_DIGIT_SIZE output (as far as the box
+ * stays inside it).
+ *
+ * @param pixels First row of a width x height 8-bit grayscale image, strokes bright on 0
+ * @param stride Bytes from one row to the next; negative for a bottom-up image
+ * @param out NN_DIGIT_SIZE * NN_DIGIT_SIZE values in [0, 1], row by row; all 0 for a blank image
+ * @return 0 on success, 1 on failure
+ */
+int preprocessDigit(const unsigned char *pixels, int width, int height, ptrdiff_t stride, double *out) {
+    PROFILE_BEGIN(preprocess);
+    memset(out, 0, sizeof(double) * NN_DIGIT_SIZE * NN_DIGIT_SIZE);
+
+    PROFILE_BEGIN(center);
+    DigitBox box;
+    int blank = digitBoundingBox(pixels, width, height, stride, &box);
+    PROFILE_END(center, NN_STAGE_CENTER, 0, (uint64_t)width * height);
+    if (blank) {
+        PROFILE_END(preprocess, NN_STAGE_PREPROCESS, 0, (uint64_t)width * height);
+        return 0;
+    }
+
+    // Fit the longer side to NN_DIGIT_FIT cells, keeping the aspect ratio
+    PROFILE_BEGIN(resize);
+    int w = box.maxX - box.minX + 1, h = box.maxY - box.minY + 1;
+    double scale = (double)(w > h ? w : h) / NN_DIGIT_FIT;
+    int cols = (int)ceil(w / scale - 1e-9), rows = (int)ceil(h / scale - 1e-9);
+    if (cols > NN_DIGIT_FIT) cols = NN_DIGIT_FIT;
+    if (rows > NN_DIGIT_FIT) rows = NN_DIGIT_FIT;
+
+    double cells[NN_DIGIT_FIT * NN_DIGIT_FIT];
+    float *acc = malloc((sizeof(float) + sizeof(uint16_t)) * w);
+    if (acc == NULL) {
+        fprintf(stderr, "Memory allocation failed for preprocessing\n");
+        return 1;
+    }
+    areaAverage(pixels + box.minY * stride + box.minX, w, h, stride, scale, cols, rows, (uint16_t*)(acc + w), acc, cells);
+    free(acc);
+    PROFILE_END(resize, NN_STAGE_RESIZE, 3 * (uint64_t)w * h, (uint64_t)w * h);
+
+    // Center of mass of the fitted digit, in cells
+    double mass = 0.0, sumX = 0.0, sumY = 0.0;
+    for (int y = 0; y < rows; y++) {
+        for (int x = 0; x < cols; x++) {
+            double v = cells[y * cols + x];
+            mass += v;
+            sumX += v * (x + 0.5);
+            sumY += v * (y + 0.5);
+        }
+    }
+    int left = (NN_DIGIT_SIZE - cols) / 2, top = (NN_DIGIT_SIZE - rows) / 2;
+    if (mass > 0.0) {
+        left = (int)lround(NN_DIGIT_SIZE / 2.0 - sumX / mass);
+        top = (int)lround(NN_DIGIT_SIZE / 2.0 - sumY / mass);
+    }
+    left = left < 0 ? 0 : (left > NN_DIGIT_SIZE - cols ? NN_DIGIT_SIZE - cols : left);
+    top = top < 0 ? 0 : (top > NN_DIGIT_SIZE - rows ? NN_DIGIT_SIZE - rows : top);
+
+    for (int y = 0; y < rows; y++) {
+        memcpy(out + (top + y) * NN_DIGIT_SIZE + left, cells + y * cols, sizeof(double) * cols);
+    }
+    PROFILE_END(preprocess, NN_STAGE_PREPROCESS, 0, (uint64_t)width * height);
+    return 0;
+}
+
+/**
+ * Preprocess count same-sized images stored back to back, e.g. a batch of
+ * scanned digits being ingested for inference or training
+ *
+ * @param pixels count images of width x height bytes each
+ * @param out count * NN_DIGIT_SIZE * NN_DIGIT_SIZE values, ready for feedForwardBatch
+ * @return 0 on success, 1 on failure
+ */
+int preprocessDigits(const unsigned char *pixels, size_t count, int width, int height, double *out) {
+    const size_t size = (size_t)width * height;
+    for (size_t i = 0; i < count; i++) {
+        if (preprocessDigit(pixels + i * size, width, height, width, out + i * NN_DIGIT_SIZE * NN_DIGIT_SIZE) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Convert RGBA pixels (e.g. a raylib canvas read back) to 8-bit luminance
+ * Integer BT.601 weights, so white stays 255; written so the compiler can
+ * vectorize it.
+ */
+void grayFromRgba(const unsigned char *rgba, size_t count, unsigned char *gray) {
+    for (size_t i = 0; i < count; i++) {
+        const unsigned char *p = rgba + 4 * i;
+        gray[i] = (unsigned char)((77u * p[0] + 150u * p[1] + 29u * p[2]) >> 8);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef PREPROCESS_H
+#define PREPROCESS_H
+
+/*
+ * Headless preprocessing of a drawn digit into network input, normalized the
+ * way MNIST was: the digit's bounding box is scaled (keeping its aspect
+ * ratio) so its longer side is 20 pixels, downsampled by area averaging,
+ * and placed in a 28x28 image so its center of mass lands on the middle.
+ *
+ * Input is a plain 8-bit grayscale buffer, bright strokes on a zero
+ * background, so the module needs no graphics library. The bounding box is
+ * found in one SSE2 pass that ORs each row and takes the per-column maximum
+ * 16 pixels at a time, and the downsampling only reads the box, accumulating
+ * whole source rows into float sums before it reduces them across. A
+ * 1000x1000 canvas takes tens of microseconds, most of it the one read of
+ * the image.
+ */
+
+#include <stddef.h>
+
+/* ========== Constants ========== */
+
+#define NN_DIGIT_SIZE 28   // Output is NN_DIGIT_SIZE x NN_DIGIT_SIZE
+#define NN_DIGIT_FIT  20   // Longer side of the digit once fitted
+
+/* ========== Data Structures ========== */
+
+// Inclusive bounds of the nonzero pixels
+typedef struct DigitBox {
+    int minX, minY;
+    int maxX, maxY;
+} DigitBox;
+
+/* ========== Function Declarations ========== */
+
+int digitBoundingBox(const unsigned char *pixels, int width, int height, ptrdiff_t stride, DigitBox *box);
+int preprocessDigit(const unsigned char *pixels, int width, int height, ptrdiff_t stride, double *out);
+int preprocessDigits(const unsigned char *pixels, size_t count, int width, int height, double *out);
+void grayFromRgba(const unsigned char *rgba, size_t count, unsigned char *gray);
+
+#endif // PREPROCESS_H
@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#define _GNU_SOURCE   // syscall
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "profile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+/* ========== Profile State ========== */
+
+#define PROFILE_SLOTS (NN_PROFILE_STAGES + NN_PROFILE_LAYERS)
+
+// Counter fields, in ProfileCounters order
+enum { FIELD_CALLS, FIELD_NANOSECONDS, FIELD_FLOPS, FIELD_BYTES,
+       FIELD_CYCLES, FIELD_CACHE_MISSES, FIELD_BRANCH_MISSES, PROFILE_FIELDS };
+
+// Counters of one thread. Only that thread adds to them; snapshots read
+// them concurrently, hence the relaxed atomics.
+typedef struct ProfileThread {
+    _Atomic uint64_t counters[PROFILE_SLOTS][PROFILE_FIELDS];
+    int perfGroup;                 // perf_event_open group leader, -1 if unavailable, -2 before trying
+    int perfEvents[2];             // Cache and branch misses in the group
+    struct ProfileThread *next;
+} ProfileThread;
+
+atomic_int nnProfileLevel = -1;
+
+static struct {
+    pthread_mutex_t lock;          // Guards everything below
+    pthread_once_t once;
+    ProfileThread *threads;        // Every thread that ever ran a bracket
+    ProfileSnapshot baseline;      // Totals at the last reset
+    uint64_t resetAt;              // Nanoseconds of the last reset
+    int hardware;                  // Some thread has opened its counters
+} profile = { .lock = PTHREAD_MUTEX_INITIALIZER, .once = PTHREAD_ONCE_INIT };
+
+static _Thread_local ProfileThread *self;
+
+static const char *stageNames[NN_PROFILE_STAGES] = {
+    "forward", "incremental", "batch", "softmax", "preprocess", "center", "resize"
+};
+
+/* ========== Helpers ========== */
+
+static uint64_t nowNanoseconds(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER count;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&count);
+    return (uint64_t)((double)count.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * Take the level from NN_PROFILE unless setProfiling came first
+ */
+static void readEnvironment(void) {
+    const char *want = getenv("NN_PROFILE");
+    int level = NN_PROFILE_OFF;
+    if (want != NULL && strcmp(want, "perf") == 0) {
+        level = NN_PROFILE_HARDWARE;
+    } else if (want != NULL && atoi(want) > 0) {
+        level = NN_PROFILE_TIMERS;
+    }
+    int unset = -1;
+    atomic_compare_exchange_strong(&nnProfileLevel, &unset, level);
+
+    pthread_mutex_lock(&profile.lock);
+    profile.resetAt = nowNanoseconds();
+    pthread_mutex_unlock(&profile.lock);
+}
+
+#ifdef __linux__
+static int openCounter(uint64_t config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);   // This thread, any CPU
+}
+#endif
+
+/**
+ * Open the calling thread's hardware counters as one group
+ * Leaves perfGroup at -1 when the kernel refuses any of them.
+ */
+static void openHardware(ProfileThread *t) {
+    t->perfGroup = -1;
+#ifdef __linux__
+    int group = openCounter(PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (group < 0) return;
+    t->perfEvents[0] = openCounter(PERF_COUNT_HW_CACHE_MISSES, group);
+    t->perfEvents[1] = openCounter(PERF_COUNT_HW_BRANCH_MISSES, group);
+    if (t->perfEvents[0] < 0 || t->perfEvents[1] < 0) {
+        if (t->perfEvents[0] >= 0) close(t->perfEvents[0]);
+        if (t->perfEvents[1] >= 0) close(t->perfEvents[1]);
+        close(group);
+        return;
+    }
+    t->perfGroup = group;
+    pthread_mutex_lock(&profile.lock);
+    profile.hardware = 1;
+    pthread_mutex_unlock(&profile.lock);
+#endif
+}
+
+/**
+ * Read the calling thread's cycles, cache misses and branch misses
+ */
+static void readHardware(ProfileThread *t, uint64_t values[3]) {
+    values[0] = values[1] = values[2] = 0;
+    if (t->perfGroup == -2) openHardware(t);
+#ifdef __linux__
+    struct { uint64_t count; uint64_t values[3]; } group;
+    if (t->perfGroup >= 0 && read(t->perfGroup, &group, sizeof(group)) == (ssize_t)sizeof(group)) {
+        memcpy(values, group.values, sizeof(group.values));
+    }
+#endif
+}
+
+/**
+ * Counters of the calling thread, registered on first use
+ *
+ * @return The counters, or NULL on allocation failure
+ */
+static ProfileThread *threadCounters(void) {
+    if (self != NULL) return self;
+
+    ProfileThread *t = calloc(1, sizeof(ProfileThread));
+    if (t == NULL) return NULL;
+    t->perfGroup = -2;
+    pthread_mutex_lock(&profile.lock);
+    t->next = profile.threads;
+    profile.threads = t;
+    pthread_mutex_unlock(&profile.lock);
+    self = t;
+    return t;
+}
+
+static void addCounter(ProfileThread *t, int slot, int field, uint64_t value) {
+    _Atomic uint64_t *c = &t->counters[slot][field];
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+/**
+ * Add a thread's counters of one slot to c
+ */
+static void sumCounters(ProfileCounters *c, ProfileThread *t, int slot) {
+    _Atomic uint64_t *v = t->counters[slot];
+    c->calls += atomic_load_explicit(&v[FIELD_CALLS], memory_order_relaxed);
+    c->nanoseconds += atomic_load_explicit(&v[FIELD_NANOSECONDS], memory_order_relaxed);
+    c->flops += atomic_load_explicit(&v[FIELD_FLOPS], memory_order_relaxed);
+    c->bytes += atomic_load_explicit(&v[FIELD_BYTES], memory_order_relaxed);
+    c->cycles += atomic_load_explicit(&v[FIELD_CYCLES], memory_order_relaxed);
+    c->cacheMisses += atomic_load_explicit(&v[FIELD_CACHE_MISSES], memory_order_relaxed);
+    c->branchMisses += atomic_load_explicit(&v[FIELD_BRANCH_MISSES], memory_order_relaxed);
+}
+
+static void subtractCounters(ProfileCounters *c, const ProfileCounters *base) {
+    c->calls -= base->calls;
+    c->nanoseconds -= base->nanoseconds;
+    c->flops -= base->flops;
+    c->bytes -= base->bytes;
+    c->cycles -= base->cycles;
+    c->cacheMisses -= base->cacheMisses;
+    c->branchMisses -= base->branchMisses;
+}
+
+static ProfileCounters *slotCounters(ProfileSnapshot *s, int slot) {
+    return slot < NN_PROFILE_STAGES ? &s->stages[slot] : &s->layers[slot - NN_PROFILE_STAGES];
+}
+
+/**
+ * Totals since the process started, called with the lock held
+ */
+static void totals(ProfileSnapshot *s) {
+    memset(s, 0, sizeof(*s));
+    for (ProfileThread *t = profile.threads; t != NULL; t = t->next) {
+        for (int slot = 0; slot < PROFILE_SLOTS; slot++) {
+            sumCounters(slotCounters(s, slot), t, slot);
+        }
+    }
+}
+
+/* ========== Control ========== */
+
+/**
+ * Turn profiling on or off
+ * Counters keep their values either way; see resetProfile.
+ *
+ * @param level NN_PROFILE_OFF, NN_PROFILE_TIMERS or NN_PROFILE_HARDWARE
+ * @return The previous level
+ */
+int setProfiling(int level) {
+    int previous = profilingLevel();
+    if (level < NN_PROFILE_OFF || level > NN_PROFILE_HARDWARE) level = NN_PROFILE_TIMERS;
+    atomic_store(&nnProfileLevel, level);
+    return previous;
+}
+
+/**
+ * Current profiling level, NN_PROFILE_* (reads NN_PROFILE on the first call)
+ */
+int profilingLevel(void) {
+    pthread_once(&profile.once, readEnvironment);
+    return atomic_load(&nnProfileLevel);
+}
+
+/**
+ * Start counting from zero
+ * Later snapshots only cover what ran after this call.
+ */
+void resetProfile(void) {
+    pthread_once(&profile.once, readEnvironment);
+    pthread_mutex_lock(&profile.lock);
+    totals(&profile.baseline);
+    profile.resetAt = nowNanoseconds();
+    pthread_mutex_unlock(&profile.lock);
+}
+
+/**
+ * Sum every thread's counters since the last reset
+ * Brackets still running on other threads are not included yet.
+ *
+ * @param s Filled in
+ */
+void profileSnapshot(ProfileSnapshot *s) {
+    int level = profilingLevel();
+    pthread_mutex_lock(&profile.lock);
+    totals(s);
+    for (int slot = 0; slot < PROFILE_SLOTS; slot++) {
+        subtractCounters(slotCounters(s, slot), slotCounters(&profile.baseline, slot));
+    }
+    s->seconds = (nowNanoseconds() - profile.resetAt) * 1e-9;
+    s->hardware = profile.hardware;
+    pthread_mutex_unlock(&profile.lock);
+    s->level = level;
+}
+
+/**
+ * Name of a stage, NULL if unknown
+ */
+const char *stageName(int stage) {
+    return (stage >= 0 && stage < NN_PROFILE_STAGES) ? stageNames[stage] : NULL;
+}
+
+/* ========== Brackets ========== */
+
+/**
+ * Open a bracket (see PROFILE_BEGIN)
+ * Clears mark->active when profiling is off.
+ */
+void profileStart(ProfileMark *mark) {
+    int level = atomic_load_explicit(&nnProfileLevel, memory_order_relaxed);
+    if (level < 0) level = profilingLevel();
+    ProfileThread *t = (level > NN_PROFILE_OFF) ? threadCounters() : NULL;
+    mark->active = (t != NULL) ? level : NN_PROFILE_OFF;
+    if (mark->active == NN_PROFILE_HARDWARE) {
+        readHardware(t, mark->hardware);
+    }
+    mark->start = nowNanoseconds();
+}
+
+/**
+ * Close a bracket and count it
+ *
+ * @param mark Opened by profileStart on this thread
+ * @param slot NN_STAGE_* or NN_PROFILE_LAYER(h)
+ * @param flops Floating-point operations done inside
+ * @param bytes Bytes of weights and activations moved inside
+ */
+void profileStop(const ProfileMark *mark, int slot, uint64_t flops, uint64_t bytes) {
+    uint64_t elapsed = nowNanoseconds() - mark->start;
+    ProfileThread *t = self;
+    if (t == NULL || slot < 0 || slot >= PROFILE_SLOTS) return;
+
+    addCounter(t, slot, FIELD_CALLS, 1);
+    addCounter(t, slot, FIELD_NANOSECONDS, elapsed);
+    addCounter(t, slot, FIELD_FLOPS, flops);
+    addCounter(t, slot, FIELD_BYTES, bytes);
+    if (mark->active == NN_PROFILE_HARDWARE && t->perfGroup >= 0) {
+        uint64_t now[3];
+        readHardware(t, now);
+        addCounter(t, slot, FIELD_CYCLES, now[0] - mark->hardware[0]);
+        addCounter(t, slot, FIELD_CACHE_MISSES, now[1] - mark->hardware[1]);
+        addCounter(t, slot, FIELD_BRANCH_MISSES, now[2] - mark->hardware[2]);
+    }
+}
+
+/* ========== Export ========== */
+
+static const char *levelName(int level) {
+    return level == NN_PROFILE_HARDWARE ? "perf" : level == NN_PROFILE_TIMERS ? "timers" : "off";
+}
+
+/**
+ * One counter set as the fields of a JSON object
+ */
+static void writeJsonCounters(FILE *f, const ProfileCounters *c, int hardware) {
+    double seconds = c->nanoseconds * 1e-9;
+    fprintf(f, "\"calls\": %llu, \"seconds\": %.9f, \"mean_us\": %.3f, \"flops\": %llu, \"bytes\": %llu, "
+               "\"gflops\": %.3f, \"gbytes_per_s\": %.3f",
+            (unsigned long long)c->calls, seconds, c->calls ? seconds * 1e6 / c->calls : 0.0,
+            (unsigned long long)c->flops, (unsigned long long)c->bytes,
+            seconds > 0 ? c->flops / seconds * 1e-9 : 0.0, seconds > 0 ? c->bytes / seconds * 1e-9 : 0.0);
+    if (hardware) {
+        fprintf(f, ", \"cycles\": %llu, \"cache_misses\": %llu, \"branch_misses\": %llu",
+                (unsigned long long)c->cycles, (unsigned long long)c->cacheMisses,
+                (unsigned long long)c->branchMisses);
+    }
+}
+
+/**
+ * Write a snapshot as a JSON object
+ * Stages and layers that never ran are left out.
+ *
+ * @return 0 on success, 1 on a write error
+ */
+int writeProfileJson(FILE *f, const ProfileSnapshot *s) {
+    fprintf(f, "{\n  \"level\": \"%s\",\n  \"hardware\": %s,\n  \"seconds\": %.6f,\n  \"stages\": [\n",
+            levelName(s->level), s->hardware ? "true" : "false", s->seconds);
+    int first = 1;
+    for (int i = 0; i < NN_PROFILE_STAGES; i++) {
+        if (s->stages[i].calls == 0) continue;
+        fprintf(f, "%s    { \"stage\": \"%s\", ", first ? "" : ",\n", stageNames[i]);
+        writeJsonCounters(f, &s->stages[i], s->hardware);
+        fprintf(f, " }");
+        first = 0;
+    }
+    fprintf(f, "%s  ],\n  \"layers\": [\n", first ? "" : "\n");
+    first = 1;
+    for (int h = 1; h < NN_PROFILE_LAYERS; h++) {
+        if (s->layers[h].calls == 0) continue;
+        fprintf(f, "%s    { \"layer\": %d, ", first ? "" : ",\n", h);
+        writeJsonCounters(f, &s->layers[h], s->hardware);
+        fprintf(f, " }");
+        first = 0;
+    }
+    fprintf(f, "%s  ]\n}\n", first ? "" : "\n");
+    return ferror(f) ? 1 : 0;
+}
+
+/**
+ * One counter of a set as a Prometheus sample value
+ */
+static void writePrometheusValue(FILE *f, const ProfileCounters *c, size_t field, double scale) {
+    uint64_t v = *(const uint64_t*)((const char*)c + field);
+    if (scale == 1) {
+        fprintf(f, "%llu\n", (unsigned long long)v);
+    } else {
+        fprintf(f, "%.9f\n", v * scale);
+    }
+}
+
+/**
+ * One Prometheus metric family over every stage and layer that ran
+ *
+ * @param field Offset of the counter in ProfileCounters
+ * @param scale Factor applied to the counter (1e-9 turns nanoseconds into seconds)
+ */
+static void writePrometheusFamily(FILE *f, const ProfileSnapshot *s, const char *name, const char *help,
+                                  size_t field, double scale) {
+    fprintf(f, "# HELP nn_%s %s\n# TYPE nn_%s counter\n", name, help, name);
+    for (int i = 0; i < NN_PROFILE_STAGES; i++) {
+        if (s->stages[i].calls == 0) continue;
+        fprintf(f, "nn_%s{stage=\"%s\"} ", name, stageNames[i]);
+        writePrometheusValue(f, &s->stages[i], field, scale);
+    }
+    for (int h = 1; h < NN_PROFILE_LAYERS; h++) {
+        if (s->layers[h].calls == 0) continue;
+        fprintf(f, "nn_%s{stage=\"layer\",layer=\"%d\"} ", name, h);
+        writePrometheusValue(f, &s->layers[h], field, scale);
+    }
+}
+
+/**
+ * Write a snapshot in the Prometheus text exposition format
+ * Every metric is a counter labelled by stage, and by layer for the dense
+ * layers, so dashboards can rate() them.
+ *
+ * @return 0 on success, 1 on a write error
+ */
+int writeProfilePrometheus(FILE *f, const ProfileSnapshot *s) {
+    fprintf(f, "# HELP nn_profile_level Profiling level: 0 off, 1 timers, 2 hardware counters\n"
+               "# TYPE nn_profile_level gauge\nnn_profile_level %d\n", s->level);
+    writePrometheusFamily(f, s, "calls_total", "Bracketed calls", offsetof(ProfileCounters, calls), 1);
+    writePrometheusFamily(f, s, "seconds_total", "Wall time inside the calls",
+                          offsetof(ProfileCounters, nanoseconds), 1e-9);
+    writePrometheusFamily(f, s, "flops_total", "Floating-point operations, a multiply-add counting two",
+                          offsetof(ProfileCounters, flops), 1);
+    writePrometheusFamily(f, s, "bytes_total", "Bytes of weights and activations moved",
+                          offsetof(ProfileCounters, bytes), 1);
+    if (s->hardware) {
+        writePrometheusFamily(f, s, "cycles_total", "CPU cycles in user space",
+                              offsetof(ProfileCounters, cycles), 1);
+        writePrometheusFamily(f, s, "cache_misses_total", "Last-level cache misses",
+                              offsetof(ProfileCounters, cacheMisses), 1);
+        writePrometheusFamily(f, s, "branch_misses_total", "Mispredicted branches",
+                              offsetof(ProfileCounters, branchMisses), 1);
+    }
+    return ferror(f) ? 1 : 0;
+}
+
+/**
+ * Write a snapshot to a file, as JSON if the name ends in .json and as
+ * Prometheus text otherwise
+ *
+ * @return 0 on success, 1 on failure
+ */
+int writeProfileFile(const char *path, const ProfileSnapshot *s) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror("Error creating profile file");
+        return 1;
+    }
+    size_t length = strlen(path);
+    int json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+    int status = json ? writeProfileJson(f, s) : writeProfilePrometheus(f, s);
+    if (fclose(f) != 0) status = 1;
+    if (status != 0) printf("Error writing %s\n", path);
+    return status;
+}
@@ -0,0 +1,114 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/*
+ * Built-in instrumentation of the inference hot paths.
+ *
+ * Every dense layer and a few stages (whole forward passes, softmax, the
+ * digit preprocessing) are bracketed by PROFILE_BEGIN/PROFILE_END. While
+ * profiling is on, each bracket adds its call, its wall time and the FLOPs
+ * and bytes the caller states to counters owned by the calling thread, so
+ * pool workers never share a cache line; profileSnapshot() sums them. With
+ * hardware counters on, every thread also opens one perf_event_open group
+ * (cycles, cache misses, branch misses) and each bracket reads it twice.
+ * That costs a system call per read, so it is for finding out where cycles
+ * go, not for leaving on. Hardware counters are Linux-only; where they cannot
+ * be opened (another OS, perf_event_paranoid, a container) they read 0.
+ *
+ * Profiling starts off unless NN_PROFILE=1 (timers) or NN_PROFILE=perf
+ * (timers and hardware counters) is set, or setProfiling() turns it on;
+ * while off, a bracket costs one load and a branch. Building with
+ * -DNN_PROFILE=0 removes the brackets altogether.
+ *
+ * FLOPs count a multiply-add as two. Bytes are the weights and activations
+ * a layer reads and writes at its precision, a lower bound on its traffic.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#ifndef NN_PROFILE
+#define NN_PROFILE 1             // 0 compiles the brackets out
+#endif
+
+/* ========== Constants ========== */
+
+#define NN_PROFILE_OFF      0
+#define NN_PROFILE_TIMERS   1    // Wall time, FLOPs and bytes
+#define NN_PROFILE_HARDWARE 2    // Also cycles, cache misses and branch misses
+
+#define NN_PROFILE_LAYERS 64     // Layers counted separately; deeper ones share the last
+
+// Stages
+#define NN_STAGE_FORWARD     0   // Single-sample forward pass (feedForward, contextForward)
+#define NN_STAGE_INCREMENTAL 1   // Incremental forward pass
+#define NN_STAGE_BATCH       2   // Batched forward pass, softmax included
+#define NN_STAGE_SOFTMAX     3   // softmax() calls
+#define NN_STAGE_PREPROCESS  4   // Canvas to network input, all of it
+#define NN_STAGE_CENTER      5   // Cropping and centering the drawing
+#define NN_STAGE_RESIZE      6   // Downsampling to 28x28
+#define NN_PROFILE_STAGES    7
+
+// Counter slot of a stage is the stage itself; dense layer h has its own
+#define NN_PROFILE_LAYER(h) (NN_PROFILE_STAGES + ((h) < NN_PROFILE_LAYERS ? (h) : NN_PROFILE_LAYERS - 1))
+
+/* ========== Data Structures ========== */
+
+typedef struct ProfileCounters {
+    uint64_t calls;
+    uint64_t nanoseconds;
+    uint64_t flops;
+    uint64_t bytes;
+    uint64_t cycles;          // Hardware counters, 0 unless enabled
+    uint64_t cacheMisses;
+    uint64_t branchMisses;
+} ProfileCounters;
+
+typedef struct ProfileSnapshot {
+    int level;                // NN_PROFILE_* when taken
+    int hardware;             // Non-zero if hardware counters could be opened
+    double seconds;           // Since profiling was last reset
+    ProfileCounters stages[NN_PROFILE_STAGES];
+    ProfileCounters layers[NN_PROFILE_LAYERS];   // layers[h] for dense layer h, [0] unused
+} ProfileSnapshot;
+
+// Start of a bracket, on the caller's stack
+typedef struct ProfileMark {
+    int active;               // NN_PROFILE_* level the bracket was opened at
+    uint64_t start;           // Nanoseconds
+    uint64_t hardware[3];
+} ProfileMark;
+
+extern atomic_int nnProfileLevel;   // NN_PROFILE_*, -1 until NN_PROFILE has been read
+
+/* ========== Function Declarations ========== */
+
+int setProfiling(int level);
+int profilingLevel(void);
+void resetProfile(void);
+void profileSnapshot(ProfileSnapshot *snapshot);
+int writeProfileJson(FILE *f, const ProfileSnapshot *snapshot);
+int writeProfilePrometheus(FILE *f, const ProfileSnapshot *snapshot);
+int writeProfileFile(const char *path, const ProfileSnapshot *snapshot);
+const char *stageName(int stage);
+void profileStart(ProfileMark *mark);
+void profileStop(const ProfileMark *mark, int slot, uint64_t flops, uint64_t bytes);
+
+/* ========== Brackets ========== */
+
+#if NN_PROFILE
+// Open a bracket named mark in the current scope
+#define PROFILE_BEGIN(mark) \
+    ProfileMark mark; \
+    mark.active = atomic_load_explicit(&nnProfileLevel, memory_order_relaxed) != 0; \
+    if (mark.active) profileStart(&mark)
+// Close it, counting it under slot (NN_STAGE_* or NN_PROFILE_LAYER(h))
+#define PROFILE_END(mark, slot, flops, bytes) \
+    do { if (mark.active) profileStop(&mark, (slot), (flops), (bytes)); } while (0)
+#else
+#define PROFILE_BEGIN(mark) do { } while (0)
+#define PROFILE_END(mark, slot, flops, bytes) do { } while (0)
+#endif
+
+#endif // PROFILE_H
@@ -0,0 +1,82 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+/*
+ * Wire protocol of the inference daemon (serve.c) over a Unix domain socket.
+ *
+ * Every message is a 16-byte header followed by `length` payload bytes, in
+ * native byte order (client and daemon always share a machine). A connection
+ * carries one request at a time; clients wanting concurrency open several.
+ *
+ *   PREDICT_F64   payload: inputs doubles in [0, 1]
+ *   PREDICT_U8    payload: inputs bytes 0-255 (a raw 28x28 image), scaled by 1/255
+ *   STATS         no payload; the reply carries a ServeStats
+ *   RELOAD        no payload; the daemon reloads its model file and replies
+ *                 once the new model is serving (NN_STATUS_FAILED: it kept the old one)
+ *   METRICS       no payload; the reply carries the statistics and the profile
+ *                 (profile.h) as Prometheus text, or the profile as JSON with
+ *                 NN_FLAG_JSON
+ *
+ * A PREDICT reply carries the predicted class in `value`; with
+ * NN_FLAG_PROBABILITIES set it also carries the softmax of every class as
+ * floats.
+ */
+
+#include <stdint.h>
+
+/* ========== Constants ========== */
+
+#define NN_REQUEST_MAGIC   0x51524e4eu   // "NNRQ"
+#define NN_RESPONSE_MAGIC  0x53524e4eu   // "NNRS"
+
+#define NN_REQ_PREDICT_F64 1
+#define NN_REQ_PREDICT_U8  2
+#define NN_REQ_STATS       3
+#define NN_REQ_RELOAD      4
+#define NN_REQ_METRICS     5
+
+#define NN_FLAG_PROBABILITIES 0x01   // Reply with every class probability
+#define NN_FLAG_JSON          0x02   // METRICS: reply with the profile as JSON
+
+#define NN_STATUS_OK         0
+#define NN_STATUS_BAD        1   // Malformed request or wrong input size
+#define NN_STATUS_OVERLOADED 2   // Queue full, try again later
+#define NN_STATUS_FAILED     3   // The daemon could not carry out the request
+
+#define NN_SERVE_BUCKETS 12      // Batch-size histogram: 1, 2-3, 4-7, ..., 2048+
+
+/* ========== Data Structures ========== */
+
+typedef struct RequestHeader {
+    uint32_t magic;        // NN_REQUEST_MAGIC
+    uint8_t type;          // NN_REQ_*
+    uint8_t flags;         // NN_FLAG_*
+    uint16_t reserved;
+    uint32_t id;           // Echoed in the reply
+    uint32_t length;       // Payload bytes
+} RequestHeader;
+
+typedef struct ResponseHeader {
+    uint32_t magic;        // NN_RESPONSE_MAGIC
+    uint8_t status;        // NN_STATUS_*
+    uint8_t reserved;
+    uint16_t value;        // Predicted class
+    uint32_t id;           // Id of the request
+    uint32_t length;       // Payload bytes
+} ResponseHeader;
+
+typedef struct ServeStats {
+    uint64_t requests;         // Predictions answered
+    uint64_t rejected;         // Predictions refused with NN_STATUS_OVERLOADED
+    uint64_t batches;          // Forward passes run
+    uint64_t queueDepth;       // Predictions waiting right now
+    uint64_t maxQueueDepth;    // Most predictions ever waiting at once
+    uint64_t maxBatch;         // Largest batch run
+    uint64_t queueMicros;      // Summed time predictions waited for their batch
+    uint64_t inferenceMicros;  // Summed time of the forward passes
+    uint64_t connections;      // Clients connected right now
+    uint64_t batchSizes[NN_SERVE_BUCKETS];   // Batches per size bucket
+    uint64_t reloads;          // Models loaded since startup by reloads
+} ServeStats;
+
+#endif // PROTOCOL_H
@@ -0,0 +1,282 @@
+// Program to prune the smallest weights of a network, check the accuracy it
+// keeps on a labelled set and save it with the pruned layers in CSR form
+//
+// usage: prune [-m model.nnb] [-s sparsity | -t threshold | -d drop] [-l layers] [-o out.nnb] images.idx labels.idx
+//   -m  binary model to prune (default: the text files, like main.c)
+//   -s  fraction of each pruned layer's weights to zero, e.g. 0.9
+//   -t  zero the weights smaller than this in magnitude instead
+//   -d  try sparsities from 50% to 95% in steps of 5% and keep the highest
+//       that loses at most this many points of accuracy (default 1.0)
+//   -l  layers to prune, e.g. 1,2 (default: every layer but the output layer)
+//   -o  model file to write (default pruned.nnb)
+//
+// Prints the accuracy, speed and weight bytes of the dense network and of
+// every candidate. Layers left with at most NN_CSR_DENSITY of their weights
+// are stored and run as CSR (see sparse.h); loadNetwork picks them up.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "nn.h"
+#include "idx.h"
+#include "model.h"
+#include "sparse.h"
+
+#define CHUNK 1024        // Samples converted and scored at a time
+#define MAX_LAYERS 64
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Accuracy and speed of one candidate
+typedef struct Score {
+    double accuracy;      // Percent of the set
+    double batchRate;     // Images per second through contextForwardBatch
+    double singleTime;    // Seconds per contextForward
+    size_t weightBytes;   // Bytes a forward pass reads
+} Score;
+
+/**
+ * Score layers on the data set with a fresh fp64 model
+ *
+ * @return 0 on success, 1 on failure
+ */
+static int scoreLayers(const Layer *layers, const IdxFile *images, const IdxFile *labels, Score *score) {
+    NetworkModel *model = createNetworkModel(layers, n, NN_PRECISION_FP64);
+    if (model == NULL) return 1;
+    NetworkContext *context = createNetworkContext(model);
+    releaseNetworkModel(model);   // The context holds the reference now
+    const int inSize = layers[0].size;
+    const int outSize = layers[n-1].size;
+    double *inputs = malloc(sizeof(double) * CHUNK * inSize);
+    double *outputs = malloc(sizeof(double) * CHUNK * outSize);
+    if (context == NULL || inputs == NULL || outputs == NULL) {
+        printf("Error: out of memory\n");
+        freeNetworkContext(context);
+        free(inputs);
+        free(outputs);
+        return 1;
+    }
+
+    size_t correct = 0, singles = 0;
+    double batchTime = 0.0, singleTime = 0.0;
+    for (size_t start = 0; start < images->count; start += CHUNK) {
+        int count = (int)((images->count - start < CHUNK) ? images->count - start : CHUNK);
+        idxToInput(images->data + start * images->itemSize, (size_t)count * inSize, inputs);
+
+        double t0 = nowSeconds();
+        if (contextForwardBatch(context, inputs, count, outputs, 0) != 0) {
+            count = 0;
+        }
+        double t1 = nowSeconds();
+        batchTime += t1 - t0;
+
+        for (int b = 0; b < count; b++) {
+            const double *row = outputs + (size_t)b * outSize;
+            int pred = 0;
+            for (int o = 1; o < outSize; o++) {
+                if (row[o] > row[pred]) pred = o;
+            }
+            correct += (pred == labels->data[start + b]);
+        }
+
+        // Single samples as the GUI runs them, on the first chunk
+        if (start == 0) {
+            double t2 = nowSeconds();
+            for (int b = 0; b < count; b++) {
+                contextForward(context, inputs + (size_t)b * inSize);
+            }
+            singleTime = nowSeconds() - t2;
+            singles = (size_t)count;
+        }
+    }
+
+    score->accuracy = 100.0 * correct / images->count;
+    score->batchRate = images->count / batchTime;
+    score->singleTime = singles ? singleTime / singles : 0.0;
+    score->weightBytes = networkModelWeightBytes(model);
+    freeNetworkContext(context);
+    free(inputs);
+    free(outputs);
+    return 0;
+}
+
+static void printScore(const char *name, const Score *s) {
+    printf("%-14s %8.2f%% %12.0f %10.2f %12.1f\n", name, s->accuracy, s->batchRate, s->singleTime * 1e6,
+           s->weightBytes / 1024.0);
+}
+
+/**
+ * Copy the chosen layers of dense into pruned and prune them
+ * With sparsity >= 0 every chosen layer loses that fraction of its weights,
+ * otherwise the weights below threshold.
+ *
+ * @return 0 on success, 1 on failure
+ */
+static int pruneLayers(const Layer *dense, Layer *pruned, const int *chosen, double sparsity, double threshold) {
+    for (int h = 1; h < n; h++) {
+        const Layer *l = &dense[h];
+        memcpy(pruned[h].weights, l->weights, sizeof(double) * (size_t)l->size * l->stride);
+        if (!chosen[h]) continue;
+        double t = sparsity >= 0 ? pruneThreshold(l, sparsity) : threshold;
+        if (t < 0) return 1;
+        pruneLayer(&pruned[h], t);
+    }
+    return 0;
+}
+
+/**
+ * Parse a comma-separated list of layer numbers into chosen[]
+ *
+ * @return 0 on success, 1 if a number is not a dense layer
+ */
+static int parseLayers(const char *list, int *chosen) {
+    const char *p = list;
+    while (*p != '\0') {
+        char *end;
+        long h = strtol(p, &end, 10);
+        if (end == p || h < 1 || h >= n) return 1;
+        chosen[h] = 1;
+        p = (*end == ',') ? end + 1 : end;
+        if (*end != ',' && *end != '\0') return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *modelPath = NULL, *out = "pruned.nnb", *layerList = NULL;
+    const char *paths[2] = { NULL, NULL };
+    double sparsity = -1.0, threshold = -1.0, drop = 1.0;
+    int positional = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            modelPath = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            sparsity = atof(argv[++i]);
+            if (sparsity < 0 || sparsity > 1) positional = -1;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+            if (threshold < 0) positional = -1;
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            drop = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            layerList = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (argv[i][0] != '-' && positional >= 0 && positional < 2) {
+            paths[positional++] = argv[i];
+        } else {
+            positional = -1;
+            break;
+        }
+    }
+    if (positional != 2 || (sparsity >= 0 && threshold >= 0)) {
+        printf("usage: %s [-m model.nnb] [-s sparsity | -t threshold | -d drop] [-l layers] [-o out.nnb] "
+               "images.idx labels.idx\n", argv[0]);
+        return 1;
+    }
+
+    // --- Load the model and the data set ---
+    setNetworkPrecision(NN_PRECISION_FP64);
+    if (modelPath != NULL) {
+        if (loadNetwork(modelPath) != 0) return 1;
+    } else {
+        initializeNetwork(network_structure, n);
+        if (importNetwork() != 0) return 1;
+    }
+
+    int chosen[MAX_LAYERS] = { 0 };
+    if (n > MAX_LAYERS) {
+        printf("Error: at most %d layers\n", MAX_LAYERS);
+        return 1;
+    }
+    if (layerList != NULL) {
+        if (parseLayers(layerList, chosen) != 0) {
+            printf("Error: layers must be between 1 and %d\n", n - 1);
+            return 1;
+        }
+    } else {
+        for (int h = 1; h < n - 1; h++) chosen[h] = 1;
+        if (n == 2) chosen[1] = 1;
+    }
+
+    IdxFile images, labels;
+    if (openIdx(paths[0], &images) != 0) return 1;
+    if (openIdx(paths[1], &labels) != 0) return 1;
+    if (images.itemSize != (size_t)Network[0].size || labels.count < images.count) {
+        printf("Error: data set does not match the network input (%zu pixels, %zu labels)\n",
+               images.itemSize, labels.count);
+        return 1;
+    }
+
+    // Pruned copies of the weights; biases and activations are shared with Network
+    Layer pruned[MAX_LAYERS];
+    for (int h = 0; h < n; h++) {
+        pruned[h] = Network[h];
+        if (h == 0) continue;
+        pruned[h].weights = alignedAlloc(sizeof(double) * (size_t)Network[h].size * Network[h].stride);
+        if (pruned[h].weights == NULL) {
+            printf("Error: out of memory\n");
+            return 1;
+        }
+    }
+
+    // --- Score the dense network and the candidates ---
+    printf("\n%-14s %9s %12s %10s %12s\n", "sparsity", "accuracy", "batch img/s", "single us", "weights KB");
+    Score dense, score;
+    if (scoreLayers(Network, &images, &labels, &dense) != 0) return 1;
+    printScore("dense", &dense);
+
+    if (sparsity < 0 && threshold < 0) {
+        // Highest sparsity within the allowed accuracy drop
+        double best = 0.0;
+        for (int step = 10; step <= 19; step++) {
+            double s = step * 0.05;
+            char name[32];
+            if (pruneLayers(Network, pruned, chosen, s, 0.0) != 0) return 1;
+            if (scoreLayers(pruned, &images, &labels, &score) != 0) return 1;
+            snprintf(name, sizeof(name), "%.0f%%", s * 100.0);
+            printScore(name, &score);
+            if (dense.accuracy - score.accuracy <= drop) best = s;
+        }
+        if (best == 0.0) {
+            printf("\nNo sparsity from 50%% keeps the accuracy within %.2f points\n", drop);
+            return 1;
+        }
+        sparsity = best;
+    }
+
+    if (pruneLayers(Network, pruned, chosen, sparsity, threshold) != 0) return 1;
+    if (scoreLayers(pruned, &images, &labels, &score) != 0) return 1;
+
+    // --- Report and save ---
+    printf("\n--- Pruned on %zu samples ---\n", images.count);
+    for (int h = 1; h < n; h++) {
+        size_t total = (size_t)pruned[h].size * pruned[h].inputs;
+        size_t kept = countNonzeros(&pruned[h]);
+        printf("Layer %d:     %zu of %zu weights kept (%.1f%% sparse)%s\n", h, kept, total,
+               100.0 * (total - kept) / total, kept <= NN_CSR_DENSITY * total ? ", stored as CSR" : "");
+    }
+    printf("Accuracy:    %.2f%% -> %.2f%% (%+.2f)\n", dense.accuracy, score.accuracy,
+           score.accuracy - dense.accuracy);
+    printf("Weights:     %.1f KB -> %.1f KB (%.1fx smaller)\n", dense.weightBytes / 1024.0,
+           score.weightBytes / 1024.0, (double)dense.weightBytes / score.weightBytes);
+    printf("Throughput:  %.0f -> %.0f images/s batched (%.1fx)\n", dense.batchRate, score.batchRate,
+           score.batchRate / dense.batchRate);
+    printf("Latency:     %.2f -> %.2f us per image (%.1fx)\n", dense.singleTime * 1e6, score.singleTime * 1e6,
+           dense.singleTime / score.singleTime);
+
+    int status = writeModelFile(out, pruned, n, NN_LAYOUT_ROWS, NN_CSR_DENSITY);
+    if (status == 0) printf("Wrote %s\n", out);
+
+    for (int h = 1; h < n; h++) alignedFree(pruned[h].weights);
+    closeIdx(&images);
+    closeIdx(&labels);
+    freeNetwork();
+    return status;
+}
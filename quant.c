@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "quant.h"
+#include "kernels.h"
+
+/* ========== Helpers ========== */
+
+static size_t alignUp(size_t bytes) {
+    return (bytes + NN_ALIGN - 1) & ~(size_t)(NN_ALIGN - 1);
+}
+
+static int clampInt(long v, int lo, int hi) {
+    return v < lo ? lo : (v > hi ? hi : (int)v);
+}
+
+/**
+ * Quantize one weight row to int8 with its own scale and zero point
+ */
+static void quantizeRow(const double *w, int inputs, int8_t *q, double *scale, int32_t *zero, int32_t *rowSum) {
+    double lo = w[0], hi = w[0];
+    for (int k = 1; k < inputs; k++) {
+        if (w[k] < lo) lo = w[k];
+        if (w[k] > hi) hi = w[k];
+    }
+
+    double s;
+    int z;
+    if (hi > lo) {
+        s = (hi - lo) / 255.0;
+        z = clampInt(lrint(-128.0 - lo / s), -128, 127);
+    } else {
+        // Constant row: symmetric scale so the value is exact
+        s = (fabs(hi) > 0) ? fabs(hi) / 127.0 : 1.0;
+        z = 0;
+    }
+
+    int32_t sum = 0;
+    for (int k = 0; k < inputs; k++) {
+        q[k] = (int8_t) clampInt(lrint(w[k] / s) + z, -128, 127);
+        sum += q[k];
+    }
+    *scale = s;
+    *zero = z;
+    *rowSum = sum;
+}
+
+/* ========== Quantization ========== */
+
+/**
+ * Build an INT8 copy of the dense layers
+ * Biases stay in double and are shared with the source layers, which must
+ * outlive the returned network.
+ *
+ * @param layers Source layers, input layer first
+ * @param layerCount Number of layers
+ * @return The quantized network, or NULL on allocation failure
+ */
+QuantNetwork *quantizeLayers(const Layer *layers, int layerCount) {
+    // Work out the arena size
+    int widestStride = 0, widestLayer = 0;
+    size_t total = alignUp(sizeof(QuantNetwork)) + alignUp(sizeof(QuantLayer) * layerCount);
+    for (int i = 1; i < layerCount; i++) {
+        int stride = (int)alignUp(layers[i].inputs);
+        total += (size_t)stride * layers[i].size;
+        total += alignUp(sizeof(double) * layers[i].size);        // scale
+        total += 2 * alignUp(sizeof(int32_t) * layers[i].size);  // zero, rowSum
+        if (stride > widestStride) widestStride = stride;
+        if (layers[i].size > widestLayer) widestLayer = layers[i].size;
+    }
+
+    unsigned char *p = alignedAlloc(total);
+    if (p == NULL) {
+        fprintf(stderr, "Memory allocation failed for quantized network\n");
+        return NULL;
+    }
+
+    QuantNetwork *q = (QuantNetwork*) p;
+    p += alignUp(sizeof(QuantNetwork));
+    q->arena = q;
+    q->layerCount = layerCount;
+    q->layers = (QuantLayer*) p;
+    p += alignUp(sizeof(QuantLayer) * layerCount);
+    q->weightBytes = 0;
+
+    for (int i = 1; i < layerCount; i++) {
+        const Layer *src = &layers[i];
+        QuantLayer *l = &q->layers[i];
+        l->size = src->size;
+        l->inputs = src->inputs;
+        l->stride = (int)alignUp(src->inputs);
+        l->bias = src->bias;
+
+        l->weights = (int8_t*) p;
+        p += (size_t)l->stride * l->size;
+        l->scale = (double*) p;
+        p += alignUp(sizeof(double) * l->size);
+        l->zero = (int32_t*) p;
+        p += alignUp(sizeof(int32_t) * l->size);
+        l->rowSum = (int32_t*) p;
+        p += alignUp(sizeof(int32_t) * l->size);
+
+        for (int j = 0; j < l->size; j++) {
+            quantizeRow(src->weights + (size_t)j * src->stride, l->inputs,
+                        l->weights + (size_t)j * l->stride, &l->scale[j], &l->zero[j], &l->rowSum[j]);
+        }
+        q->weightBytes += (size_t)l->stride * l->size + (sizeof(double) + 2 * sizeof(int32_t)) * l->size;
+    }
+
+    // Per-thread scratch: quantized activations, then int32 dot products
+    q->accOffset = (size_t)NN_BATCH_TILE * widestStride;
+    q->scratchBytes = q->accOffset + alignUp(sizeof(int32_t) * NN_BATCH_TILE * widestLayer);
+    return q;
+}
+
+/**
+ * Release a network made by quantizeLayers
+ * Safe to call with NULL
+ */
+void freeQuantNetwork(QuantNetwork *q) {
+    if (q != NULL) {
+        alignedFree(q->arena);
+    }
+}
+
+/* ========== Forward Pass ========== */
+
+/**
+ * Quantize one activation vector to [0, 127]
+ * The range always includes 0 so zero activations stay exact.
+ *
+ * @param x Activations
+ * @param inputs Number of activations
+ * @param xq Receives inputs quantized values followed by zero padding up to stride
+ * @param stride Padded length of xq
+ * @param xScale Receives the scale (0 when every activation is zero)
+ * @param xZero Receives the zero point
+ * @return Sum of the quantized values
+ */
+static int32_t quantizeActivations(const double *x, int inputs, uint8_t *xq, int stride,
+                                   double *xScale, int *xZero) {
+    // Four independent min/max chains so the loop is not latency bound
+    double lo4[4] = {0}, hi4[4] = {0};
+    int k = 0;
+    for (; k + 4 <= inputs; k += 4) {
+        for (int j = 0; j < 4; j++) {
+            lo4[j] = x[k + j] < lo4[j] ? x[k + j] : lo4[j];
+            hi4[j] = x[k + j] > hi4[j] ? x[k + j] : hi4[j];
+        }
+    }
+    for (; k < inputs; k++) {
+        lo4[0] = x[k] < lo4[0] ? x[k] : lo4[0];
+        hi4[0] = x[k] > hi4[0] ? x[k] : hi4[0];
+    }
+    double lo = fmin(fmin(lo4[0], lo4[1]), fmin(lo4[2], lo4[3]));
+    double hi = fmax(fmax(hi4[0], hi4[1]), fmax(hi4[2], hi4[3]));
+
+    memset(xq + inputs, 0, (size_t)(stride - inputs));
+    if (hi == lo) {
+        memset(xq, 0, (size_t)inputs);
+        *xScale = 0.0;
+        *xZero = 0;
+        return 0;
+    }
+
+    double inv = 127.0 / (hi - lo);
+    int z = clampInt(lrint(-lo * inv), 0, 127);
+    const double offset = z + 0.5;   // Round half up; values are clamped at 0 anyway
+    int32_t sum = 0;
+    for (k = 0; k < inputs; k++) {
+        int v = (int)(x[k] * inv + offset);
+        v = v < 0 ? 0 : (v > 127 ? 127 : v);
+        xq[k] = (uint8_t) v;
+        sum += v;
+    }
+    *xScale = (hi - lo) / 127.0;
+    *xZero = z;
+    return sum;
+}
+
+/**
+ * INT8 dense layer over up to NN_BATCH_TILE samples: y = act(W * x + b)
+ * Each sample's activations get their own scale and zero point; all samples
+ * go through one integer kernel call so they share the weight loads.
+ *
+ * @param q Quantized network
+ * @param scratch q->scratchBytes bytes aligned to NN_ALIGN, private to the calling thread
+ * @param layer Index of the layer to apply (1 .. layerCount-1)
+ * @param x Input rows, layers[layer].inputs activations each
+ * @param xStride Distance in doubles between consecutive input rows
+ * @param count Number of samples, at most NN_BATCH_TILE
+ * @param y Output rows, layers[layer].size values each
+ * @param yStride Distance in doubles between consecutive output rows
+ * @param applyRelu Non-zero to apply ReLU after the bias
+ */
+void quantDense(const QuantNetwork *q, void *scratch, int layer, const double *x, int xStride,
+                int count, double *y, int yStride, int applyRelu) {
+    const QuantLayer *l = &q->layers[layer];
+    uint8_t *xq = scratch;
+    int32_t *acc = (int32_t*)(xq + q->accOffset);
+    double xScale[NN_BATCH_TILE];
+    int xZero[NN_BATCH_TILE];
+    int32_t sumX[NN_BATCH_TILE];
+
+    for (int b = 0; b < count; b++) {
+        sumX[b] = quantizeActivations(x + (size_t)b * xStride, l->inputs,
+                                      xq + (size_t)b * l->stride, l->stride, &xScale[b], &xZero[b]);
+    }
+
+    nnKernels->dotInt8(l->weights, l->stride, xq, count, l->size, acc);
+
+    // Remove the zero points, rescale, then bias and ReLU
+    for (int b = 0; b < count; b++) {
+        const int32_t *accB = acc + (size_t)b * l->size;
+        double *yb = y + (size_t)b * yStride;
+        for (int o = 0; o < l->size; o++) {
+            int64_t dot = (int64_t)accB[o] - (int64_t)xZero[b] * l->rowSum[o]
+                        - (int64_t)l->zero[o] * sumX[b] + (int64_t)l->inputs * l->zero[o] * xZero[b];
+            double v = (double)dot * l->scale[o] * xScale[b] + l->bias[o];
+            yb[o] = (applyRelu && !(v >= 0)) ? 0.0 : v;
+        }
+    }
+}
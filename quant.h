@@ -0,0 +1,48 @@
+#ifndef QUANT_H
+#define QUANT_H
+
+/*
+ * Post-training INT8 quantization of the dense layers.
+ *
+ * Weights are quantized per output neuron: w = scale[o] * (q - zero[o]) with
+ * q in [-128, 127], the scale and zero point covering that row's min..max.
+ * Activations are quantized on every forward pass to 7-bit unsigned values
+ * x = xScale * (xq - xZero) with xq in [0, 127]; 7 bits keep the int16 pair
+ * sums of pmaddubsw from saturating (2 * 127 * 128 < 32768). The int32 dot
+ * products are corrected for both zero points and rescaled to double before
+ * the bias and ReLU are applied.
+ */
+
+#include <stdint.h>
+#include "nn.h"
+
+/* ========== Data Structures ========== */
+
+typedef struct QuantLayer {
+    int size;              // Neurons in this layer
+    int inputs;            // Neurons in the previous layer
+    int stride;            // Bytes per weight row, padded to NN_ALIGN with zeros
+    int8_t *weights;       // size x stride quantized weights
+    double *scale;         // Per-neuron weight scale
+    int32_t *zero;         // Per-neuron weight zero point
+    int32_t *rowSum;       // Per-neuron sum of the quantized weights
+    const double *bias;    // Biases of the fp64 layer (not quantized)
+} QuantLayer;
+
+typedef struct QuantNetwork {
+    int layerCount;        // Layers including the input layer
+    QuantLayer *layers;    // layerCount entries, layers[0] is unused
+    size_t scratchBytes;   // Scratch quantDense needs per thread
+    size_t accOffset;      // Offset of the int32 dot products inside that scratch
+    size_t weightBytes;    // Bytes of quantized weights, scales and zero points
+    void *arena;           // Single allocation backing all of the above
+} QuantNetwork;
+
+/* ========== Function Declarations ========== */
+
+QuantNetwork *quantizeLayers(const Layer *layers, int layerCount);
+void freeQuantNetwork(QuantNetwork *q);
+void quantDense(const QuantNetwork *q, void *scratch, int layer, const double *x, int xStride,
+                int count, double *y, int yStride, int applyRelu);
+
+#endif // QUANT_H
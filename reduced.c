@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reduced.h"
+#include "kernels.h"
+
+/* ========== Helpers ========== */
+
+static size_t alignUp(size_t bytes) {
+    return (bytes + NN_ALIGN - 1) & ~(size_t)(NN_ALIGN - 1);
+}
+
+/* ========== Conversion ========== */
+
+/**
+ * Build a float or half copy of the dense layers
+ * Each value is rounded to nearest; padding stays zero.
+ *
+ * @param layers Source layers, input layer first
+ * @param layerCount Number of layers
+ * @param half Non-zero to store the weights as IEEE half, zero for float
+ * @return The converted network, or NULL on allocation failure
+ */
+FloatNetwork *convertLayers(const Layer *layers, int layerCount, int half) {
+    const size_t elementSize = half ? sizeof(uint16_t) : sizeof(float);
+
+    // Work out the arena size
+    size_t total = alignUp(sizeof(FloatNetwork)) + alignUp(sizeof(FloatLayer) * layerCount);
+    for (int i = 1; i < layerCount; i++) {
+        total += alignUp(elementSize * layers[i].inputs) * layers[i].size;   // Weights
+        total += alignUp(sizeof(float) * layers[i].size);                    // Biases
+    }
+
+    unsigned char *p = alignedAlloc(total);
+    if (p == NULL) {
+        fprintf(stderr, "Memory allocation failed for %s network\n", half ? "fp16" : "fp32");
+        return NULL;
+    }
+
+    FloatNetwork *f = (FloatNetwork*) p;
+    p += alignUp(sizeof(FloatNetwork));
+    f->arena = f;
+    f->layerCount = layerCount;
+    f->half = half;
+    f->layers = (FloatLayer*) p;
+    p += alignUp(sizeof(FloatLayer) * layerCount);
+    f->weightBytes = 0;
+
+    for (int i = 1; i < layerCount; i++) {
+        const Layer *src = &layers[i];
+        FloatLayer *l = &f->layers[i];
+        size_t rowBytes = alignUp(elementSize * src->inputs);
+        l->size = src->size;
+        l->inputs = src->inputs;
+        l->stride = (int)(rowBytes / elementSize);
+
+        if (half) {
+            uint16_t *w = (uint16_t*) p;
+            for (int j = 0; j < l->size; j++) {
+                const double *row = src->weights + (size_t)j * src->stride;
+                for (int k = 0; k < l->inputs; k++) {
+                    w[(size_t)j * l->stride + k] = floatToHalf((float) row[k]);
+                }
+            }
+            l->weights = w;
+        } else {
+            float *w = (float*) p;
+            for (int j = 0; j < l->size; j++) {
+                const double *row = src->weights + (size_t)j * src->stride;
+                for (int k = 0; k < l->inputs; k++) {
+                    w[(size_t)j * l->stride + k] = (float) row[k];
+                }
+            }
+            l->weights = w;
+        }
+        p += rowBytes * l->size;
+
+        l->bias = (float*) p;
+        p += alignUp(sizeof(float) * l->size);
+        for (int j = 0; j < l->size; j++) {
+            l->bias[j] = (float) src->bias[j];
+        }
+        f->weightBytes += rowBytes * l->size + sizeof(float) * l->size;
+    }
+    return f;
+}
+
+/**
+ * Release a network made by convertLayers
+ * Safe to call with NULL
+ */
+void freeFloatNetwork(FloatNetwork *f) {
+    if (f != NULL) {
+        alignedFree(f->arena);
+    }
+}
+
+/* ========== Forward Pass ========== */
+
+/**
+ * Run neurons [first, last) of one layer in single precision
+ * Disjoint neuron ranges of the same layer can run on different threads.
+ *
+ * @param f Converted network
+ * @param layer Index of the layer to apply (1 .. layerCount-1)
+ * @param first First neuron to compute
+ * @param last One past the last neuron to compute
+ * @param x Input activations: one vector, or a feature-major tile if tile is set
+ * @param y Output of neuron first (row first of the tile)
+ * @param tile Non-zero for NN_BATCH_TILE samples in feature-major order
+ * @param applyRelu Non-zero to apply ReLU after the bias
+ */
+void floatDense(const FloatNetwork *f, int layer, int first, int last,
+                const float *x, float *y, int tile, int applyRelu) {
+    const FloatLayer *l = &f->layers[layer];
+    const int outputs = last - first;
+    const size_t offset = (size_t)first * l->stride;
+
+    if (f->half) {
+        const uint16_t *w = (const uint16_t*)l->weights + offset;
+        if (tile) nnKernels->denseTileF16(w, l->stride, l->bias + first, x, l->inputs, outputs, y, applyRelu);
+        else nnKernels->denseF16(w, l->stride, l->bias + first, x, l->inputs, outputs, y, applyRelu);
+    } else {
+        const float *w = (const float*)l->weights + offset;
+        if (tile) nnKernels->denseTileF32(w, l->stride, l->bias + first, x, l->inputs, outputs, y, applyRelu);
+        else nnKernels->denseF32(w, l->stride, l->bias + first, x, l->inputs, outputs, y, applyRelu);
+    }
+}
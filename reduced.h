@@ -0,0 +1,43 @@
+#ifndef REDUCED_H
+#define REDUCED_H
+
+/*
+ * Single precision copies of the dense layers.
+ *
+ * NN_PRECISION_FP32 keeps float weights, biases and activations; with 8 or
+ * 16 lanes per vector instead of 4 or 8 and half the bytes per weight it runs
+ * about twice as fast as fp64. NN_PRECISION_FP16 stores the weights as IEEE
+ * half (another 2x less memory) and converts them to float as the kernels
+ * load them, so the arithmetic is still fp32. Inputs and outputs stay double
+ * at the nn.h surface; only the inside of the forward pass changes.
+ */
+
+#include <stdint.h>
+#include "nn.h"
+
+/* ========== Data Structures ========== */
+
+typedef struct FloatLayer {
+    int size;              // Neurons in this layer
+    int inputs;            // Neurons in the previous layer
+    int stride;            // Elements per weight row, padded to NN_ALIGN bytes with zeros
+    const void *weights;   // size x stride float or uint16_t (half) weights
+    float *bias;           // One bias per neuron
+} FloatLayer;
+
+typedef struct FloatNetwork {
+    int layerCount;        // Layers including the input layer
+    int half;              // Non-zero when the weights are stored as half
+    FloatLayer *layers;    // layerCount entries, layers[0] is unused
+    size_t weightBytes;    // Bytes of weights and biases
+    void *arena;           // Single allocation backing all of the above
+} FloatNetwork;
+
+/* ========== Function Declarations ========== */
+
+FloatNetwork *convertLayers(const Layer *layers, int layerCount, int half);
+void freeFloatNetwork(FloatNetwork *f);
+void floatDense(const FloatNetwork *f, int layer, int first, int last,
+                const float *x, float *y, int tile, int applyRelu);
+
+#endif // REDUCED_H
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "reload.h"
+
+/* ========== Slot State ========== */
+
+struct ModelSlot {
+    _Atomic(NetworkModel*) model;  // Current model; the slot holds one reference
+    _Atomic uint64_t epoch;        // Bumped by every publish, starts at 1
+    _Atomic uint64_t generation;   // Models published after the first
+    pthread_mutex_t lock;          // Serializes publishers and guards readers
+    ModelReader *readers;
+};
+
+/* ========== Slots ========== */
+
+/**
+ * Create a slot publishing a model
+ *
+ * @param model First model; the slot takes over the caller's reference
+ * @return The slot, or NULL on allocation failure
+ */
+ModelSlot *createModelSlot(NetworkModel *model) {
+    ModelSlot *s = malloc(sizeof(ModelSlot));
+    if (s == NULL) {
+        fprintf(stderr, "Memory allocation failed for model slot\n");
+        return NULL;
+    }
+    atomic_init(&s->model, model);
+    atomic_init(&s->epoch, 1);
+    atomic_init(&s->generation, 0);
+    pthread_mutex_init(&s->lock, NULL);
+    s->readers = NULL;
+    return s;
+}
+
+/**
+ * Free a slot and drop its reference to the current model
+ * Every reader must have been removed.
+ */
+void freeModelSlot(ModelSlot *s) {
+    if (s == NULL) return;
+    releaseNetworkModel(atomic_load(&s->model));
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+/* ========== Readers ========== */
+
+/**
+ * Register a reader thread with a slot
+ *
+ * @param s Slot
+ * @param r Reader owned by the calling thread, alive until removeModelReader
+ * @return 0 on success
+ */
+int addModelReader(ModelSlot *s, ModelReader *r) {
+    atomic_init(&r->epoch, 0);
+    r->model = NULL;
+    r->context = NULL;
+
+    pthread_mutex_lock(&s->lock);
+    r->next = s->readers;
+    s->readers = r;
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+/**
+ * Unregister a reader and free its context
+ * Must not be called between enterModel and leaveModel.
+ */
+void removeModelReader(ModelSlot *s, ModelReader *r) {
+    pthread_mutex_lock(&s->lock);
+    for (ModelReader **p = &s->readers; *p != NULL; p = &(*p)->next) {
+        if (*p == r) {
+            *p = r->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    freeNetworkContext(r->context);   // Drops the reader's reference to its model
+    r->context = NULL;
+    r->model = NULL;
+}
+
+/**
+ * Start using the current model
+ * Records the epoch before reading the model pointer, so a publisher that
+ * swaps the pointer afterwards waits for this reader. When the model changed
+ * since the last call, the reader's context is replaced by one for the new
+ * model; if that fails the old context, which keeps its model alive, is
+ * used once more.
+ *
+ * @param s Slot
+ * @param r Reader of the calling thread
+ * @return Context to run forward passes on until leaveModel, or NULL if
+ *         the reader has no context at all
+ */
+NetworkContext *enterModel(ModelSlot *s, ModelReader *r) {
+    atomic_store(&r->epoch, atomic_load(&s->epoch));
+    NetworkModel *m = atomic_load(&s->model);
+
+    if (m != r->model) {
+        NetworkContext *c = createNetworkContext(m);
+        if (c != NULL) {
+            freeNetworkContext(r->context);
+            r->context = c;
+            r->model = m;
+        }
+    }
+    return r->context;
+}
+
+/**
+ * Stop using the model entered last
+ * The context returned by enterModel must not be used afterwards.
+ */
+void leaveModel(ModelReader *r) {
+    atomic_store_explicit(&r->epoch, 0, memory_order_release);
+}
+
+/* ========== Publishing ========== */
+
+/**
+ * Wait until no reader is inside an epoch older than `epoch`
+ * Readers entering from now on already see the new model. Called with the
+ * slot locked, so the reader list stays put.
+ */
+static void waitForReaders(ModelSlot *s, uint64_t epoch) {
+    for (ModelReader *r = s->readers; r != NULL; r = r->next) {
+        for (;;) {
+            uint64_t seen = atomic_load(&r->epoch);
+            if (seen == 0 || seen >= epoch) break;
+            struct timespec pause = { 0, 50000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+/**
+ * Make a model current and retire the previous one
+ * The pointer is swapped at once; this call then blocks until every reader
+ * that might still be using the previous model through the slot has left,
+ * and drops the slot's reference to it. Readers never wait for it.
+ *
+ * @param s Slot
+ * @param model New model; the slot takes over the caller's reference
+ * @return 0 on success
+ */
+int publishModel(ModelSlot *s, NetworkModel *model) {
+    pthread_mutex_lock(&s->lock);
+    NetworkModel *old = atomic_exchange(&s->model, model);
+    uint64_t epoch = atomic_fetch_add(&s->epoch, 1) + 1;
+    atomic_fetch_add(&s->generation, 1);
+    waitForReaders(s, epoch);
+    pthread_mutex_unlock(&s->lock);
+
+    releaseNetworkModel(old);   // Freed once the readers' contexts let go too
+    return 0;
+}
+
+/**
+ * Build a model from a model file and publish it
+ * The file is mapped and checked on the calling thread while readers keep
+ * running on the current model. A file whose input or output layer differs
+ * from the current model's is refused, since readers size their buffers
+ * for those. Replace model files with a rename (saveNetwork does), never by
+ * rewriting them in place: the current model may still be mapped.
+ *
+ * @param s Slot
+ * @param path Model file (see model.h)
+ * @param precision NN_PRECISION_* to run the new model at
+ * @return 0 on success, 1 on failure (the current model stays)
+ */
+int reloadModel(ModelSlot *s, const char *path, int precision) {
+    NetworkModel *m = openNetworkModel(path, precision);
+    if (m == NULL) {
+        return 1;
+    }
+
+    // Only publishers change the model and they hold the lock
+    pthread_mutex_lock(&s->lock);
+    const NetworkModel *current = atomic_load(&s->model);
+    int inputs = networkModelLayerSize(current, 0);
+    int outputs = networkModelLayerSize(current, networkModelLayers(current) - 1);
+    pthread_mutex_unlock(&s->lock);
+
+    int newInputs = networkModelLayerSize(m, 0);
+    int newOutputs = networkModelLayerSize(m, networkModelLayers(m) - 1);
+    if (newInputs != inputs || newOutputs != outputs) {
+        fprintf(stderr, "Error: %s has %d inputs and %d outputs, the current model %d and %d\n",
+                path, newInputs, newOutputs, inputs, outputs);
+        releaseNetworkModel(m);
+        return 1;
+    }
+    return publishModel(s, m);
+}
+
+/**
+ * Number of models published after the first one
+ */
+uint64_t modelGeneration(ModelSlot *s) {
+    return atomic_load(&s->generation);
+}
@@ -0,0 +1,50 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+/*
+ * Hot reload of a shared model without stopping its readers.
+ *
+ * A ModelSlot publishes one NetworkModel at a time. Readers bracket every
+ * use with enterModel/leaveModel and get a context for whatever model is
+ * current; publishing a new model swaps the slot's pointer atomically, so a
+ * reader sees either the old model or the new one, never a mix.
+ *
+ * The old model is retired with epoch-based reclamation: the slot keeps a
+ * global epoch and every reader records the epoch it entered in. A publisher
+ * bumps the epoch after the swap and waits until no reader is still inside
+ * an older one (a grace period) before dropping the slot's reference. A
+ * reader's context holds its own reference, so the old weights stay alive
+ * until each reader has moved on to the new model at its next enterModel.
+ * Readers never lock or wait; only publishers wait, and only for the
+ * readers that were already running.
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "nn.h"
+
+/* ========== Data Structures ========== */
+
+typedef struct ModelSlot ModelSlot;
+
+// One reader thread of a slot, owned by that thread
+typedef struct ModelReader {
+    _Atomic uint64_t epoch;        // Epoch entered in, 0 while outside enterModel/leaveModel
+    NetworkModel *model;           // Model of context
+    NetworkContext *context;       // Context for the model last entered
+    struct ModelReader *next;      // Next reader of the slot
+} ModelReader;
+
+/* ========== Function Declarations ========== */
+
+ModelSlot *createModelSlot(NetworkModel *model);
+void freeModelSlot(ModelSlot *slot);
+int addModelReader(ModelSlot *slot, ModelReader *reader);
+void removeModelReader(ModelSlot *slot, ModelReader *reader);
+NetworkContext *enterModel(ModelSlot *slot, ModelReader *reader);
+void leaveModel(ModelReader *reader);
+int publishModel(ModelSlot *slot, NetworkModel *model);
+int reloadModel(ModelSlot *slot, const char *path, int precision);
+uint64_t modelGeneration(ModelSlot *slot);
+
+#endif // RELOAD_H
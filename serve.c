@@ -0,0 +1,516 @@
+// Inference daemon: loads the model once and answers predictions over a Unix
+// domain socket (protocol.h), batching requests that arrive together
+//
+// usage: serve [-s socket] [-m model.nnb] [-p fp64|fp32|fp16|int8] [-b max-batch]
+//              [-t budget-us] [-q max-queue] [-j threads]
+//   -s  socket path (default /tmp/nn.sock)
+//   -m  binary model to load (default: the text files, like main.c)
+//   -p  precision to run at (default fp64)
+//   -b  most requests per forward pass (default 256)
+//   -t  longest a request waits for others to join its batch, in microseconds (default 1000)
+//   -q  most requests waiting before new ones are refused (default 4096)
+//   -j  threads for the forward pass (default: every online core)
+//
+// One thread per connection reads requests and queues them; a single batcher
+// thread takes the queue as soon as it holds a full batch or its oldest request
+// has waited the budget, and runs one batched forward pass over it. Queue depth
+// and batch-size statistics are returned for NN_REQ_STATS, and as Prometheus
+// text with the per-layer profile (profile.h) for NN_REQ_METRICS; start the
+// daemon with NN_PROFILE=1 (or perf) to fill the profile.
+//
+// SIGHUP or NN_REQ_RELOAD reloads the -m model file without stopping: the new
+// model is built beside the running one and swapped in between batches (see
+// reload.h). Replace the file with a rename, e.g. by saving it with convert or
+// train -m; a failed reload keeps the current model.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "nn.h"
+#include "kernels.h"
+#include "pool.h"
+#include "protocol.h"
+#include "profile.h"
+#include "reload.h"
+
+/* ========== Server State ========== */
+
+// A prediction waiting for its batch, owned by the connection thread
+typedef struct Pending {
+    struct Pending *next;
+    const double *input;       // Network input
+    double arrived;            // When it was queued
+    int prediction;
+    float *probabilities;      // Receives every class probability
+    int done;
+    pthread_cond_t *wake;      // Signalled when done is set
+} Pending;
+
+static struct {
+    pthread_mutex_t lock;      // Guards the queue and the stats
+    pthread_cond_t work;       // The queue gained a request
+    Pending *head, *tail;
+    int depth;
+    ServeStats stats;
+
+    int maxBatch;
+    int maxQueue;
+    double budget;             // Seconds a request may wait for company
+    int inSize, classes;
+
+    ModelSlot *slot;           // Model the batcher runs, swapped by reloads
+    const char *modelPath;     // File reloads read, NULL when serving the text files
+    int precision;
+} server = { .lock = PTHREAD_MUTEX_INITIALIZER, .work = PTHREAD_COND_INITIALIZER };
+
+static const char *socketPath = "/tmp/nn.sock";
+
+/* ========== Helpers ========== */
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int readFull(int fd, void *buf, size_t size) {
+    unsigned char *p = buf;
+    while (size > 0) {
+        ssize_t got = read(fd, p, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return 1;
+        p += got;
+        size -= (size_t)got;
+    }
+    return 0;
+}
+
+/**
+ * Send a reply header and payload
+ *
+ * @return 0 on success, 1 on error
+ */
+static int sendReply(int fd, const RequestHeader *request, int status, int value, const void *payload, size_t size) {
+    ResponseHeader reply = { NN_RESPONSE_MAGIC, (uint8_t)status, 0, (uint16_t)value, request->id, (uint32_t)size };
+    struct iovec parts[2] = { { &reply, sizeof(reply) }, { (void*)payload, size } };
+    size_t left = sizeof(reply) + size;
+    int first = 0;
+    while (left > 0) {
+        ssize_t sent = writev(fd, parts + first, 2 - first);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return 1;
+        left -= (size_t)sent;
+        while (first < 2 && (size_t)sent >= parts[first].iov_len) {
+            sent -= (ssize_t)parts[first].iov_len;
+            first++;
+        }
+        if (first < 2) {
+            parts[first].iov_base = (unsigned char*)parts[first].iov_base + sent;
+            parts[first].iov_len -= (size_t)sent;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Histogram bucket of a batch size: 1, 2-3, 4-7, ...
+ */
+static int sizeBucket(int size) {
+    int bucket = 0;
+    while (size > 1 && bucket < NN_SERVE_BUCKETS - 1) {
+        size >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/**
+ * Render the statistics and the profile as NN_REQ_METRICS text
+ *
+ * @param json Non-zero for the profile as JSON alone
+ * @param size Receives the length
+ * @return malloc'd text, or NULL on failure
+ */
+static char *renderMetrics(const ServeStats *st, int json, size_t *size) {
+    char *text = NULL;
+    FILE *f = open_memstream(&text, size);
+    if (f == NULL) return NULL;
+
+    ProfileSnapshot snapshot;
+    profileSnapshot(&snapshot);
+    if (json) {
+        writeProfileJson(f, &snapshot);
+    } else {
+        fprintf(f, "# HELP nn_serve_requests_total Predictions answered\n# TYPE nn_serve_requests_total counter\n"
+                   "nn_serve_requests_total %llu\n", (unsigned long long)st->requests);
+        fprintf(f, "# HELP nn_serve_rejected_total Predictions refused as overloaded\n# TYPE nn_serve_rejected_total counter\n"
+                   "nn_serve_rejected_total %llu\n", (unsigned long long)st->rejected);
+        fprintf(f, "# HELP nn_serve_batches_total Forward passes run\n# TYPE nn_serve_batches_total counter\n"
+                   "nn_serve_batches_total %llu\n", (unsigned long long)st->batches);
+        fprintf(f, "# HELP nn_serve_queue_seconds_total Time predictions waited for their batch\n"
+                   "# TYPE nn_serve_queue_seconds_total counter\nnn_serve_queue_seconds_total %.6f\n",
+                st->queueMicros * 1e-6);
+        fprintf(f, "# HELP nn_serve_inference_seconds_total Time of the forward passes\n"
+                   "# TYPE nn_serve_inference_seconds_total counter\nnn_serve_inference_seconds_total %.6f\n",
+                st->inferenceMicros * 1e-6);
+        fprintf(f, "# HELP nn_serve_queue_depth Predictions waiting\n# TYPE nn_serve_queue_depth gauge\n"
+                   "nn_serve_queue_depth %llu\n", (unsigned long long)st->queueDepth);
+        fprintf(f, "# HELP nn_serve_connections Clients connected\n# TYPE nn_serve_connections gauge\n"
+                   "nn_serve_connections %llu\n", (unsigned long long)st->connections);
+        fprintf(f, "# HELP nn_serve_reloads_total Models loaded by reloads\n# TYPE nn_serve_reloads_total counter\n"
+                   "nn_serve_reloads_total %llu\n", (unsigned long long)st->reloads);
+        writeProfilePrometheus(f, &snapshot);
+    }
+    if (fclose(f) != 0) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+/* ========== Batching ========== */
+
+/**
+ * Batcher thread: wait for a full batch or the budget, run it, wake the requesters
+ */
+static void *batcherMain(void *p) {
+    (void) p;
+    Pending **taken = malloc(sizeof(Pending*) * server.maxBatch);
+    double *inputs = alignedAlloc(sizeof(double) * server.maxBatch * server.inSize);
+    double *outputs = alignedAlloc(sizeof(double) * server.maxBatch * server.classes);
+    ModelReader reader;
+    addModelReader(server.slot, &reader);
+    int ready = enterModel(server.slot, &reader) != NULL;   // Later models reuse this context on failure
+    leaveModel(&reader);
+    if (taken == NULL || inputs == NULL || outputs == NULL || !ready) {
+        fprintf(stderr, "Memory allocation failed for batcher\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&server.lock);
+    for (;;) {
+        while (server.depth == 0) {
+            pthread_cond_wait(&server.work, &server.lock);
+        }
+
+        // Let the batch fill until it is full or its oldest request runs out of
+        // budget; once every client is waiting nobody else can join
+        double deadline = server.head->arrived + server.budget;
+        while (server.depth < server.maxBatch && (uint64_t)server.depth < server.stats.connections &&
+               nowSeconds() < deadline) {
+            struct timespec until;
+            until.tv_sec = (time_t)deadline;
+            until.tv_nsec = (long)((deadline - (double)until.tv_sec) * 1e9);
+            pthread_cond_timedwait(&server.work, &server.lock, &until);
+        }
+
+        int count = 0;
+        while (server.head != NULL && count < server.maxBatch) {
+            taken[count++] = server.head;
+            server.head = server.head->next;
+        }
+        if (server.head == NULL) server.tail = NULL;
+        server.depth -= count;
+        pthread_mutex_unlock(&server.lock);
+
+        // Connection threads sleep until done, so their inputs stay put
+        double started = nowSeconds();
+        for (int i = 0; i < count; i++) {
+            memcpy(inputs + (size_t)i * server.inSize, taken[i]->input, sizeof(double) * server.inSize);
+        }
+        NetworkContext *context = enterModel(server.slot, &reader);
+        contextForwardBatchParallel(context, inputs, count, outputs, 1);
+        leaveModel(&reader);
+        double finished = nowSeconds();
+
+        pthread_mutex_lock(&server.lock);
+        ServeStats *st = &server.stats;
+        for (int i = 0; i < count; i++) {
+            const double *row = outputs + (size_t)i * server.classes;
+            Pending *r = taken[i];
+            r->prediction = nnKernels->argmax(row, server.classes);
+            for (int o = 0; o < server.classes; o++) r->probabilities[o] = (float) row[o];
+            st->queueMicros += (uint64_t)((started - r->arrived) * 1e6);
+            r->done = 1;
+            pthread_cond_signal(r->wake);
+        }
+        st->requests += (uint64_t)count;
+        st->batches++;
+        st->inferenceMicros += (uint64_t)((finished - started) * 1e6);
+        st->batchSizes[sizeBucket(count)]++;
+        if ((uint64_t)count > st->maxBatch) st->maxBatch = (uint64_t)count;
+    }
+    return NULL;
+}
+
+/* ========== Reloading ========== */
+
+/**
+ * Reload the model file; runs on the calling thread while the batcher goes on
+ *
+ * @return 0 on success, 1 on failure
+ */
+static int reload(void) {
+    if (server.modelPath == NULL) {
+        fprintf(stderr, "Error: only a model file (-m) can be reloaded\n");
+        return 1;
+    }
+    double started = nowSeconds();
+    if (reloadModel(server.slot, server.modelPath, server.precision) != 0) {
+        fprintf(stderr, "Reloading %s failed, keeping the current model\n", server.modelPath);
+        return 1;
+    }
+    printf("Reloaded %s in %.1f ms (model %llu)\n", server.modelPath, (nowSeconds() - started) * 1e3,
+           (unsigned long long)modelGeneration(server.slot));
+    return 0;
+}
+
+/**
+ * Reloader thread: reload on every SIGHUP, which the other threads block
+ */
+static void *reloaderMain(void *p) {
+    sigset_t *hangup = p;
+    for (;;) {
+        int sig;
+        if (sigwait(hangup, &sig) == 0) reload();
+    }
+    return NULL;
+}
+
+/* ========== Connections ========== */
+
+/**
+ * Queue a prediction and sleep until the batcher has run it
+ *
+ * @return 0 when answered, 1 if the queue was full
+ */
+static int predict(Pending *r) {
+    pthread_mutex_lock(&server.lock);
+    if (server.depth >= server.maxQueue) {
+        server.stats.rejected++;
+        pthread_mutex_unlock(&server.lock);
+        return 1;
+    }
+    r->next = NULL;
+    r->done = 0;
+    r->arrived = nowSeconds();
+    if (server.tail != NULL) server.tail->next = r;
+    else server.head = r;
+    server.tail = r;
+    server.depth++;
+    if ((uint64_t)server.depth > server.stats.maxQueueDepth) server.stats.maxQueueDepth = (uint64_t)server.depth;
+    pthread_cond_signal(&server.work);
+
+    while (!r->done) {
+        pthread_cond_wait(r->wake, &server.lock);
+    }
+    pthread_mutex_unlock(&server.lock);
+    return 0;
+}
+
+/**
+ * Connection thread: answer requests until the client hangs up
+ */
+static void *connectionMain(void *p) {
+    int fd = (int)(intptr_t)p;
+    const size_t maxPayload = sizeof(double) * server.inSize;
+    unsigned char *payload = malloc(maxPayload);
+    double *input = malloc(sizeof(double) * server.inSize);
+    float *probabilities = malloc(sizeof(float) * server.classes);
+    pthread_cond_t wake;
+    pthread_cond_init(&wake, NULL);
+    Pending pending = { .input = input, .probabilities = probabilities, .wake = &wake };
+
+    pthread_mutex_lock(&server.lock);
+    server.stats.connections++;
+    pthread_mutex_unlock(&server.lock);
+
+    RequestHeader request;
+    while (payload != NULL && input != NULL && probabilities != NULL &&
+           readFull(fd, &request, sizeof(request)) == 0) {
+        // A bad header or an oversized payload leaves no way to resync: hang up
+        if (request.magic != NN_REQUEST_MAGIC || request.length > maxPayload) break;
+        if (request.length > 0 && readFull(fd, payload, request.length) != 0) break;
+
+        if (request.type == NN_REQ_STATS || request.type == NN_REQ_METRICS) {
+            ServeStats stats;
+            pthread_mutex_lock(&server.lock);
+            stats = server.stats;
+            stats.queueDepth = (uint64_t)server.depth;
+            pthread_mutex_unlock(&server.lock);
+            stats.reloads = modelGeneration(server.slot);
+            if (request.type == NN_REQ_STATS) {
+                if (sendReply(fd, &request, NN_STATUS_OK, 0, &stats, sizeof(stats)) != 0) break;
+                continue;
+            }
+            size_t size = 0;
+            char *text = renderMetrics(&stats, request.flags & NN_FLAG_JSON, &size);
+            int status = sendReply(fd, &request, text ? NN_STATUS_OK : NN_STATUS_FAILED, 0, text, text ? size : 0);
+            free(text);
+            if (status != 0) break;
+            continue;
+        }
+        if (request.type == NN_REQ_RELOAD) {
+            int status = reload() == 0 ? NN_STATUS_OK : NN_STATUS_FAILED;
+            if (sendReply(fd, &request, status, 0, NULL, 0) != 0) break;
+            continue;
+        }
+
+        // Decode the sample
+        int valid = 1;
+        if (request.type == NN_REQ_PREDICT_F64 && request.length == sizeof(double) * server.inSize) {
+            memcpy(input, payload, request.length);
+        } else if (request.type == NN_REQ_PREDICT_U8 && request.length == (uint32_t)server.inSize) {
+            for (int k = 0; k < server.inSize; k++) input[k] = payload[k] / 255.0;
+        } else {
+            valid = 0;
+        }
+
+        int status;
+        if (!valid) {
+            status = sendReply(fd, &request, NN_STATUS_BAD, 0, NULL, 0);
+        } else if (predict(&pending) != 0) {
+            status = sendReply(fd, &request, NN_STATUS_OVERLOADED, 0, NULL, 0);
+        } else {
+            int withProbabilities = request.flags & NN_FLAG_PROBABILITIES;
+            status = sendReply(fd, &request, NN_STATUS_OK, pending.prediction, probabilities,
+                               withProbabilities ? sizeof(float) * server.classes : 0);
+        }
+        if (status != 0) break;
+    }
+
+    pthread_mutex_lock(&server.lock);
+    server.stats.connections--;
+    pthread_mutex_unlock(&server.lock);
+
+    close(fd);
+    pthread_cond_destroy(&wake);
+    free(payload);
+    free(input);
+    free(probabilities);
+    return NULL;
+}
+
+/* ========== Main ========== */
+
+static void onSignal(int sig) {
+    (void) sig;
+    unlink(socketPath);
+    _exit(0);
+}
+
+int main(int argc, char *argv[]) {
+    const char *modelPath = NULL;
+    const char *precision = "fp64";
+    int threads = 0, budgetMicros = 1000;
+    server.maxBatch = 256;
+    server.maxQueue = 4096;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            modelPath = argv[++i];
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            precision = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            server.maxBatch = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            budgetMicros = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            server.maxQueue = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else {
+            server.maxBatch = 0;
+            break;
+        }
+    }
+    struct sockaddr_un addr;
+    if (server.maxBatch < 1 || server.maxQueue < 1 || budgetMicros < 0 || precisionFromName(precision) < 0 ||
+        strlen(socketPath) >= sizeof(addr.sun_path)) {
+        printf("usage: %s [-s socket] [-m model.nnb] [-p fp64|fp32|fp16|int8] [-b max-batch]\n"
+               "       [-t budget-us] [-q max-queue] [-j threads]\n", argv[0]);
+        return 1;
+    }
+    server.budget = budgetMicros * 1e-6;
+    server.modelPath = modelPath;
+    server.precision = precisionFromName(precision);
+
+    // Only the reloader thread takes SIGHUP; threads inherit the mask
+    static sigset_t hangup;
+    sigemptyset(&hangup);
+    sigaddset(&hangup, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &hangup, NULL);
+
+    // --- Load the model ---
+    NetworkModel *model;
+    if (modelPath != NULL) {
+        printf("Using %s kernels\n", selectKernels()->name);
+        model = openNetworkModel(modelPath, server.precision);
+    } else {
+        initializeNetwork(network_structure, n);
+        if (importNetwork() != 0) return 1;
+        model = createNetworkModel(Network, n, server.precision);
+        freeNetwork();
+    }
+    if (model == NULL) return 1;
+    server.inSize = networkModelLayerSize(model, 0);
+    server.classes = networkModelLayerSize(model, networkModelLayers(model) - 1);
+    server.slot = createModelSlot(model);
+    if (server.slot == NULL) return 1;
+    setNetworkThreads(threads, 0);
+
+    // --- Listen ---
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        perror("Error creating socket");
+        return 1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+    unlink(socketPath);   // A stale socket from a previous run
+    if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 128) != 0) {
+        fprintf(stderr, "Error listening on %s: ", socketPath);
+        perror("");
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    pthread_t batcher, reloader;
+    if (pthread_create(&batcher, NULL, batcherMain, NULL) != 0 ||
+        pthread_create(&reloader, NULL, reloaderMain, &hangup) != 0) {
+        fprintf(stderr, "Error: could not start the server threads\n");
+        return 1;
+    }
+    printf("Serving %s on %s: batches of up to %d, %d us budget, %d threads\n",
+           precision, socketPath, server.maxBatch, budgetMicros, poolThreads());
+
+    // --- Accept clients, one thread each ---
+    pthread_attr_t detached;
+    pthread_attr_init(&detached);
+    pthread_attr_setdetachstate(&detached, PTHREAD_CREATE_DETACHED);
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno != EINTR) perror("Error accepting a client");
+            continue;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, &detached, connectionMain, (void*)(intptr_t)fd) != 0) {
+            fprintf(stderr, "Error: could not start a connection thread\n");
+            close(fd);
+        }
+    }
+}
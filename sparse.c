@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sparse.h"
+
+/* ========== Helpers ========== */
+
+static size_t alignUp(size_t bytes) {
+    return (bytes + NN_ALIGN - 1) & ~(size_t)(NN_ALIGN - 1);
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+/* ========== Pruning ========== */
+
+/**
+ * Number of nonzero weights of a dense layer
+ */
+size_t countNonzeros(const Layer *l) {
+    size_t count = 0;
+    for (int o = 0; o < l->size; o++) {
+        const double *row = l->weights + (size_t)o * l->stride;
+        for (int k = 0; k < l->inputs; k++) {
+            count += (row[k] != 0.0);
+        }
+    }
+    return count;
+}
+
+/**
+ * Magnitude below which a given fraction of a layer's weights lie
+ * Passing it to pruneLayer zeroes that fraction (more when several weights
+ * share the threshold's magnitude).
+ *
+ * @param l Dense layer
+ * @param sparsity Fraction of the weights to zero, 0 to 1
+ * @return The threshold, or -1 on allocation failure
+ */
+double pruneThreshold(const Layer *l, double sparsity) {
+    size_t count = (size_t)l->size * l->inputs;
+    size_t drop = (size_t)(sparsity * (double)count);
+    if (drop == 0) return 0.0;
+    if (drop >= count) return HUGE_VAL;
+
+    double *magnitudes = malloc(sizeof(double) * count);
+    if (magnitudes == NULL) {
+        fprintf(stderr, "Memory allocation failed for pruning\n");
+        return -1.0;
+    }
+    for (int o = 0; o < l->size; o++) {
+        const double *row = l->weights + (size_t)o * l->stride;
+        for (int k = 0; k < l->inputs; k++) {
+            magnitudes[(size_t)o * l->inputs + k] = fabs(row[k]);
+        }
+    }
+    qsort(magnitudes, count, sizeof(double), compareDoubles);
+    double threshold = magnitudes[drop];
+    free(magnitudes);
+    return threshold;
+}
+
+/**
+ * Zero every weight of a layer whose magnitude is below threshold
+ * Biases are kept.
+ *
+ * @param l Dense layer with writable weights
+ * @param threshold Smallest magnitude that survives
+ * @return Nonzero weights left
+ */
+size_t pruneLayer(Layer *l, double threshold) {
+    for (int o = 0; o < l->size; o++) {
+        double *row = l->weights + (size_t)o * l->stride;
+        for (int k = 0; k < l->inputs; k++) {
+            if (fabs(row[k]) < threshold) row[k] = 0.0;
+        }
+    }
+    return countNonzeros(l);
+}
+
+/* ========== CSR Layers ========== */
+
+/**
+ * Bytes of the CSR arrays of a layer, each padded to NN_ALIGN
+ */
+size_t sparseLayerBytes(int size, uint32_t nonzeros) {
+    return alignUp(sizeof(uint32_t) * ((size_t)size + 1)) + alignUp(sizeof(uint32_t) * (size_t)nonzeros) +
+           alignUp(sizeof(double) * (size_t)nonzeros);
+}
+
+/**
+ * Build CSR copies of the layers that are mostly zeros
+ * A layer is converted when at most maxDensity of its weights are nonzero.
+ * Layers that already have CSR arrays in stored (e.g. inside a model file
+ * mapping, which must outlive the returned network) use them in place.
+ *
+ * @param layers Dense layers, input layer first
+ * @param stored Per layer: existing CSR arrays, rowStart NULL for none; may be NULL
+ * @param layerCount Number of layers
+ * @param maxDensity Largest nonzero fraction converted, 0 to convert only stored layers
+ * @return The sparse layers, or NULL on allocation failure
+ */
+SparseNetwork *sparsifyLayers(const Layer *layers, const SparseLayer *stored, int layerCount, double maxDensity) {
+    // Work out which layers to convert and the arena size
+    uint32_t *nonzeros = calloc((size_t)layerCount, sizeof(uint32_t));
+    if (nonzeros == NULL) {
+        fprintf(stderr, "Memory allocation failed for sparse layers\n");
+        return NULL;
+    }
+    size_t total = alignUp(sizeof(SparseNetwork)) + alignUp(sizeof(SparseLayer) * layerCount);
+    for (int i = 1; i < layerCount; i++) {
+        if (stored != NULL && stored[i].rowStart != NULL) continue;
+        size_t count = countNonzeros(&layers[i]);
+        if (count <= maxDensity * layers[i].size * layers[i].inputs && count <= UINT32_MAX) {
+            nonzeros[i] = (uint32_t) count;
+            total += sparseLayerBytes(layers[i].size, nonzeros[i]);
+        } else {
+            nonzeros[i] = UINT32_MAX;   // Stays dense
+        }
+    }
+
+    unsigned char *p = alignedAlloc(total);
+    if (p == NULL) {
+        fprintf(stderr, "Memory allocation failed for sparse layers\n");
+        free(nonzeros);
+        return NULL;
+    }
+
+    SparseNetwork *s = (SparseNetwork*) p;
+    p += alignUp(sizeof(SparseNetwork));
+    s->arena = s;
+    s->layerCount = layerCount;
+    s->layers = (SparseLayer*) p;
+    p += alignUp(sizeof(SparseLayer) * layerCount);
+
+    for (int i = 1; i < layerCount; i++) {
+        const Layer *src = &layers[i];
+        SparseLayer *l = &s->layers[i];
+        if (stored != NULL && stored[i].rowStart != NULL) {
+            *l = stored[i];
+        } else if (nonzeros[i] != UINT32_MAX) {
+            uint32_t *rowStart = (uint32_t*) p;
+            p += alignUp(sizeof(uint32_t) * ((size_t)src->size + 1));
+            uint32_t *index = (uint32_t*) p;
+            p += alignUp(sizeof(uint32_t) * (size_t)nonzeros[i]);
+            double *values = (double*) p;
+            p += alignUp(sizeof(double) * (size_t)nonzeros[i]);
+
+            uint32_t at = 0;
+            for (int o = 0; o < src->size; o++) {
+                const double *row = src->weights + (size_t)o * src->stride;
+                rowStart[o] = at;
+                for (int k = 0; k < src->inputs; k++) {
+                    if (row[k] == 0.0) continue;
+                    index[at] = (uint32_t) k;
+                    values[at++] = row[k];
+                }
+            }
+            rowStart[src->size] = at;
+
+            l->size = src->size;
+            l->inputs = src->inputs;
+            l->nonzeros = at;
+            l->rowStart = rowStart;
+            l->index = index;
+            l->values = values;
+        } else {
+            continue;
+        }
+        s->sparseLayers++;
+        s->weightBytes += sparseLayerBytes(l->size, l->nonzeros);
+    }
+    free(nonzeros);
+    return s;
+}
+
+/**
+ * Release a network made by sparsifyLayers
+ * Safe to call with NULL
+ */
+void freeSparseNetwork(SparseNetwork *s) {
+    if (s != NULL) {
+        alignedFree(s->arena);
+    }
+}
+
+/**
+ * Write a CSR layer out as a dense weight matrix
+ *
+ * @param s CSR layer
+ * @param weights size x stride matrix to fill, zeros included
+ * @param stride Elements between rows of weights
+ */
+void expandSparseLayer(const SparseLayer *s, double *weights, int stride) {
+    for (int o = 0; o < s->size; o++) {
+        double *row = weights + (size_t)o * stride;
+        memset(row, 0, sizeof(double) * s->inputs);
+        for (uint32_t j = s->rowStart[o]; j < s->rowStart[o + 1]; j++) {
+            row[s->index[j]] = s->values[j];
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+/*
+ * Magnitude pruning and compressed sparse row (CSR) weights.
+ *
+ * pruneLayer zeroes every weight of a layer whose magnitude is below a
+ * threshold, and pruneThreshold finds the threshold that zeroes a given
+ * fraction of them. A layer that is mostly zeros is then kept in CSR form:
+ * for each neuron o, its nonzero weights values[rowStart[o] .. rowStart[o+1])
+ * and, in the same positions of index, the inputs they multiply, in input
+ * order. The denseCsr kernels (kernels.h) read and multiply only those, so
+ * a layer pruned to 90% sparsity moves and computes about a tenth of the
+ * dense one; with its 32-bit index each stored weight costs 12 bytes
+ * instead of 8, which is why layers are only converted up to
+ * NN_CSR_DENSITY nonzeros.
+ *
+ * Model files store such layers in the same form (model.h), and a model
+ * opened from one runs on the arrays inside the mapping.
+ */
+
+#include <stdint.h>
+#include "nn.h"
+
+/* ========== Constants ========== */
+
+#define NN_CSR_DENSITY 0.3   // Nonzero weight fraction up to which a layer is stored and run as CSR
+
+/* ========== Data Structures ========== */
+
+typedef struct SparseLayer {
+    int size;                   // Neurons in this layer, 0 for a layer that stays dense
+    int inputs;                 // Neurons in the previous layer
+    uint32_t nonzeros;          // Stored weights
+    const uint32_t *rowStart;   // size + 1 offsets into index and values
+    const uint32_t *index;      // Input of each stored weight, ascending within a neuron
+    const double *values;       // Stored weights
+} SparseLayer;
+
+typedef struct SparseNetwork {
+    int layerCount;             // Layers including the input layer
+    SparseLayer *layers;        // layerCount entries, rowStart is NULL for dense layers and layers[0]
+    int sparseLayers;           // Layers in CSR form
+    size_t weightBytes;         // Bytes of their rowStart, index and values arrays
+    void *arena;                // Single allocation backing all of the above
+} SparseNetwork;
+
+/* ========== Function Declarations ========== */
+
+size_t countNonzeros(const Layer *l);
+double pruneThreshold(const Layer *l, double sparsity);
+size_t pruneLayer(Layer *l, double threshold);
+SparseNetwork *sparsifyLayers(const Layer *layers, const SparseLayer *stored, int layerCount, double maxDensity);
+void freeSparseNetwork(SparseNetwork *s);
+size_t sparseLayerBytes(int size, uint32_t nonzeros);
+void expandSparseLayer(const SparseLayer *s, double *weights, int stride);
+
+#endif // SPARSE_H
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "spsc.h"
+#include "nn.h"
+
+/* ========== Queue State ========== */
+
+struct SpscQueue {
+    // Producer's line
+    _Alignas(NN_ALIGN) atomic_size_t tail;   // Next slot to fill; pushes so far
+    size_t headCache;                        // Last head the producer read
+
+    // Consumer's line
+    _Alignas(NN_ALIGN) atomic_size_t head;   // Next slot to empty; pops so far
+    size_t tailCache;                        // Last tail the consumer read
+
+    // Shared, read-only after creation
+    _Alignas(NN_ALIGN) size_t mask;          // Capacity - 1, capacity a power of two
+    void **slots;
+    void *arena;                             // Queue and slots
+};
+
+/* ========== Creation ========== */
+
+/**
+ * Create an empty queue
+ *
+ * @param capacity Items it holds at most, rounded up to a power of two
+ * @return The queue, or NULL on failure
+ */
+SpscQueue *createSpscQueue(int capacity) {
+    size_t slots = 1;
+    while (slots < (size_t)(capacity > 1 ? capacity : 1)) slots <<= 1;
+
+    size_t header = (sizeof(SpscQueue) + NN_ALIGN - 1) & ~(size_t)(NN_ALIGN - 1);
+    unsigned char *p = alignedAlloc(header + sizeof(void*) * slots);
+    if (p == NULL) {
+        fprintf(stderr, "Memory allocation failed for queue\n");
+        return NULL;
+    }
+    SpscQueue *q = (SpscQueue*) p;
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+    q->headCache = 0;
+    q->tailCache = 0;
+    q->mask = slots - 1;
+    q->slots = (void**)(p + header);
+    q->arena = p;
+    return q;
+}
+
+/**
+ * Release a queue; items still in it are not freed
+ * Safe to call with NULL
+ */
+void freeSpscQueue(SpscQueue *q) {
+    if (q != NULL) {
+        alignedFree(q->arena);
+    }
+}
+
+/* ========== Producer ========== */
+
+/**
+ * Append an item; producer thread only
+ *
+ * @param q Queue
+ * @param item Non-NULL pointer to hand over
+ * @return 0 on success, 1 if the queue is full
+ */
+int spscPush(SpscQueue *q, void *item) {
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (tail - q->headCache > q->mask) {
+        q->headCache = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (tail - q->headCache > q->mask) {
+            return 1;
+        }
+    }
+    q->slots[tail & q->mask] = item;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+/* ========== Consumer ========== */
+
+/**
+ * Take the oldest item; consumer thread only
+ *
+ * @return The item, or NULL if the queue is empty
+ */
+void *spscPop(SpscQueue *q) {
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (head == q->tailCache) {
+        q->tailCache = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (head == q->tailCache) {
+            return NULL;
+        }
+    }
+    void *item = q->slots[head & q->mask];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return item;
+}
+
+/**
+ * Whether the queue holds nothing; a hint for the consumer, e.g. before it
+ * goes to sleep (any thread may call it)
+ */
+int spscEmpty(SpscQueue *q) {
+    return atomic_load_explicit(&q->head, memory_order_acquire) ==
+           atomic_load_explicit(&q->tail, memory_order_acquire);
+}
@@ -0,0 +1,33 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+/*
+ * Lock-free single-producer/single-consumer queue of pointers.
+ *
+ * A fixed ring of slots with one index per side: the producer alone writes
+ * the tail and the consumer alone writes the head, each on its own cache
+ * line, so neither side ever waits for the other or takes a lock. A push
+ * publishes its slot with a release store of the tail that the consumer's
+ * acquire load pairs with (and the same the other way for a pop), so the
+ * item a pointer refers to is fully written before the other side sees it.
+ * Each side also keeps a private copy of the other side's index and only
+ * reloads it when the ring looks full or empty.
+ *
+ * Exactly one thread may push and exactly one other thread may pop. The
+ * queue never blocks: a push to a full ring and a pop from an empty one
+ * fail at once, and callers that need to sleep do so on their own.
+ */
+
+/* ========== Data Structures ========== */
+
+typedef struct SpscQueue SpscQueue;
+
+/* ========== Function Declarations ========== */
+
+SpscQueue *createSpscQueue(int capacity);
+void freeSpscQueue(SpscQueue *q);
+int spscPush(SpscQueue *q, void *item);
+void *spscPop(SpscQueue *q);
+int spscEmpty(SpscQueue *q);
+
+#endif // SPSC_H
@@ -0,0 +1,96 @@
+// Program to check that feedForwardBatch gives bit-identical results whatever
+// the thread count
+//
+// usage: threadcheck [-m model.nnb] [-j threads] [-f first] [-l last]
+//   -m  binary model to load (default: the text files, like main.c)
+//   -j  threads to compare against one (default 4)
+//   -f  smallest batch to check (default 1)
+//   -l  largest batch to check (default 600)
+//
+// Every batch size from first to last runs once on one thread and once on
+// the pool, on the same pseudo-random digits, and the logits are compared
+// bit for bit. The default range covers the tile path, the single GEMM
+// chunk, and several chunks plus a remainder (NN_GEMM_BATCH is 256).
+// Prints the first mismatch of each failing size and exits 1 if any failed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nn.h"
+
+/**
+ * Fill count inputs with digit-like samples: mostly zero, a band of strokes
+ */
+static void makeInputs(double *inputs, int count, int size) {
+    unsigned state = 12345;
+    for (int i = 0; i < count * size; i++) {
+        state = state * 1103515245u + 12345u;
+        int pixel = i % size;
+        int inBand = pixel % 28 >= 6 && pixel % 28 < 22 && pixel / 28 >= 4 && pixel / 28 < 24;
+        inputs[i] = (inBand && (state >> 16) % 3 == 0) ? ((state >> 8) & 0xFF) / 255.0 : 0.0;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *modelPath = NULL;
+    int threads = 4, first = 1, last = 600;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            modelPath = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            first = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            last = atoi(argv[++i]);
+        } else {
+            threads = 0;
+            break;
+        }
+    }
+    if (threads < 2 || first < 1 || last < first) {
+        printf("usage: %s [-m model.nnb] [-j threads] [-f first] [-l last]\n", argv[0]);
+        return 1;
+    }
+
+    if (modelPath != NULL) {
+        if (loadNetwork(modelPath) != 0) return 1;
+    } else {
+        initializeNetwork(network_structure, n);
+        if (importNetwork() != 0) return 1;
+    }
+    const int inSize = Network[0].size, outSize = Network[n - 1].size;
+
+    double *inputs = malloc(sizeof(double) * last * inSize);
+    double *single = malloc(sizeof(double) * last * outSize);
+    double *pooled = malloc(sizeof(double) * last * outSize);
+    if (inputs == NULL || single == NULL || pooled == NULL) {
+        printf("Error: out of memory\n");
+        return 1;
+    }
+    makeInputs(inputs, last, inSize);
+
+    int failed = 0;
+    for (int count = first; count <= last; count++) {
+        setNetworkThreads(1, 0);
+        if (feedForwardBatch(inputs, count, single, 0) != 0) return 1;
+        setNetworkThreads(threads, 0);
+        if (feedForwardBatch(inputs, count, pooled, 0) != 0) return 1;
+
+        if (memcmp(single, pooled, sizeof(double) * count * outSize) != 0) {
+            int i = 0;
+            while (memcmp(&single[i], &pooled[i], sizeof(double)) == 0) i++;
+            printf("batch %d: sample %d logit %d is %.17g on 1 thread, %.17g on %d\n",
+                   count, i / outSize, i % outSize, single[i], pooled[i], threads);
+            failed++;
+        }
+    }
+    printf("%d of %d batch sizes differ between 1 and %d threads\n", failed, last - first + 1, threads);
+
+    free(inputs);
+    free(single);
+    free(pooled);
+    freeNetwork();
+    return failed > 0;
+}
@@ -0,0 +1,205 @@
+// Program to train the network on an IDX data set (e.g. MNIST) and write the
+// weights back in the text format importNetwork() reads
+//
+// usage: train [options] images.idx labels.idx
+//   -e n         epochs (default 10)
+//   -b n         minibatch size (default 64)
+//   -o sgd|adam  optimizer (default adam)
+//   -l rate      learning rate (default 0.001 for adam, 0.05 for sgd)
+//   -s seed      seed for the initial weights and the shuffling (default 1)
+//   -j n         threads (default: every online core)
+//   -r           start from random weights instead of the current text files
+//   -a layers    network description, e.g. 784,256:tanh,64,10 (default 784,128,10);
+//                a layer is relu, linear, sigmoid or tanh, hidden layers default
+//                to relu and the output layer to linear
+//   -v images.idx labels.idx   test set scored after every epoch
+//   -m model.nnb also save a binary model
+//   -n           do not write anything (benchmark)
+//
+// Reports the loss and accuracy of every epoch and the epochs per second.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nn.h"
+#include "idx.h"
+#include "trainer.h"
+#include "pool.h"
+
+#define CHUNK 1024   // Test samples scored at a time
+#define MAX_LAYERS 64
+
+/**
+ * Fraction of a test set the network classifies correctly
+ */
+static double testAccuracy(const IdxFile *images, const IdxFile *labels, double *inputs, double *outputs) {
+    const int inSize = Network[0].size;
+    const int outSize = Network[n-1].size;
+    size_t correct = 0;
+
+    for (size_t start = 0; start < images->count; start += CHUNK) {
+        int count = (int)((images->count - start < CHUNK) ? images->count - start : CHUNK);
+        idxToInput(images->data + start * images->itemSize, (size_t)count * inSize, inputs);
+        if (feedForwardBatch(inputs, count, outputs, 0) != 0) return 0.0;
+        for (int b = 0; b < count; b++) {
+            const double *row = outputs + (size_t)b * outSize;
+            int pred = 0;
+            for (int o = 1; o < outSize; o++) {
+                if (row[o] > row[pred]) pred = o;
+            }
+            correct += (pred == labels->data[start + b]);
+        }
+    }
+    return (double)correct / images->count;
+}
+
+/**
+ * Check that an image/label pair of IDX files fits the network
+ */
+static int checkDataSet(const IdxFile *images, const IdxFile *labels) {
+    if (images->itemSize != (size_t)Network[0].size || labels->itemSize != 1 || labels->count < images->count) {
+        printf("Error: data set does not match the network input (%zu pixels, %zu labels)\n",
+               images->itemSize, labels->count);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int epochs = 10, batchSize = 64, threads = 0, randomStart = 0, dryRun = 0;
+    int optimizer = NN_OPTIMIZER_ADAM;
+    double rate = 0.0;
+    unsigned seed = 1;
+    const char *modelPath = NULL;
+    const char *spec = NULL;
+    const char *testPaths[2] = { NULL, NULL };
+    const char *paths[2] = { NULL, NULL };
+    int positional = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            epochs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            batchSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            i++;
+            optimizer = strcmp(argv[i], "sgd") == 0 ? NN_OPTIMIZER_SGD : (strcmp(argv[i], "adam") == 0 ? NN_OPTIMIZER_ADAM : -1);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            randomStart = 1;
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            spec = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0 && i + 2 < argc) {
+            testPaths[0] = argv[++i];
+            testPaths[1] = argv[++i];
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            modelPath = argv[++i];
+        } else if (strcmp(argv[i], "-n") == 0) {
+            dryRun = 1;
+        } else if (argv[i][0] != '-' && positional < 2) {
+            paths[positional++] = argv[i];
+        } else {
+            positional = -1;
+            break;
+        }
+    }
+    if (positional != 2 || epochs < 1 || batchSize < 1 || optimizer < 0) {
+        printf("usage: %s [-e epochs] [-b batch] [-o sgd|adam] [-l rate] [-s seed] [-j threads] [-r] [-a layers]\n"
+               "       [-v test-images.idx test-labels.idx] [-m model.nnb] [-n] images.idx labels.idx\n", argv[0]);
+        return 1;
+    }
+
+    // --- Set up the network and the data ---
+    setNetworkPrecision(NN_PRECISION_FP64);
+    int structure[MAX_LAYERS], activations[MAX_LAYERS];
+    int layers = parseNetworkSpec(spec != NULL ? spec : "784,128,10", structure, activations, MAX_LAYERS);
+    if (layers < 0) return 1;
+    initializeNetwork(structure, layers);
+    for (int h = 1; h < n; h++) {
+        Network[h].activation = activations[h];
+    }
+    if (randomStart) {
+        randomizeLayers(Network, n, seed);
+        setNetworkPrecision(NN_PRECISION_FP64);   // Rebuild the forward pass's copies from the new weights
+    } else if (importNetwork() != 0) {
+        printf("Use -r to train from random weights\n");
+        return 1;
+    }
+    setNetworkThreads(threads, 0);
+
+    IdxFile images, labels, testImages, testLabels;
+    if (openIdx(paths[0], &images) != 0) return 1;
+    if (openIdx(paths[1], &labels) != 0) return 1;
+    if (checkDataSet(&images, &labels) != 0) return 1;
+    int testing = testPaths[0] != NULL;
+    if (testing) {
+        if (openIdx(testPaths[0], &testImages) != 0) return 1;
+        if (openIdx(testPaths[1], &testLabels) != 0) return 1;
+        if (checkDataSet(&testImages, &testLabels) != 0) return 1;
+    }
+
+    double *inputs = malloc(sizeof(double) * CHUNK * Network[0].size);
+    double *outputs = malloc(sizeof(double) * CHUNK * Network[n-1].size);
+    if (inputs == NULL || outputs == NULL) {
+        printf("Error: out of memory\n");
+        return 1;
+    }
+
+    TrainOptions options;
+    defaultTrainOptions(&options, optimizer);
+    options.batchSize = batchSize;
+    options.seed = seed;
+    if (rate > 0) options.learningRate = rate;
+    Trainer *trainer = createTrainer(Network, n, &options);
+    if (trainer == NULL) return 1;
+
+    printf("\nTraining on %zu samples: %s, learning rate %g, batch %d, %d threads\n",
+           images.count, optimizer == NN_OPTIMIZER_ADAM ? "adam" : "sgd", options.learningRate,
+           batchSize, poolThreads());
+    if (testing) {
+        printf("Test accuracy before training: %.2f%%\n", 100.0 * testAccuracy(&testImages, &testLabels, inputs, outputs));
+    }
+
+    // --- Train ---
+    double trainSeconds = 0.0;
+    for (int e = 1; e <= epochs; e++) {
+        TrainStats stats;
+        if (trainEpoch(trainer, images.data, labels.data, (int)images.count, &stats) != 0) return 1;
+        trainSeconds += stats.seconds;
+        printf("Epoch %d/%d: loss %.4f, train accuracy %.2f%%, %.2f s (%.0f images/s)",
+               e, epochs, stats.loss, 100.0 * stats.accuracy, stats.seconds, images.count / stats.seconds);
+        // The trainer only rewrites the weights; the copies batches run on (see createTrainer) are rebuilt
+        if (setNetworkPrecision(NN_PRECISION_FP64) != 0) return 1;
+        if (testing) {
+            printf(", test accuracy %.2f%%", 100.0 * testAccuracy(&testImages, &testLabels, inputs, outputs));
+        }
+        printf("\n");
+    }
+    printf("Trained %d epochs in %.2f s: %.3f epochs/s\n", epochs, trainSeconds, epochs / trainSeconds);
+
+    // --- Save ---
+    int status = 0;
+    if (!dryRun) {
+        status = exportNetwork();
+        if (status == 0 && modelPath != NULL) {
+            status = saveNetwork(modelPath);
+        }
+    }
+
+    freeTrainer(trainer);
+    free(inputs);
+    free(outputs);
+    closeIdx(&images);
+    closeIdx(&labels);
+    if (testing) {
+        closeIdx(&testImages);
+        closeIdx(&testLabels);
+    }
+    freeNetwork();
+    return status;
+}
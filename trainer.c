@@ -0,0 +1,553 @@
+/*
+ * Copyright (c) 2025 Satish Singh & Arman Badyal
+ * All Rights Reserved.
+ *
+ * Unauthorized copying, modification, distribution, or use of this software,
+ * via any medium, is strictly prohibited without explicit permission from
+ * the author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <stdint.h>
+#include "trainer.h"
+#include "kernels.h"
+#include "model.h"
+#include "pool.h"
+#include "gemm.h"
+
+#define UPDATE_GRAIN 8   // Neuron rows per work item of the weight update
+
+/* ========== Private Structures ========== */
+
+// Per-tile buffers; one slot per tile of a minibatch
+typedef struct TileSlot {
+    double **acts;         // acts[h]: size x NN_BATCH_TILE activations, acts[0] is the input tile
+    double *delta[2];      // Ping-pong gradients w.r.t. a layer's pre-activations
+    double **gradW;        // gradW[h]: size x stride, laid out like the layer's weights
+    double **gradB;        // gradB[h]: one per neuron
+    double *probs;         // Softmax of one sample
+    void *workspace;       // Scratch of the weight-gradient GEMM
+    double loss;           // Summed cross-entropy of the tile
+    int correct;           // Samples of the tile predicted correctly
+} TileSlot;
+
+struct Trainer {
+    Layer *layers;         // Trained in place
+    int layerCount;
+    int rows;              // Neuron rows over every dense layer
+    int *rowLayer;         // Layer of each row
+    int *rowIndex;         // Neuron of each row within its layer
+    TrainOptions options;
+    int slots;             // Tiles per minibatch
+    TileSlot *slot;
+    size_t workspaceBytes; // Per slot
+    double **transposed;   // transposed[h]: inputs x transposedStride copy of W (h >= 2)
+    int *transposedStride;
+    double *zeroBias;      // Zeros, for the bias-free input gradient
+    double **stateW[2];    // Optimizer state per weight (SGD velocity; Adam mean, squared mean)
+    double **stateB[2];    // Same per bias
+    long step;             // Weight updates so far, for the Adam bias correction
+    int *order;            // Shuffled sample order
+    int orderCapacity;
+    uint64_t rng;          // State of the shuffle generator
+    void *arena;           // Everything above except order
+};
+
+// One minibatch, shared by the tile and update tasks
+typedef struct BatchJob {
+    Trainer *trainer;
+    const unsigned char *images;
+    const unsigned char *labels;
+    const int *samples;    // Sample indices of the minibatch
+    int count;             // Samples in the minibatch
+    double adamRate;       // Learning rate with the Adam bias correction folded in
+} BatchJob;
+
+/* ========== Helpers ========== */
+
+static size_t alignUp(size_t bytes) {
+    return (bytes + NN_ALIGN - 1) & ~(size_t)(NN_ALIGN - 1);
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * splitmix64: small, seedable and the same on every platform, unlike rand()
+ */
+static uint64_t nextRandom(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Uniform double in (0, 1)
+ */
+static double nextUniform(uint64_t *state) {
+    return ((nextRandom(state) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+/* ========== Setup ========== */
+
+/**
+ * Fill options with the usual settings for an optimizer
+ *
+ * @param options Options to fill
+ * @param optimizer NN_OPTIMIZER_SGD or NN_OPTIMIZER_ADAM
+ */
+void defaultTrainOptions(TrainOptions *options, int optimizer) {
+    memset(options, 0, sizeof(*options));
+    options->optimizer = optimizer;
+    options->batchSize = 64;
+    options->learningRate = (optimizer == NN_OPTIMIZER_ADAM) ? 0.001 : 0.05;
+    options->momentum = 0.9;
+    options->beta1 = 0.9;
+    options->beta2 = 0.999;
+    options->epsilon = 1e-8;
+    options->seed = 1;
+}
+
+/**
+ * He-initialize the dense layers for training from scratch
+ * Weights are normal with variance 2 / inputs, biases zero. initializeNetwork's
+ * uniform [-1, 1] weights saturate a 784-input layer and do not train.
+ *
+ * @param layers Layers to overwrite, input layer first
+ * @param layerCount Number of layers
+ * @param seed Seed of the generator
+ */
+void randomizeLayers(Layer *layers, int layerCount, unsigned seed) {
+    uint64_t state = seed;
+    for (int h = 1; h < layerCount; h++) {
+        Layer *l = &layers[h];
+        double sigma = sqrt(2.0 / l->inputs);
+        for (int o = 0; o < l->size; o++) {
+            double *row = l->weights + (size_t)o * l->stride;
+            for (int k = 0; k < l->inputs; k++) {
+                // Box-Muller
+                double u = nextUniform(&state), v = nextUniform(&state);
+                row[k] = sigma * sqrt(-2.0 * log(u)) * cos(6.283185307179586 * v);
+            }
+            l->bias[o] = 0.0;
+        }
+    }
+}
+
+/**
+ * Create a trainer for the given layers
+ * The layers must be writable (not loaded from a model file) and stay alive
+ * while the trainer is used. Training rewrites their fp64 weights only; call
+ * setNetworkPrecision after every epoch (and before saving) to rebuild the
+ * copies the forward passes run on: reduced precision, or at fp64 the
+ * column-major first layer, the CSR layers and the GEMM-packed weights of
+ * feedForwardBatch. Until then those still hold the old weights.
+ *
+ * @param layers Layers to train, input layer first
+ * @param layerCount Number of layers
+ * @param options Settings, see defaultTrainOptions
+ * @return The trainer, or NULL on failure
+ */
+Trainer *createTrainer(Layer *layers, int layerCount, const TrainOptions *options) {
+    if (layerCount < 2 || options->batchSize < 1 || !(options->learningRate > 0) ||
+        (options->optimizer != NN_OPTIMIZER_SGD && options->optimizer != NN_OPTIMIZER_ADAM)) {
+        printf("Error: Invalid training options\n");
+        return NULL;
+    }
+
+    const int T = NN_BATCH_TILE;
+    const int slots = (options->batchSize + T - 1) / T;
+    const int states = (options->optimizer == NN_OPTIMIZER_ADAM) ? 2 : 1;
+    int rows = 0, widest = 0;
+    for (int h = 0; h < layerCount; h++) {
+        if (layers[h].size > widest) widest = layers[h].size;
+        if (h > 0) rows += layers[h].size;
+    }
+
+    // Work out the arena size
+    size_t perLayer = alignUp(sizeof(double*) * layerCount);
+    size_t params = 0;   // Bytes of one set of weights and biases
+    for (int h = 1; h < layerCount; h++) {
+        params += sizeof(double) * (size_t)layers[h].size * layers[h].stride;
+        params += alignUp(sizeof(double) * layers[h].size);
+    }
+    size_t workspaceBytes = gemmWorkspaceBytes(widest, widest, T);
+    size_t slotBytes = 3 * perLayer + 2 * alignUp(sizeof(double) * widest * T) +
+                       alignUp(sizeof(double) * widest) + workspaceBytes + params;
+    for (int h = 0; h < layerCount; h++) {
+        slotBytes += alignUp(sizeof(double) * (size_t)layers[h].size * T);
+    }
+    size_t total = alignUp(sizeof(Trainer)) + alignUp(sizeof(TileSlot) * slots) + (size_t)slots * slotBytes;
+    total += 2 * alignUp(sizeof(int) * rows);
+    total += perLayer + alignUp(sizeof(int) * layerCount) + alignUp(sizeof(double) * widest);
+    for (int h = 2; h < layerCount; h++) {
+        total += (size_t)layers[h].inputs * alignUp(sizeof(double) * layers[h].size);
+    }
+    total += (size_t)states * (2 * perLayer + params);
+
+    unsigned char *p = alignedAlloc(total);
+    if (p == NULL) {
+        fprintf(stderr, "Memory allocation failed for trainer\n");
+        return NULL;
+    }
+
+    Trainer *t = (Trainer*) p;
+    p += alignUp(sizeof(Trainer));
+    t->arena = t;
+    t->layers = layers;
+    t->layerCount = layerCount;
+    t->options = *options;
+    t->rng = options->seed;
+    t->slots = slots;
+    t->rows = rows;
+    t->workspaceBytes = workspaceBytes;
+
+    // Row tables for the update tasks
+    t->rowLayer = (int*) p;
+    p += alignUp(sizeof(int) * rows);
+    t->rowIndex = (int*) p;
+    p += alignUp(sizeof(int) * rows);
+    for (int h = 1, r = 0; h < layerCount; h++) {
+        for (int o = 0; o < layers[h].size; o++, r++) {
+            t->rowLayer[r] = h;
+            t->rowIndex[r] = o;
+        }
+    }
+
+    // Tile slots
+    t->slot = (TileSlot*) p;
+    p += alignUp(sizeof(TileSlot) * slots);
+    for (int s = 0; s < slots; s++) {
+        TileSlot *ts = &t->slot[s];
+        ts->acts = (double**) p;
+        p += perLayer;
+        ts->gradW = (double**) p;
+        p += perLayer;
+        ts->gradB = (double**) p;
+        p += perLayer;
+        for (int h = 0; h < layerCount; h++) {
+            ts->acts[h] = (double*) p;
+            p += alignUp(sizeof(double) * (size_t)layers[h].size * T);
+        }
+        for (int i = 0; i < 2; i++) {
+            ts->delta[i] = (double*) p;
+            p += alignUp(sizeof(double) * widest * T);
+        }
+        ts->probs = (double*) p;
+        p += alignUp(sizeof(double) * widest);
+        ts->workspace = p;
+        p += workspaceBytes;
+        for (int h = 1; h < layerCount; h++) {
+            ts->gradW[h] = (double*) p;
+            p += sizeof(double) * (size_t)layers[h].size * layers[h].stride;
+            ts->gradB[h] = (double*) p;
+            p += alignUp(sizeof(double) * layers[h].size);
+        }
+    }
+
+    // Transposed weights for the input gradients (layer 1 has none to pass back)
+    t->transposed = (double**) p;
+    p += perLayer;
+    t->transposedStride = (int*) p;
+    p += alignUp(sizeof(int) * layerCount);
+    t->zeroBias = (double*) p;
+    p += alignUp(sizeof(double) * widest);
+    for (int h = 2; h < layerCount; h++) {
+        const Layer *l = &layers[h];
+        t->transposedStride[h] = (int)(alignUp(sizeof(double) * l->size) / sizeof(double));
+        t->transposed[h] = (double*) p;
+        p += sizeof(double) * (size_t)l->inputs * t->transposedStride[h];
+        transposeMatrix(l->weights, (size_t)l->stride, t->transposed[h], (size_t)t->transposedStride[h],
+                        l->size, l->inputs);
+    }
+
+    // Optimizer state, zeroed by alignedAlloc
+    for (int i = 0; i < states; i++) {
+        t->stateW[i] = (double**) p;
+        p += perLayer;
+        t->stateB[i] = (double**) p;
+        p += perLayer;
+        for (int h = 1; h < layerCount; h++) {
+            t->stateW[i][h] = (double*) p;
+            p += sizeof(double) * (size_t)layers[h].size * layers[h].stride;
+            t->stateB[i][h] = (double*) p;
+            p += alignUp(sizeof(double) * layers[h].size);
+        }
+    }
+    return t;
+}
+
+/**
+ * Release a trainer made by createTrainer
+ * Safe to call with NULL
+ */
+void freeTrainer(Trainer *t) {
+    if (t != NULL) {
+        free(t->order);
+        alignedFree(t->arena);
+    }
+}
+
+/* ========== Backpropagation ========== */
+
+/**
+ * Multiply a gradient by the derivative of a layer's activation, written in
+ * terms of the activated outputs y
+ */
+static void activationGradient(int activation, const double *y, double *delta, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        switch (activation) {
+        case NN_ACTIVATION_RELU:    if (!(y[i] > 0)) delta[i] = 0.0; break;
+        case NN_ACTIVATION_SIGMOID: delta[i] *= y[i] * (1.0 - y[i]); break;
+        case NN_ACTIVATION_TANH:    delta[i] *= 1.0 - y[i] * y[i]; break;
+        default: break;   // Linear
+        }
+    }
+}
+
+/**
+ * Forward and backward pass of one tile, accumulating into its slot
+ */
+static void runTile(const BatchJob *job, int tile) {
+    const Trainer *t = job->trainer;
+    const Layer *layers = t->layers;
+    const int T = NN_BATCH_TILE;
+    const int last = t->layerCount - 1;
+    const int inSize = layers[0].size;
+    const int outSize = layers[last].size;
+    const int start = tile * T;
+    const int count = (job->count - start < T) ? job->count - start : T;
+    TileSlot *ts = &t->slot[tile];
+
+    // Gather the samples into a feature-major tile, zero-padding a short one
+    double *x = ts->acts[0];
+    for (int b = 0; b < T; b++) {
+        const unsigned char *pixels = job->images + (size_t)job->samples[start + b < job->count ? start + b : start] * inSize;
+        for (int k = 0; k < inSize; k++) {
+            x[(size_t)k * T + b] = b < count ? pixels[k] / 255.0 : 0.0;
+        }
+    }
+
+    // Forward, each layer with its activation
+    for (int h = 1; h <= last; h++) {
+        const Layer *l = &layers[h];
+        nnKernels->denseTile(l->weights, l->stride, l->bias, ts->acts[h-1], l->inputs, l->size,
+                             ts->acts[h], l->activation == NN_ACTIVATION_RELU);
+        if (l->activation > NN_ACTIVATION_LINEAR) {
+            applyActivation(l->activation, ts->acts[h], (size_t)l->size * T);
+        }
+    }
+
+    // Softmax cross-entropy over the output values: their gradient is p - onehot
+    double *delta = ts->delta[0];
+    const double scale = 1.0 / job->count;
+    for (int b = 0; b < T; b++) {
+        if (b >= count) {
+            for (int o = 0; o < outSize; o++) delta[(size_t)o * T + b] = 0.0;
+            continue;
+        }
+        int label = job->labels[job->samples[start + b]];
+        for (int o = 0; o < outSize; o++) ts->probs[o] = ts->acts[last][(size_t)o * T + b];
+        ts->correct += nnKernels->argmax(ts->probs, outSize) == label;
+        nnKernels->softmax(ts->probs, ts->probs, outSize);
+        ts->loss -= log(ts->probs[label] > 1e-300 ? ts->probs[label] : 1e-300);
+        for (int o = 0; o < outSize; o++) {
+            delta[(size_t)o * T + b] = (ts->probs[o] - (o == label)) * scale;
+        }
+    }
+    activationGradient(layers[last].activation, ts->acts[last], delta, (size_t)outSize * T);
+
+    // Backward, last layer first
+    for (int h = last; h >= 1; h--) {
+        const Layer *l = &layers[h];
+        const double *in = ts->acts[h-1];
+
+        // gradW += delta * in^T, one GEMM over the tile's samples
+        gemm(0, 1, l->size, l->inputs, T, delta, T, in, T, ts->gradW[h], l->stride, 1,
+             ts->workspace, t->workspaceBytes);
+        for (int o = 0; o < l->size; o++) {
+            const double *d = delta + (size_t)o * T;
+            double sum = 0.0;
+            for (int b = 0; b < T; b++) sum += d[b];
+            ts->gradB[h][o] += sum;
+        }
+
+        if (h > 1) {
+            // Pass the gradient back through W and the previous layer's activation
+            double *back = (delta == ts->delta[0]) ? ts->delta[1] : ts->delta[0];
+            nnKernels->denseTile(t->transposed[h], t->transposedStride[h], t->zeroBias, delta,
+                                 l->size, l->inputs, back, 0);
+            activationGradient(layers[h-1].activation, in, back, (size_t)l->inputs * T);
+            delta = back;
+        }
+    }
+}
+
+/**
+ * Pool task: tiles [begin, end) of a minibatch
+ */
+static void runTiles(void *arg, int begin, int end, int worker) {
+    (void) worker;
+    for (int tile = begin; tile < end; tile++) {
+        runTile(arg, tile);
+    }
+}
+
+/**
+ * Apply one optimizer step to a vector of parameters and clear its gradient
+ *
+ * @param value Parameters
+ * @param grad Summed gradient, zeroed on return
+ * @param s0 SGD velocity or Adam gradient mean
+ * @param s1 Adam squared gradient mean (unused for SGD)
+ * @param length Number of parameters
+ */
+static void applyStep(const BatchJob *job, double *value, double *grad, double *s0, double *s1, int length) {
+    const TrainOptions *opt = &job->trainer->options;
+    if (opt->optimizer == NN_OPTIMIZER_ADAM) {
+        for (int k = 0; k < length; k++) {
+            s0[k] = opt->beta1 * s0[k] + (1.0 - opt->beta1) * grad[k];
+            s1[k] = opt->beta2 * s1[k] + (1.0 - opt->beta2) * grad[k] * grad[k];
+            value[k] -= job->adamRate * s0[k] / (sqrt(s1[k]) + opt->epsilon);
+        }
+    } else {
+        for (int k = 0; k < length; k++) {
+            s0[k] = opt->momentum * s0[k] - opt->learningRate * grad[k];
+            value[k] += s0[k];
+        }
+    }
+    memset(grad, 0, sizeof(double) * length);
+}
+
+/**
+ * Pool task: sum the tile gradients of neuron rows [begin, end) and apply
+ * the optimizer to them
+ */
+static void updateRows(void *arg, int begin, int end, int worker) {
+    const BatchJob *job = arg;
+    Trainer *t = job->trainer;
+    const int tiles = (job->count + NN_BATCH_TILE - 1) / NN_BATCH_TILE;
+    const int adam = t->options.optimizer == NN_OPTIMIZER_ADAM;
+    (void) worker;
+
+    for (int r = begin; r < end; r++) {
+        const int h = t->rowLayer[r], o = t->rowIndex[r];
+        Layer *l = &t->layers[h];
+        const size_t at = (size_t)o * l->stride;
+        double *gw = t->slot[0].gradW[h] + at;
+        double *gb = t->slot[0].gradB[h] + o;
+
+        // Fold the other slots into slot 0 in slot order, so the sum does not
+        // depend on the thread count
+        for (int s = 1; s < tiles; s++) {
+            double *sw = t->slot[s].gradW[h] + at;
+            for (int k = 0; k < l->inputs; k++) gw[k] += sw[k];
+            *gb += t->slot[s].gradB[h][o];
+            memset(sw, 0, sizeof(double) * l->inputs);
+            t->slot[s].gradB[h][o] = 0.0;
+        }
+
+        applyStep(job, l->weights + at, gw, t->stateW[0][h] + at, adam ? t->stateW[1][h] + at : NULL, l->inputs);
+        applyStep(job, l->bias + o, gb, t->stateB[0][h] + o, adam ? t->stateB[1][h] + o : NULL, 1);
+
+        // Refresh this neuron's column of the transposed copy
+        if (h > 1) {
+            for (int k = 0; k < l->inputs; k++) {
+                t->transposed[h][(size_t)k * t->transposedStride[h] + o] = l->weights[at + k];
+            }
+        }
+    }
+}
+
+/* ========== Training ========== */
+
+/**
+ * Train for one pass over a data set
+ * Samples are visited in a new random order every epoch. Pixels are scaled
+ * to [0, 1] like idxToInput.
+ *
+ * @param t Trainer
+ * @param images count images of layers[0].size bytes each, back to back
+ * @param labels count class indices
+ * @param count Number of samples
+ * @param stats Receives the loss, accuracy and time of the epoch (may be NULL)
+ * @return 0 on success, 1 on failure
+ */
+int trainEpoch(Trainer *t, const unsigned char *images, const unsigned char *labels, int count,
+               TrainStats *stats) {
+    const int outSize = t->layers[t->layerCount - 1].size;
+    for (int i = 0; i < count; i++) {
+        if (labels[i] >= outSize) {
+            printf("Error: label %d of sample %d is out of range\n", labels[i], i);
+            return 1;
+        }
+    }
+    if (count > t->orderCapacity) {
+        int *order = realloc(t->order, sizeof(int) * count);
+        if (order == NULL) {
+            fprintf(stderr, "Memory allocation failed for training order\n");
+            return 1;
+        }
+        t->order = order;
+        t->orderCapacity = count;
+    }
+
+    double started = nowSeconds();
+
+    // Fisher-Yates shuffle
+    for (int i = 0; i < count; i++) t->order[i] = i;
+    for (int i = count - 1; i > 0; i--) {
+        int j = (int)(nextRandom(&t->rng) % (uint64_t)(i + 1));
+        int tmp = t->order[i];
+        t->order[i] = t->order[j];
+        t->order[j] = tmp;
+    }
+
+    double loss = 0.0;
+    long correct = 0;
+    for (int start = 0; start < count; start += t->options.batchSize) {
+        BatchJob job = { t, images, labels, t->order + start, 0, 0.0 };
+        job.count = (count - start < t->options.batchSize) ? count - start : t->options.batchSize;
+        int tiles = (job.count + NN_BATCH_TILE - 1) / NN_BATCH_TILE;
+
+        for (int s = 0; s < tiles; s++) {
+            t->slot[s].loss = 0.0;
+            t->slot[s].correct = 0;
+        }
+        if (poolThreads() > 1 && tiles > 1) {
+            poolParallelFor(tiles, 1, runTiles, &job);
+        } else {
+            runTiles(&job, 0, tiles, 0);
+        }
+        for (int s = 0; s < tiles; s++) {
+            loss += t->slot[s].loss;
+            correct += t->slot[s].correct;
+        }
+
+        t->step++;
+        if (t->options.optimizer == NN_OPTIMIZER_ADAM) {
+            job.adamRate = t->options.learningRate * sqrt(1.0 - pow(t->options.beta2, (double)t->step)) /
+                           (1.0 - pow(t->options.beta1, (double)t->step));
+        }
+        if (poolThreads() > 1) {
+            poolParallelFor(t->rows, UPDATE_GRAIN, updateRows, &job);
+        } else {
+            updateRows(&job, 0, t->rows, 0);
+        }
+    }
+
+    if (stats != NULL) {
+        stats->loss = count > 0 ? loss / count : 0.0;
+        stats->accuracy = count > 0 ? (double)correct / count : 0.0;
+        stats->seconds = nowSeconds() - started;
+    }
+    return 0;
+}
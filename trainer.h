@@ -0,0 +1,61 @@
+#ifndef TRAINER_H
+#define TRAINER_H
+
+/*
+ * Minibatch training of the dense network of any depth.
+ *
+ * The loss is the cross-entropy of the softmax of the output layer; it is
+ * backpropagated through each layer's activation (relu, linear, sigmoid or
+ * tanh, see Layer.activation) and the weights are updated
+ * with SGD (with momentum) or Adam. A minibatch is cut into tiles of
+ * NN_BATCH_TILE samples that go through the same feature-major kernels as
+ * batched inference:
+ *
+ *   forward       a = f(W x + b)               denseTile
+ *   weight grad   dW[o] += sum_b d[o][b] x[b]  dense, with the x tile as the matrix
+ *   input grad    dx = W^T d                   denseTile on a transposed copy of W
+ *
+ * The tiles of a minibatch are spread over the thread pool (setNetworkThreads).
+ * Every tile accumulates into its own gradient slot and the slots are summed
+ * in a fixed order, so results do not depend on the thread count; a batch of
+ * B samples keeps at most B / NN_BATCH_TILE threads busy. Every buffer is
+ * allocated by createTrainer, apart from the shuffle order, which grows once
+ * to the size of the training set.
+ */
+
+#include "nn.h"
+
+#define NN_OPTIMIZER_SGD  0   // SGD with momentum
+#define NN_OPTIMIZER_ADAM 1   // Adam (Kingma & Ba)
+
+/* ========== Data Structures ========== */
+
+typedef struct TrainOptions {
+    int optimizer;         // NN_OPTIMIZER_*
+    int batchSize;         // Samples per weight update
+    double learningRate;
+    double momentum;       // SGD only
+    double beta1;          // Adam decay of the gradient mean
+    double beta2;          // Adam decay of the squared gradient mean
+    double epsilon;        // Adam denominator guard
+    unsigned seed;         // Seed for the shuffling of every epoch
+} TrainOptions;
+
+typedef struct TrainStats {
+    double loss;           // Mean cross-entropy over the epoch
+    double accuracy;       // Fraction of samples classified correctly before their update
+    double seconds;        // Wall time of the epoch
+} TrainStats;
+
+typedef struct Trainer Trainer;
+
+/* ========== Function Declarations ========== */
+
+void defaultTrainOptions(TrainOptions *options, int optimizer);
+void randomizeLayers(Layer *layers, int layerCount, unsigned seed);
+Trainer *createTrainer(Layer *layers, int layerCount, const TrainOptions *options);
+void freeTrainer(Trainer *t);
+int trainEpoch(Trainer *t, const unsigned char *images, const unsigned char *labels, int count,
+               TrainStats *stats);
+
+#endif // TRAINER_H
@@ -1,55 +1,319 @@
-// Program to transpost the matrix stored in file W1.txt(784X128) and W2.txt(128X10)
+// Program to transpose the text weight matrices, of any size, without holding them in memory
+//
+// usage: transpose [-m MB] [in.txt out.txt]
+//   -m  memory for the tiles in megabytes (default 64)
+//
+// Without files, every W<i>.txt in the working directory (one row per input)
+// is written to W<i>_transpose.txt (one row per neuron). importNetwork and
+// convert read either orientation, so this is only needed to hand the files
+// to something else. The shape is taken from the file: the first line gives
+// the columns and every line must have as many numbers.
+//
+// The input is streamed in bands of rows that fit the memory budget; each
+// band is transposed tile by tile (transposeMatrix) and appended to a
+// scratch file next to the output, so band b holds its columns one after
+// the other. The output is then written a group of rows at a time, reading
+// each group's slice of every band back. Memory stays within the budget
+// however large the matrix; a matrix that fits in one band never touches
+// the scratch file.
 
+#define _FILE_OFFSET_BITS 64
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "model.h"
+#include "parse.h"
 
-int main(){
-    FILE *f1 = fopen("W1.txt", "r");
-    FILE *f2 = fopen("W2.txt", "r");
-    FILE *f3 = fopen("W1_transpose.txt", "w");
-    FILE *f4 = fopen("W2_transpose.txt", "w");
+#ifdef _WIN32
+#define seekFile _fseeki64
+#else
+#define seekFile fseeko
+#endif
 
-    if (f1 == NULL || f2 == NULL || f3 == NULL || f4 == NULL) {
-        printf("Error opening file.\n");
-        return 1;
+#define READ_BUFFER (1 << 20)
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Buffered number reader that keeps track of lines
+typedef struct TextReader {
+    FILE *f;
+    const char *path;
+    char *buf;
+    size_t pos, len;
+    size_t usable;     // Bytes before the last whitespace, or len at the end of the file
+    int eof;
+    long line;         // Line of the next character, from 1
+    int lineCount;     // Numbers read on the current line so far
+} TextReader;
+
+/**
+ * Refill the buffer, keeping the unread tail
+ * Only whole numbers are handed to parseDouble: the buffer is cut after its
+ * last whitespace until the end of the file is reached.
+ */
+static void fillReader(TextReader *r) {
+    memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+    r->len -= r->pos;
+    r->pos = 0;
+    if (!r->eof) {
+        size_t got = fread(r->buf + r->len, 1, READ_BUFFER - r->len, r->f);
+        r->len += got;
+        if (got == 0) r->eof = 1;
     }
+    r->usable = r->len;
+    if (r->eof) return;
+    while (r->usable > 0 && strchr(" \t\r\n", r->buf[r->usable - 1]) == NULL) r->usable--;
+}
 
-    double matrix[784][128];
-    double matrix2[128][10];
+/**
+ * Read the next number
+ *
+ * @param r Reader
+ * @param value Receives the number
+ * @param cols Numbers every line must have, 0 while still counting the first line
+ * @return 1 for a number, 0 at the end of the file, -1 on a malformed file
+ */
+static int readNumber(TextReader *r, double *value, int cols) {
+    for (;;) {
+        while (r->pos < r->len && strchr(" \t\r\n", r->buf[r->pos]) != NULL) {
+            if (r->buf[r->pos++] != '\n') continue;
+            if (cols > 0 && r->lineCount != 0 && r->lineCount != cols) {
+                fprintf(stderr, "Error: %s line %ld has %d numbers instead of %d\n", r->path, r->line, r->lineCount, cols);
+                return -1;
+            }
+            if (cols == 0 && r->lineCount > 0) return 0;   // End of the first line
+            r->lineCount = 0;
+            r->line++;
+        }
+        if (r->pos < r->usable) break;
+        fillReader(r);
+        if (r->len == 0) {
+            if (cols > 0 && r->lineCount != 0 && r->lineCount != cols) {
+                fprintf(stderr, "Error: %s line %ld has %d numbers instead of %d\n", r->path, r->line, r->lineCount, cols);
+                return -1;
+            }
+            return 0;
+        }
+    }
+    const char *end = parseDouble(r->buf + r->pos, r->buf + r->usable, value);
+    if (end == NULL) {
+        fprintf(stderr, "Error: %s line %ld holds something other than a number\n", r->path, r->line);
+        return -1;
+    }
+    r->pos = (size_t)(end - r->buf);
+    r->lineCount++;
+    return 1;
+}
 
-    // Read the first matrix from W1.txt
-    for (int i = 0; i < 784; i++) {
-        for (int j = 0; j < 128; j++) {
-            fscanf(f1, "%lf", &matrix[i][j]);
+/**
+ * Write rows x cols values as text, one row per line
+ * %.17g reads back to the same double, as in exportNetwork.
+ */
+static int writeRows(FILE *f, const double *values, int rows, int cols) {
+    for (int i = 0; i < rows; i++) {
+        const double *row = values + (size_t)i * cols;
+        for (int j = 0; j < cols; j++) {
+            if (fprintf(f, j + 1 < cols ? "%.17g " : "%.17g\n", row[j]) < 0) return 1;
         }
     }
+    return 0;
+}
+
+/**
+ * Transpose one text matrix file into another
+ *
+ * @param in Input file
+ * @param out Output file
+ * @param budget Bytes of tiles to use at most
+ * @return 0 on success, 1 on failure
+ */
+static int transposeFile(const char *in, const char *out, size_t budget) {
+    TextReader r = { fopen(in, "rb"), in, malloc(READ_BUFFER), 0, 0, 0, 0, 1, 0 };
+    if (r.f == NULL || r.buf == NULL) {
+        fprintf(stderr, "Error opening %s\n", in);
+        if (r.f) fclose(r.f);
+        free(r.buf);
+        return 1;
+    }
 
-    // Write the transposed matrix to W1_transpose.txt
-    for (int i = 0; i < 128; i++) {
-        for (int j = 0; j < 784; j++) {
-            fprintf(f3, "%.17lf ", matrix[j][i]);
+    // --- The first line gives the columns ---
+    size_t firstCapacity = 1024, cols = 0;
+    double *first = malloc(sizeof(double) * firstCapacity), v;
+    int got = 0;
+    while (first != NULL && (got = readNumber(&r, &v, 0)) == 1) {
+        if (cols == firstCapacity) {
+            double *grown = realloc(first, sizeof(double) * (firstCapacity *= 2));
+            if (grown == NULL) {
+                free(first);
+                first = NULL;
+                break;
+            }
+            first = grown;
         }
-        fprintf(f3, "\n");
+        first[cols++] = v;
+    }
+    if (first == NULL || cols == 0 || got < 0) {
+        if (first == NULL) fprintf(stderr, "Memory allocation failed for %s\n", in);
+        else if (got == 0) fprintf(stderr, "Error: %s is empty\n", in);
+        free(first);
+        free(r.buf);
+        fclose(r.f);
+        return 1;
     }
+    r.lineCount = 0;
+    r.line++;
+
+    // --- Pass 1: bands of rows, transposed and spilled to the scratch file ---
+    size_t band = budget / 2 / (sizeof(double) * cols);
+    if (band < 1) band = 1;
+    double *rowsIn = malloc(sizeof(double) * band * cols);
+    double *colsOut = malloc(sizeof(double) * band * cols);
+    char *scratchPath = malloc(strlen(out) + 7);
+    FILE *scratch = NULL;
+    size_t rows = 0, filled = 0;
+    int status = (rowsIn == NULL || colsOut == NULL || scratchPath == NULL) ? 1 : 0;
+    if (status == 0) {
+        memcpy(rowsIn, first, sizeof(double) * cols);
+        filled = 1;
+        sprintf(scratchPath, "%s.tiles", out);
+    }
+    free(first);
+
+    while (status == 0) {
+        size_t k = 0;
+        while (filled < band && (got = readNumber(&r, &rowsIn[filled * cols + k], (int)cols)) == 1) {
+            if (++k == cols) {
+                k = 0;
+                filled++;
+            }
+        }
+        if (filled < band && got < 0) status = 1;
+        if (status != 0 || filled == 0) break;
 
-    // Read the second matrix from W2.txt
-    for (int i = 0; i < 128; i++) {
-        for (int j = 0; j < 10; j++) {
-            fscanf(f2, "%lf", &matrix2[i][j]);
+        // A full band with more to come goes to the scratch file
+        int last = (filled < band);
+        if (!last && scratch == NULL) {
+            scratch = fopen(scratchPath, "w+b");
+            if (scratch == NULL) {
+                perror("Error creating the scratch file");
+                status = 1;
+                break;
+            }
         }
+        transposeMatrix(rowsIn, cols, colsOut, filled, (int)filled, (int)cols);
+        rows += filled;
+        if (scratch != NULL && fwrite(colsOut, sizeof(double) * cols, filled, scratch) != filled) {
+            fprintf(stderr, "Error writing %s\n", scratchPath);
+            status = 1;
+        }
+        if (last) break;
+        filled = 0;
+    }
+    free(rowsIn);
+    fclose(r.f);
+    free(r.buf);
+
+    FILE *f = (status == 0) ? fopen(out, "w") : NULL;
+    if (status == 0 && f == NULL) {
+        fprintf(stderr, "Error creating %s\n", out);
+        status = 1;
     }
 
-    // Write the transposed matrix to W2_transpose.txt
-    for (int i = 0; i < 10; i++) {
-        for (int j = 0; j < 128; j++) {
-            fprintf(f4, "%.17lf ", matrix2[j][i]);
+    // --- Pass 2: groups of output rows from every band's slice ---
+    if (status == 0 && scratch == NULL) {
+        status = writeRows(f, colsOut, (int)cols, (int)rows);     // One band: already in memory
+    } else if (status == 0) {
+        free(colsOut);
+        size_t group = budget / (sizeof(double) * (rows + band));
+        if (group < 1) group = 1;
+        if (group > cols) group = cols;
+        double *outRows = malloc(sizeof(double) * group * rows);
+        colsOut = malloc(sizeof(double) * group * band);
+        status = (outRows == NULL || colsOut == NULL) ? 1 : 0;
+
+        for (size_t c0 = 0; c0 < cols && status == 0; c0 += group) {
+            size_t count = (c0 + group < cols) ? group : cols - c0;
+            for (size_t b0 = 0; b0 < rows && status == 0; b0 += band) {
+                size_t height = (b0 + band < rows) ? band : rows - b0;
+                // Band b0 holds `height` values per column; columns c0.. are contiguous
+                if (seekFile(scratch, (off_t)(sizeof(double) * (b0 * cols + c0 * height)), SEEK_SET) != 0 ||
+                    fread(colsOut, sizeof(double) * height, count, scratch) != count) {
+                    fprintf(stderr, "Error reading %s\n", scratchPath);
+                    status = 1;
+                    break;
+                }
+                for (size_t c = 0; c < count; c++) {
+                    memcpy(outRows + c * rows + b0, colsOut + c * height, sizeof(double) * height);
+                }
+            }
+            if (status == 0) status = writeRows(f, outRows, (int)count, (int)rows);
         }
-        fprintf(f4, "\n");
+        free(outRows);
     }
+    free(colsOut);
+
+    if (scratch != NULL) {
+        fclose(scratch);
+        remove(scratchPath);
+    }
+    free(scratchPath);
+    if (f != NULL && fclose(f) != 0) status = 1;
+    if (status != 0) {
+        fprintf(stderr, "Error transposing %s\n", in);
+        if (f != NULL) remove(out);
+        return 1;
+    }
+    printf("Wrote %s (%zu x %zu)\n", out, cols, rows);
+    return 0;
+}
 
-    fclose(f1);
-    fclose(f2);
-    fclose(f3);
-    fclose(f4);
+int main(int argc, char *argv[]) {
+    const char *in = NULL, *out = NULL;
+    double megabytes = 64;
+    int usage = 0;
 
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            megabytes = atof(argv[++i]);
+        } else if (argv[i][0] != '-' && in == NULL) {
+            in = argv[i];
+        } else if (argv[i][0] != '-' && out == NULL) {
+            out = argv[i];
+        } else {
+            usage = 1;
+            break;
+        }
+    }
+    if (usage || megabytes <= 0 || (in != NULL && out == NULL)) {
+        printf("usage: %s [-m MB] [in.txt out.txt]\n", argv[0]);
+        return 1;
+    }
+    size_t budget = (size_t)(megabytes * 1024 * 1024);
+
+    double started = nowSeconds();
+    if (in != NULL) {
+        if (transposeFile(in, out, budget) != 0) return 1;
+    } else {
+        int h;
+        for (h = 1; ; h++) {
+            char wname[64], tname[64];
+            snprintf(wname, sizeof(wname), "W%d.txt", h);
+            snprintf(tname, sizeof(tname), "W%d_transpose.txt", h);
+            FILE *probe = fopen(wname, "rb");
+            if (probe == NULL) break;
+            fclose(probe);
+            if (transposeFile(wname, tname, budget) != 0) return 1;
+        }
+        if (h == 1) {
+            printf("Error: no W1.txt in the working directory\n");
+            return 1;
+        }
+    }
+    printf("Done in %.2f s\n", nowSeconds() - started);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,72 @@
+// Program to find the fastest GEMM block sizes for this machine and save them
+// to the profile file gemm() reads at startup
+//
+// usage: tune [-m model.nnb] [-s MxNxK] [-t seconds] [-o file]
+//   -m  tune on the model's largest layer as the batched pass runs it
+//       (neurons x NN_GEMM_BATCH samples x inputs)
+//   -s  product to tune on (default 128x256x784, the digit network's first layer)
+//   -t  seconds to spend (default 10)
+//   -o  profile to write (default gemm.tune; set NN_GEMM_TUNING to read another)
+//
+// Prints every candidate's GFLOP/s and the speed of the default sizes, then
+// writes the winner. The profile applies to the kernel table that was
+// active (NN_KERNEL picks another); rerun it on each kind of machine.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nn.h"
+#include "kernels.h"
+#include "gemm.h"
+
+int main(int argc, char *argv[]) {
+    const char *out = NN_GEMM_PROFILE, *modelPath = NULL;
+    int m = 128, cols = NN_GEMM_BATCH, k = 784;
+    double seconds = 10;
+    int usage = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            modelPath = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%dx%d", &m, &cols, &k) != 3) usage = 1;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else {
+            usage = 1;
+            break;
+        }
+    }
+    if (usage || seconds <= 0 || m <= 0 || cols <= 0 || k <= 0) {
+        printf("usage: %s [-m model.nnb] [-s MxNxK] [-t seconds] [-o file]\n", argv[0]);
+        return 1;
+    }
+
+    if (modelPath != NULL) {
+        if (loadNetwork(modelPath) != 0) return 1;
+        double largest = 0;
+        for (int h = 1; h < n; h++) {
+            if ((double)Network[h].size * Network[h].inputs > largest) {
+                largest = (double)Network[h].size * Network[h].inputs;
+                m = Network[h].size;
+                k = Network[h].inputs;
+            }
+        }
+        freeNetwork();
+    } else {
+        printf("Using %s kernels\n", selectKernels()->name);
+    }
+
+    printf("Tuning a %dx%dx%d product for %.0f s (%dx%d microkernel)\n", m, cols, k, seconds,
+           nnKernels->gemmRows, nnKernels->gemmCols);
+    GemmTuning best;
+    double gflops;
+    if (tuneGemm(m, cols, k, seconds, &best, &gflops, stdout) != 0) return 1;
+    printf("Best: mc %d, kc %d, nc %d at %.2f GFLOP/s\n", best.mc, best.kc, best.nc, gflops);
+
+    if (saveGemmTuning(out, &best) != 0) return 1;
+    printf("Wrote %s\n", out);
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Program to compare a reduced-precision network against the fp64 one on a labelled set
+//
+// usage: validate [-p fp32|fp16|int8] [-m model.nnb] images.idx labels.idx
+//   -p  precision to validate (default int8)
+//   -m  binary model to load (default: the text files, like main.c)
+//
+// Reports accuracy of both, top-1 agreement, the largest logit deviation,
+// weight memory and throughput.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "nn.h"
+#include "idx.h"
+
+#define CHUNK 1024   // Samples converted and scored at a time
+
+static double nowSeconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char *argv[]) {
+    const char *precisionName = "int8";
+    const char *modelPath = NULL;
+    const char *paths[2] = { NULL, NULL };
+    int positional = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            precisionName = argv[++i];
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            modelPath = argv[++i];
+        } else if (argv[i][0] != '-' && positional < 2) {
+            paths[positional++] = argv[i];
+        } else {
+            positional = -1;
+            break;
+        }
+    }
+    int target = precisionFromName(precisionName);
+    if (positional != 2 || target < 0 || target == NN_PRECISION_FP64) {
+        printf("usage: %s [-p fp32|fp16|int8] [-m model.nnb] images.idx labels.idx\n", argv[0]);
+        return 1;
+    }
+
+    // --- Load the model and the data set ---
+    setNetworkPrecision(NN_PRECISION_FP64);
+    if (modelPath != NULL) {
+        if (loadNetwork(modelPath) != 0) return 1;
+    } else {
+        initializeNetwork(network_structure, n);
+        if (importNetwork() != 0) return 1;
+    }
+
+    IdxFile images, labels;
+    if (openIdx(paths[0], &images) != 0) return 1;
+    if (openIdx(paths[1], &labels) != 0) return 1;
+    if (images.itemSize != (size_t)Network[0].size || labels.count < images.count) {
+        printf("Error: data set does not match the network input (%zu pixels, %zu labels)\n",
+               images.itemSize, labels.count);
+        return 1;
+    }
+
+    const int inSize = Network[0].size;
+    const int outSize = Network[n-1].size;
+    double *inputs = malloc(sizeof(double) * CHUNK * inSize);
+    double *reference = malloc(sizeof(double) * CHUNK * outSize);
+    double *reduced = malloc(sizeof(double) * CHUNK * outSize);
+    if (inputs == NULL || reference == NULL || reduced == NULL) {
+        printf("Error: out of memory\n");
+        return 1;
+    }
+
+    setNetworkPrecision(NN_PRECISION_FP64);
+    size_t referenceBytes = networkWeightBytes();
+    if (setNetworkPrecision(target) != 0) return 1;
+    size_t reducedBytes = networkWeightBytes();
+
+    // --- Score both precisions chunk by chunk ---
+    size_t correctRef = 0, correctRed = 0, agree = 0;
+    double maxDeviation = 0.0, timeRef = 0.0, timeRed = 0.0;
+
+    for (size_t start = 0; start < images.count; start += CHUNK) {
+        int count = (int)((images.count - start < CHUNK) ? images.count - start : CHUNK);
+        idxToInput(images.data + start * images.itemSize, (size_t)count * inSize, inputs);
+
+        setNetworkPrecision(NN_PRECISION_FP64);
+        double t0 = nowSeconds();
+        feedForwardBatch(inputs, count, reference, 0);
+        double t1 = nowSeconds();
+        setNetworkPrecision(target);
+        double t2 = nowSeconds();
+        feedForwardBatch(inputs, count, reduced, 0);
+        double t3 = nowSeconds();
+        timeRef += t1 - t0;
+        timeRed += t3 - t2;
+
+        for (int b = 0; b < count; b++) {
+            const double *r = reference + (size_t)b * outSize;
+            const double *q = reduced + (size_t)b * outSize;
+            int predRef = 0, predRed = 0;
+            for (int o = 0; o < outSize; o++) {
+                if (r[o] > r[predRef]) predRef = o;
+                if (q[o] > q[predRed]) predRed = o;
+                double d = fabs(r[o] - q[o]);
+                if (d > maxDeviation) maxDeviation = d;
+            }
+            int label = labels.data[start + b];
+            correctRef += (predRef == label);
+            correctRed += (predRed == label);
+            agree += (predRef == predRed);
+        }
+    }
+
+    // --- Report ---
+    double total = (double)images.count;
+    printf("\n--- %s vs fp64 on %zu samples ---\n", precisionName, images.count);
+    printf("Weights:             %.1f KB -> %.1f KB (%.1fx smaller)\n",
+           referenceBytes / 1024.0, reducedBytes / 1024.0, (double)referenceBytes / reducedBytes);
+    printf("Accuracy fp64:       %.2f%%\n", 100.0 * correctRef / total);
+    printf("Accuracy %-10s  %.2f%% (%+.2f%%)\n", precisionName, 100.0 * correctRed / total,
+           100.0 * ((double)correctRed - (double)correctRef) / total);
+    printf("Top-1 agreement:     %.2f%%\n", 100.0 * agree / total);
+    printf("Max logit deviation: %.3g\n", maxDeviation);
+    printf("Throughput:          %.0f -> %.0f images/s\n", total / timeRef, total / timeRed);
+
+    free(inputs);
+    free(reference);
+    free(reduced);
+    closeIdx(&images);
+    closeIdx(&labels);
+    freeNetwork();
+    return 0;
+}